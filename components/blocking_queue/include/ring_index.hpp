@@ -0,0 +1,171 @@
+/*
+Copyright (C) Yudoc Kim <craven@crowz.kr>
+ 
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+ 
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#ifndef RING_INDEX_HPP
+#define RING_INDEX_HPP
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+
+//! \brief Smallest power of two not below capacity, the rings mask their positions with it
+inline constexpr uint32_t ringSize(uint32_t capacity)
+{
+    uint32_t size = 1;
+    while(size < capacity)
+    {
+        size <<= 1;
+    }
+    return size;
+}
+
+//! Positions of a ring between one producer and one consumer, the slots are kept by the ring
+//! \note The producer claims a position, fills its slot and publishes it, the consumer peeks it,
+//!       reads the slot and releases it. Positions run freely, slot() masks them
+class SpscIndex
+{
+public:
+    //! \param size a power of two
+    explicit SpscIndex(uint32_t size) :
+        cMask(size - 1),
+        mHead(0),
+        mTail(0)
+    {
+
+    }
+
+    uint32_t slot(uint32_t pos) const { return pos & cMask; }
+
+    //! \brief Position to fill, false when the ring is full. Producer only
+    bool claim(uint32_t& pos) const
+    {
+        pos = mHead.load(std::memory_order_relaxed);
+        return (pos - mTail.load(std::memory_order_acquire)) <= cMask;
+    }
+
+    //! \brief Hand the filled position to the consumer. Producer only
+    void publish(uint32_t pos)
+    {
+        mHead.store(pos + 1, std::memory_order_release);
+    }
+
+    //! \brief Oldest published position, false when the ring is empty. Consumer only
+    bool peek(uint32_t& pos) const
+    {
+        pos = mTail.load(std::memory_order_relaxed);
+        return mHead.load(std::memory_order_acquire) != pos;
+    }
+
+    //! \brief Give the read position back to the producer. Consumer only
+    void release(uint32_t pos)
+    {
+        mTail.store(pos + 1, std::memory_order_release);
+    }
+
+    //! \brief The position claim() returns while there is room. Producer only
+    uint32_t head() const { return mHead.load(std::memory_order_relaxed); }
+    //! \brief The position peek() returns while there is data. Consumer only
+    uint32_t tail() const { return mTail.load(std::memory_order_relaxed); }
+
+    uint32_t size() const
+    {
+        return mHead.load(std::memory_order_acquire) - mTail.load(std::memory_order_acquire);
+    }
+
+private:
+    const uint32_t cMask;
+    std::atomic<uint32_t> mHead;    // written by the producer
+    std::atomic<uint32_t> mTail;    // written by the consumer
+};
+
+//! Positions of a ring between several producers and one consumer, same use as SpscIndex
+//! \note Each slot has a sequence: equal to a position when the slot is free for it, one more when
+//!       it holds it. The producers race for the head, a slot is published by its sequence only
+class MpscIndex
+{
+public:
+    //! \param size a power of two
+    explicit MpscIndex(uint32_t size) :
+        cMask(size - 1),
+        mpSequences(new std::atomic<uint32_t>[size]),
+        mHead(0),
+        mTail(0)
+    {
+        for(uint32_t i = 0; i < size; i++)
+        {
+            mpSequences[i].store(i, std::memory_order_relaxed);
+        }
+    }
+
+    uint32_t slot(uint32_t pos) const { return pos & cMask; }
+
+    //! \brief Position to fill, false when the ring is full. Any producer
+    bool claim(uint32_t& pos)
+    {
+        pos = mHead.load(std::memory_order_relaxed);
+        while(true)
+        {
+            const int32_t diff = static_cast<int32_t>(mpSequences[pos & cMask].load(std::memory_order_acquire) - pos);
+            if(diff < 0)
+            {
+                return false;   // full
+            }
+            if((diff == 0) and mHead.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                return true;
+            }
+            if(diff > 0)
+            {
+                pos = mHead.load(std::memory_order_relaxed);     // another producer took it
+            }
+        }
+    }
+
+    //! \brief Hand the filled position to the consumer
+    void publish(uint32_t pos)
+    {
+        mpSequences[pos & cMask].store(pos + 1, std::memory_order_release);
+    }
+
+    //! \brief Oldest published position, false when the ring is empty or its producer is still writing it
+    bool peek(uint32_t& pos) const
+    {
+        pos = mTail.load(std::memory_order_relaxed);
+        return mpSequences[pos & cMask].load(std::memory_order_acquire) == (pos + 1);
+    }
+
+    //! \brief Free the read position for the producer a lap later
+    void release(uint32_t pos)
+    {
+        mpSequences[pos & cMask].store(pos + cMask + 1, std::memory_order_release);
+        mTail.store(pos + 1, std::memory_order_release);
+    }
+
+    uint32_t size() const
+    {
+        return mHead.load(std::memory_order_acquire) - mTail.load(std::memory_order_acquire);
+    }
+
+private:
+    const uint32_t cMask;
+    std::unique_ptr<std::atomic<uint32_t>[]> mpSequences;
+    std::atomic<uint32_t> mHead;    // next position to claim
+    std::atomic<uint32_t> mTail;    // written by the consumer
+};
+
+#endif //RING_INDEX_HPP
@@ -0,0 +1,198 @@
+/*
+Copyright (C) Yudoc Kim <craven@crowz.kr>
+ 
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+ 
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#ifndef RING_QUEUE_HPP
+#define RING_QUEUE_HPP
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <type_traits>
+#include "ring_index.hpp"
+
+//! Bounded lock free queue for one consumer and one or, with cMultiProducer, several producers
+//! \note Drop-in for BlockingQueue: push and pop wait up to waitTime on a full or empty queue.
+//!       Only a side that has to wait takes the mutex, the others never block each other.
+//!       The capacity is rounded up to a power of two. The positions are an SpscIndex or an MpscIndex
+template<typename T, bool cMultiProducer = false>
+class RingQueue
+{
+public:
+    RingQueue(uint32_t capacity) :
+        cSize(ringSize(capacity)),
+        mpSlots(new T[cSize]),
+        mIndex(cSize),
+        mConsumerWaiting(false),
+        mProducersWaiting(0)
+    {
+
+    }
+
+    bool push(T&& data, const std::chrono::milliseconds& waitTime)
+    {
+        if(not tryPush(data))
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mProducersWaiting++;
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            const bool pushed = mNotFull.wait_for(lock, waitTime, [&]{ return tryPush(data); });
+            mProducersWaiting--;
+            if(not pushed)
+            {
+                return false;
+            }
+        }
+        wakeConsumer();
+        return true;
+    }
+
+    bool push(const T& data, const std::chrono::milliseconds& waitTime)
+    {
+        T copy(data);
+        return push(std::move(copy), waitTime);
+    }
+
+    //! \brief Move up to count items in, waits up to waitTime for room for the first one that doesn't fit
+    //! \return the number of items pushed, the rest of pData is untouched
+    uint32_t push(T* pData, uint32_t count, const std::chrono::milliseconds& waitTime)
+    {
+        uint32_t pushed = 0;
+        while((pushed < count) and tryPush(pData[pushed]))
+        {
+            pushed++;
+        }
+        if(pushed)
+        {
+            wakeConsumer();
+        }
+        if((pushed < count) and push(std::move(pData[pushed]), waitTime))
+        {
+            pushed++;
+            while((pushed < count) and tryPush(pData[pushed]))
+            {
+                pushed++;
+            }
+            wakeConsumer();
+        }
+        return pushed;
+    }
+
+    bool pop(T& out, const std::chrono::milliseconds& waitTime)
+    {
+        return pop(&out, 1, waitTime) == 1;
+    }
+
+    //! \brief Take up to maxCount items, waits up to waitTime for the first one. Consumer only
+    //! \return the number of items moved to pOut
+    uint32_t pop(T* pOut, uint32_t maxCount, const std::chrono::milliseconds& waitTime)
+    {
+        uint32_t count = 0;
+        while((count < maxCount) and tryPop(pOut[count]))
+        {
+            count++;
+        }
+        if((count == 0) and maxCount)
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mConsumerWaiting = true;
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if(mNotEmpty.wait_for(lock, waitTime, [&]{ return tryPop(pOut[0]); }))
+            {
+                count = 1;
+            }
+            mConsumerWaiting = false;
+        }
+        if(count)
+        {
+            wakeProducers();
+        }
+        return count;
+    }
+
+    size_t size() const { return mIndex.size(); }
+    bool isEmpty() const { return size() == 0; }
+    bool isFull() const { return size() >= cSize; }
+
+private:
+    using Index = std::conditional_t<cMultiProducer, MpscIndex, SpscIndex>;
+
+    const uint32_t cSize;
+    std::unique_ptr<T[]> mpSlots;
+    Index mIndex;
+
+    // slow path, only for waiting
+    std::mutex mMutex;
+    std::condition_variable mNotEmpty;
+    std::condition_variable mNotFull;
+    std::atomic<bool> mConsumerWaiting;
+    std::atomic<uint32_t> mProducersWaiting;
+
+    bool tryPush(T& data)
+    {
+        uint32_t pos;
+        if(not mIndex.claim(pos))
+        {
+            return false;
+        }
+        mpSlots[mIndex.slot(pos)] = std::move(data);
+        mIndex.publish(pos);
+        return true;
+    }
+
+    bool tryPop(T& out)
+    {
+        uint32_t pos;
+        if(not mIndex.peek(pos))
+        {
+            return false;
+        }
+        out = std::move(mpSlots[mIndex.slot(pos)]);
+        mIndex.release(pos);
+        return true;
+    }
+
+    //! the fences pair with the ones of the waiting side, one of the two sees the other
+    void wakeConsumer()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(mConsumerWaiting.load(std::memory_order_relaxed))
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mNotEmpty.notify_one();
+        }
+    }
+
+    void wakeProducers()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(mProducersWaiting.load(std::memory_order_relaxed))
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mNotFull.notify_all();
+        }
+    }
+
+    // not copiable assignable
+    RingQueue(const RingQueue& rhs);
+    RingQueue& operator= (const RingQueue& rhs);
+};
+
+#endif //RING_QUEUE_HPP
@@ -0,0 +1,81 @@
+/*
+Copyright (C) Yudoc Kim <craven@crowz.kr>
+ 
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+ 
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#ifndef SPSC_RING_HPP
+#define SPSC_RING_HPP
+
+#include <stdint.h>
+#include <array>
+#include "ring_index.hpp"
+
+//! Lock free ring between one producer and one consumer task, its slots are used in place
+//! \note The slots are filled and read in place and never destroyed, so a T that owns memory
+//!       (a vector) keeps its capacity from one use to the next
+template<typename T, uint32_t N>
+class SpscRing
+{
+    static_assert((N != 0) and ((N & (N - 1)) == 0), "ring size must be a power of two");
+
+public:
+    SpscRing() :
+        mIndex(N)
+    {
+
+    }
+
+    //! \brief Free slot to fill, nullptr when the ring is full. Producer only
+    T* back()
+    {
+        uint32_t pos;
+        return mIndex.claim(pos) ? &mSlots[mIndex.slot(pos)] : nullptr;
+    }
+
+    //! \brief Hand the slot returned by back() to the consumer. Producer only
+    void push()
+    {
+        mIndex.publish(mIndex.head());
+    }
+
+    //! \brief Oldest filled slot, nullptr when the ring is empty. Consumer only
+    T* front()
+    {
+        uint32_t pos;
+        return mIndex.peek(pos) ? &mSlots[mIndex.slot(pos)] : nullptr;
+    }
+
+    //! \brief Give the slot returned by front() back to the producer. Consumer only
+    void pop()
+    {
+        mIndex.release(mIndex.tail());
+    }
+
+    uint32_t size() const { return mIndex.size(); }
+    bool isEmpty() const { return size() == 0; }
+
+    static constexpr uint32_t capacity() { return N; }
+
+private:
+    std::array<T, N> mSlots;
+    SpscIndex mIndex;
+
+    // not copiable assignable
+    SpscRing(const SpscRing& rhs);
+    SpscRing& operator= (const SpscRing& rhs);
+};
+
+#endif //SPSC_RING_HPP
@@ -25,6 +25,8 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 #include "esp_vfs_dev.h"
 #include "driver/usb_serial_jtag.h"
 #include "driver/usb_serial_jtag_vfs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "uart_bypass.hpp"
 #include "pyocd_io_console.hpp"
 
@@ -57,7 +59,7 @@ std::string Help::help()
     return std::string("print all cmd");
 }
 
-bool Help::excute(const std::vector<std::string>& args)
+bool Help::excute(const std::vector<std::string>&)
 {
     Console::create().help();
     return true;
@@ -30,6 +30,7 @@ public:
     ~PyOcdIoConsole();
 
 protected:
+    SwdExecutor mSwdExecutor;       // its own front-end task, the probe and the sessions are shared
     PyOcdParser mPyOcdParser;
     static constexpr uint32_t cBufSize = 4096;
     char mRxBuff[cBufSize];
@@ -16,7 +16,9 @@ along with this program; if not, write to the Free Software
 Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 */
 
+#include <unistd.h>
 #include "pyocd_io_console.hpp"
+#include "ocd.hpp"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
@@ -26,7 +28,8 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 PyOcdIoConsole::PyOcdIoConsole() :
     PyOcdIo(nullptr),
     Cmd("pyocd"),
-    mPyOcdParser(*this)
+    mSwdExecutor(Ocd::create().getSwd()),
+    mPyOcdParser(*this, mSwdExecutor, &Ocd::create().getArbiter())
 {
 
 }
@@ -47,7 +50,7 @@ std::string PyOcdIoConsole::help()
     return std::string("PyOCD Server Using Console");
 }
 
-bool PyOcdIoConsole::excute(const std::vector<std::string>& args)
+bool PyOcdIoConsole::excute(const std::vector<std::string>&)
 {
     int stdin_fileno = fileno(stdin);
     printf("execute\n");
@@ -66,6 +69,7 @@ bool PyOcdIoConsole::excute(const std::vector<std::string>& args)
         if(len)
         {
             mPyOcdParser.parse(mRxBuff, len);
+            mPyOcdParser.finish();
         }
     }
     return true;
@@ -105,26 +105,19 @@ std::string LineEndMap::getLineEndStr(Map map)
 // UartByPass
 //-------------------------------------------------------------------
 UartByPass::UartByPass() :
-    Client(DebugMsgRx::create(), INT32_MAX - 1),
+    Client(DebugMsgRx::create(), INT32_MAX - 1, Overflow::eDropOldest, cDefaultQueueSize, false),
     Cmd("uart"),
-    Task(__func__),
-    mQueue(20)
+    Task(__func__)
 {
     start();
 }
 
-bool UartByPass::writeStr(const MsgProxy::Msg& msg)
-{
-    mQueue.push(msg.str, std::chrono::milliseconds(10));
-    return true;
-}
-
 std::string UartByPass::help()
 {
     return std::string("Send message direct to the UART");
 }
 
-bool UartByPass::excute(const std::vector<std::string>& args)
+bool UartByPass::excute(const std::vector<std::string>&)
 {
     int stdin_fileno = fileno(stdin);
     printf("Enter usb-uart mode press ctrl+B if you want to exit\n");
@@ -181,14 +174,16 @@ bool UartByPass::excute(const std::vector<std::string>& args)
 
 void UartByPass::task()
 {
+    std::vector<MsgProxy::Msg> batch(MsgProxy::cBatchSize);
     while(mRun)
     {
-        std::vector<uint8_t> str;
-        if(mQueue.pop(str, std::chrono::milliseconds(1000)) and str.size())
+        const uint32_t count = take(batch.data(), batch.size(), std::chrono::milliseconds(1000));
+        for(uint32_t i = 0; i < count; i++)
         {
-            fwrite(str.data(), 1, str.size(), stdout);
+            fwrite(batch[i].str.data(), 1, batch[i].str.size(), stdout);
+            batch[i].clear();
         }
-        if(mQueue.isEmpty())
+        if(isQueueEmpty())
         {
             fflush(stdout);
         }
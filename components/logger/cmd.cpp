@@ -21,6 +21,8 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 #include <sstream>
 #include "status.hpp"
 #include "fs_manager.hpp"
+#include "ocd.hpp"
+#include "swd.hpp"
 
 WebCmd::WebCmd(Type type, SubCmd subCmd) :
     cType(type),
@@ -29,7 +31,7 @@ WebCmd::WebCmd(Type type, SubCmd subCmd) :
 
 }
 
-WebCmd::WebCmd(uint8_t* buffer, uint32_t size) :
+WebCmd::WebCmd(uint8_t* buffer, uint32_t) :
     cType(buffer[0] == (uint8_t)Type::eClientToSever ? Type::eClientToSever :
             buffer[0] == (uint8_t)Type::eServerToClient ? Type::eServerToClient :
             Type::eInvalid),
@@ -58,7 +60,8 @@ UartSetting::UartSetting(int baudrate, int port) :
 {
     std::string uart = FsManager::create().isMount() ? "SD Okay": "SD Error";
     std::ostringstream cmd;
-    cmd << baudrate << " " << port << " " << uart;
+    const uint32_t swdKhz = Ocd::create().getSwd().getClock() / 1000;
+    cmd << baudrate << " " << port << " " << uart << " SWD " << swdKhz << "kHz";
     mCmd = cmd.str();
 }
 
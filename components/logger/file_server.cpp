@@ -71,7 +71,7 @@ esp_err_t FileServerHandler::userHandler(httpd_req *req)
     FILE *fd = NULL;
     struct stat file_stat;
 
-    for(int i = 0; i < strlen(req->uri) + 1; i ++)
+    for(size_t i = 0; i < strlen(req->uri) + 1; i ++)
     {
         if(req->uri[i] == '?')
         {
@@ -25,7 +25,6 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 #include <task.hpp>
 #include "msg_proxy.hpp"
 #include "fs_manager.hpp"
-#include "blocking_queue.hpp"
 
 //! It is SD card class inherit logger client
 class LogFile : public Client, private Task
@@ -37,10 +36,10 @@ public:
 
 protected:
     static constexpr uint32_t cNewFileCreateDurationHours = 12;
+    static constexpr uint32_t cQueueSize = 1024;   // the card stalls for a while on flush
     std::recursive_timed_mutex mMutex;
     FsManager& mFsManager;
     const char* cMountPoint;
-    BlockingQueue<MsgProxy::Msg> mMsgQueue;
 
     FILE* pFile;
     std::string mFilePath;
@@ -56,10 +55,6 @@ protected:
     //! \param length message length
     bool write(const char* msg, uint32_t length);
 
-    //! \brief Write a mesage to the SD card
-    //! \param msg message vector
-    bool writeStr(const MsgProxy::Msg& msg) override;
-
     void task() override;
 };
 
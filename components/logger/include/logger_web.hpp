@@ -39,6 +39,7 @@ protected:
 };
 
 //! To send log messages(UART) to the user web browser.
+//! A viewer on a bad link drops its oldest messages, it doesn't hold up the others.
 class WebLogSender : public Client
 {
 public:
@@ -0,0 +1,113 @@
+/*
+Copyright (C) Yudoc Kim <craven@crowz.kr>
+ 
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+ 
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#ifndef MSG_POOL_HPP
+#define MSG_POOL_HPP
+
+#include <stdint.h>
+#include <atomic>
+#include "sdkconfig.h"
+
+//! A reference counted slab of the MsgPool
+struct MsgBuffer
+{
+    static constexpr uint32_t cSize = 1024;
+
+    std::atomic<uint32_t> refs;
+    bool pooled;                // false: taken from the heap while the pool was empty
+    uint8_t data[cSize];
+};
+
+//! Shares part of a MsgBuffer, the buffer goes back to the pool with its last reference
+class MsgRef
+{
+public:
+    MsgRef() : mpBuffer(nullptr), mOffset(0), mLength(0) {}
+    MsgRef(MsgBuffer* pBuffer, uint32_t offset, uint32_t length);
+    MsgRef(const MsgRef& ref);
+    MsgRef(MsgRef&& ref);
+    ~MsgRef() { reset(); }
+
+    MsgRef& operator = (const MsgRef& ref);
+    MsgRef& operator = (MsgRef&& ref);
+
+    const uint8_t* data() const { return mpBuffer ? mpBuffer->data + mOffset : nullptr; }
+    uint32_t size() const { return mLength; }
+    bool empty() const { return mLength == 0; }
+    void reset();
+
+protected:
+    MsgBuffer* mpBuffer;
+    uint32_t mOffset;
+    uint32_t mLength;
+};
+
+//! Fixed slab of message buffers, so the UART path doesn't churn the heap
+//! \note The free list is a bitmap, taking and returning a buffer is a single CAS from any task
+//! \note The clients queue more messages than there are buffers, a slow sink like the SD card can hold
+//! all of them. The heap covers a burst up to cMaxHeapCount buffers, past that the message is dropped.
+class MsgPool
+{
+public:
+    static constexpr uint32_t cCount = CONFIG_LOG_MSG_POOL_COUNT;
+    static_assert(cCount <= 32, "the free list is one word");
+    static constexpr uint32_t cMaxHeapCount = CONFIG_LOG_MSG_MAX_HEAP_COUNT;
+
+    static MsgPool& create();
+
+    //! \brief A buffer with one reference, from the heap when the pool is empty
+    //! \return nullptr when the heap buffers are used up too, counted as a drop
+    MsgBuffer* allocate();
+    void release(MsgBuffer* pBuffer);
+
+    //! \brief Allocations refused since the last call
+    uint32_t takeDropped() { return mDropped.exchange(0); }
+
+protected:
+    MsgBuffer mBuffers[cCount];
+    std::atomic<uint32_t> mFree;        // bit n: mBuffers[n] is free
+    std::atomic<uint32_t> mHeapCount;   // buffers from the heap in use
+    std::atomic<uint32_t> mHeapTotal;   // buffers taken from the heap so far
+    std::atomic<uint32_t> mDropped;     // allocations refused
+
+    MsgPool();
+    ~MsgPool() = default;
+};
+
+//! Packs the messages of one writer into shared buffers
+//! \note Not thread safe, each writer task has its own
+class MsgArena
+{
+public:
+    MsgArena() : mpBuffer(nullptr), mUsed(0) {}
+    ~MsgArena();
+
+    //! \brief Room at the end of the current buffer, a new buffer when less than minRoom is left
+    //! \return nullptr and no room when the pool is exhausted
+    uint8_t* reserve(uint32_t minRoom, uint32_t& room);
+    //! \brief Reference to length bytes written at pData, then taken from the room
+    MsgRef commit(const uint8_t* pData, uint32_t length);
+    //! \brief Copy data into the arena, an empty reference when the pool is exhausted
+    MsgRef copy(const void* data, uint32_t length);
+
+protected:
+    MsgBuffer* mpBuffer;        // the arena keeps one reference on it
+    uint32_t mUsed;
+};
+
+#endif //MSG_POOL_HPP
@@ -23,8 +23,12 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 #include <memory>
 #include <list>
 #include <mutex>
+#include <condition_variable>
+#include <chrono>
 #include <vector>
-#include "blocking_queue.hpp"
+#include <atomic>
+#include "ring_queue.hpp"
+#include "msg_pool.hpp"
 #include "task.hpp"
 
 class Client;
@@ -34,26 +38,19 @@ class Client;
 class MsgProxy : public Task
 {
 public:
-    static constexpr uint32_t cQueueSize = 100;
+    static constexpr uint32_t cQueueSize = 128;
+    static constexpr uint32_t cBatchSize = 16;     // messages a task takes from the queue at once
     static constexpr char cStrEnd = '\n';
 
     struct Msg
     {
-        std::vector<uint8_t> str;
-        bool newLine;
-        struct timeval time;
+        MsgRef str;                 // shared by all the clients, no copies
+        bool newLine = false;
+        struct timeval time = {};
     
         void clear()
         {
-            str.clear();
-        }
-
-        Msg& operator = (const Msg& msg)
-        {
-            this->str = std::move(msg.str);
-            time = msg.time;
-            newLine = msg.newLine;
-            return *this;
+            str.reset();
         }
     };
 
@@ -71,10 +68,21 @@ public:
     //! sendMsg() will pop messages form the queue and send its clients
     bool write(uint8_t* msg, uint32_t length, bool newLine);
 
-    static std::vector<uint8_t> getHeader(const struct timeval& time);
+    //! \brief Write a message already in a pool buffer, from the MsgArena of the writer
+    bool write(MsgRef&& str, bool newLine);
+
+    //! \brief Write the lines of a chunk with one queue operation, they share its time stamp
+    //! \param pMsgs str and newLine set by the writer, the messages are moved out
+    //! \return the number of the messages queued
+    uint32_t write(Msg* pMsgs, uint32_t count);
+
+    static MsgRef getHeader(const struct timeval& time, MsgArena& arena);
 
 protected:
-    BlockingQueue<Msg> mQueue;
+    RingQueue<Msg, true> mQueue;        // the web socket and the console both write to the UART
+    std::atomic<uint32_t> mDropped;     // messages write() couldn't queue
+    std::mutex mArenaMutex;             // for the writers that copy
+    MsgArena mArena;
     std::list<Client*> mClientList;
     std::recursive_mutex mMutex;
 
@@ -82,27 +90,93 @@ protected:
     virtual ~MsgProxy();
 
     //! \brief send messages to the clients.
-    //! \note child class must call this to send data to the clients.  
+    //! \note child class must call this to send data to the clients.
+    //! It only queues the message to each client, a slow client never holds up the others.
     void sendTimeStamp(const Msg& msg);
     void sendStr(const Msg& msg);
+    //! \brief Log the messages dropped since the last call, the proxy's and the clients'
+    void reportDropped();
+
+private:
+    void send(const Msg& msg, bool timeStamp);
 };
 
 //! It's a interface class to receive messages from the proxy.
+//! Every client has its own bounded queue, the proxy task only puts messages in it.
+//! A client either takes them in a task of its own or lets startDelivery() call writeStr().
 class Client
 {
 public:
+    //! What to do with a message when the queue of the client is full
+    enum class Overflow
+    {
+        eBlock,         // wait cBlockTime for room, then drop the new message
+        eDropOldest,    // make room by dropping the oldest message
+        eDropNewest,    // drop the new message
+        eDisconnect,    // the client can't keep up, remove it
+    };
+
+    static constexpr uint32_t cDefaultQueueSize = 64;
+    static constexpr std::chrono::milliseconds cBlockTime{100};
+
     const int cId;
-    Client(MsgProxy& debugMsg, int id);
+    Client(MsgProxy& debugMsg, int id, Overflow overflow = Overflow::eDropOldest,
+        uint32_t queueSize = cDefaultQueueSize, bool timeStamps = true);
     virtual ~Client();
 
-    //! \brief write time stamp
-    virtual bool writeTimeStamp(const MsgProxy::Msg& msg) { return writeStr(msg); };
+    //! \brief Queue a message for the client, the proxy task calls it
+    //! \return false if the client has to be removed
+    bool post(const MsgProxy::Msg& msg, bool timeStamp);
 
-    //! \brief write string
-    virtual bool writeStr(const MsgProxy::Msg& msg) { return true; };
+    //! \brief Number of the messages dropped by the overflow policy
+    uint32_t getDropped() const { return mDropped; };
 
 protected:
     MsgProxy& mDebugMsg;
+
+    //! \brief write string, called by the delivery task
+    virtual bool writeStr(const MsgProxy::Msg&) { return true; };
+
+    //! \brief Take messages from the queue, for a client with its own task
+    //! \return the number of the messages moved to msgs
+    uint32_t take(MsgProxy::Msg* msgs, uint32_t maxCount, std::chrono::milliseconds wait);
+
+    //! \brief Is the queue empty?
+    bool isQueueEmpty();
+
+    //! \brief Deliver the queue with writeStr() on a task of the client
+    //! \note call it at the end of the child constructor and
+    //! stopDelivery() in the child destructor, writeStr() is virtual.
+    void startDelivery();
+    void stopDelivery();
+
+private:
+    friend class MsgProxy;
+
+    //! The task that calls writeStr()
+    class Delivery : public Task
+    {
+    public:
+        Delivery(Client& client);
+        ~Delivery();
+
+    protected:
+        Client& mClient;
+        void task() override;
+    };
+
+    const Overflow cOverflow;
+    const bool cTimeStamps;         // false, the time stamps are not queued
+    std::mutex mQueueMutex;
+    std::condition_variable mNotEmpty;
+    std::condition_variable mNotFull;
+    std::vector<MsgProxy::Msg> mSlots;
+    uint32_t mHead;
+    uint32_t mCount;
+    std::atomic<bool> mClosed;      // a write failed or the queue overflowed with eDisconnect
+    std::atomic<uint32_t> mDropped;
+    uint32_t mReported;             // mDropped at the last report, the proxy task's
+    std::unique_ptr<Delivery> mpDelivery;
 };
 
 //! It will handle the messages from the UART
@@ -112,6 +186,8 @@ public:
     static DebugMsgRx& create();
 
 protected:
+    MsgArena mHeaderArena;          // time stamps, the task's own
+
     DebugMsgRx();
     ~DebugMsgRx();
     void task() override;
@@ -22,6 +22,8 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 #include <vector>
 #include <thread>
 #include <atomic>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
 #include "msg_proxy.hpp"
 #include "task.hpp"
 #include "console.hpp"
@@ -31,7 +33,7 @@ class UartTx : public Client
 {
 public:
     UartTx(int uartPortNum);
-    ~UartTx() = default;
+    ~UartTx();
     
 protected:
     const int cUartNum;
@@ -39,15 +41,31 @@ protected:
 };
 
 //! For receinv message from the UART
+//! It sleeps on the event queue of the driver, a quiet target costs no CPU.
 class UartRx : public Task
 {
 public:
-    UartRx(int uartPortNum);
+    UartRx(int uartPortNum, QueueHandle_t eventQueue);
     ~UartRx() = default;
     
 protected:
+    static constexpr uint32_t cMinReadSize = 128;   // a fresh pool buffer below this
+    static constexpr uint32_t cStopCheckMs = 1000;  // the only wake up of an idle line
+    static constexpr uint32_t cMaxLines = 64;       // lines per queue operation
     const int cUartNum;
+    const QueueHandle_t cEventQueue;
+    MsgProxy& mProxy;
+    MsgArena mArena;            // the UART is read straight into pool buffers
+    std::vector<MsgProxy::Msg> mLines;
+    bool mNewLine;
+
     void task() override;
+
+    //! \brief Read what the driver has buffered and pass it on line by line
+    void read();
+
+    //! \brief Split a chunk read into the arena into lines and write them together
+    void split(uint8_t* buffer, uint32_t length);
 };
 
 class SettingCmd : protected Cmd
@@ -94,7 +112,11 @@ protected:
     static constexpr int cRxPin = 7;
 #endif
 
+    static constexpr char cLineEnd = '\n';
+    static constexpr int cPatternTimeout = 9;      // baud cycles between the pattern characters
+
     Config mConfig;
+    QueueHandle_t mEventQueue;
     std::unique_ptr<UartRx> pUartRx;
     std::unique_ptr<UartTx> pUartTx;
     SettingCmd mOption;
@@ -29,6 +29,8 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 #include <sstream>
 #include "status.hpp"
 #include "esp_sntp.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 
 using namespace std::chrono_literals;
 static const char *TAG = "logFile";
@@ -40,11 +42,10 @@ LogFile& LogFile::create()
 }
 
 LogFile::LogFile() :
-    Client(DebugMsgRx::create(), INT32_MAX),
+    Client(DebugMsgRx::create(), INT32_MAX, Overflow::eDropNewest, cQueueSize),
     Task(__func__),
     mFsManager(FsManager::create()),
     cMountPoint(mFsManager.getMountPoint()),
-    mMsgQueue(1024),
     pFile(nullptr)
 {
 
@@ -129,12 +130,6 @@ FILE* LogFile::createFile()
     return fopen(mFilePath.c_str(), "w");
 }
 
-bool LogFile::writeStr(const MsgProxy::Msg& msg)
-{
-    mMsgQueue.push(msg, 0ms);
-    return true;
-}
-
 void LogFile::task()
 {
     while(mRun and (sntp_get_sync_status() != sntp_sync_status_t::SNTP_SYNC_STATUS_COMPLETED))
@@ -150,10 +145,11 @@ void LogFile::task()
     }
 
     auto start = std::chrono::steady_clock::now();
+    std::vector<MsgProxy::Msg> batch(MsgProxy::cBatchSize);
     while(mRun)
     {
-        MsgProxy::Msg msg;
-        if(mMsgQueue.pop(msg, 100ms))
+        const uint32_t count = take(batch.data(), batch.size(), 100ms);
+        if(count)
         {
             std::lock_guard<std::recursive_timed_mutex> lock(mMutex);
             const auto now = std::chrono::steady_clock::now();
@@ -169,18 +165,25 @@ void LogFile::task()
                 start = now;
             }
 
+            for(uint32_t i = 0; i < count; i++)
+            {
+                if(pFile != nullptr)
+                {
+                    fwrite(batch[i].str.data(), 1, batch[i].str.size(), pFile);
+                }
+                batch[i].clear();
+            }
+
             if(pFile == nullptr)
             {
                 continue;
             }
-            
-            fwrite(msg.str.data(), 1, msg.str.size(), pFile);
 
-            if(mMsgQueue.isEmpty())
+            if(isQueueEmpty())
             {
                 fflush(pFile);
                 fsync(fileno(pFile));
             }
         }
     }
-}
\ No newline at end of file
+}
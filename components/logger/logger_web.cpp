@@ -61,12 +61,12 @@ WebLogSender::WebLogSender(httpd_handle_t hd, int fd) :
     hd(hd),
     fd(fd)
 {
-
+    startDelivery();
 }
 
 WebLogSender::~WebLogSender()
 {
-
+    stopDelivery();
 }
 
 bool WebLogSender::writeStr(const MsgProxy::Msg& msg)
@@ -99,20 +99,6 @@ WsHandler::WsHandler() :
 {
 }
 
-static std::string string_to_hex(const std::string& input)
-{
-    static const char hex_digits[] = "0123456789ABCDEF";
-
-    std::string output;
-    output.reserve(input.length() * 2);
-    for (unsigned char c : input)
-    {
-        output.push_back(hex_digits[c >> 4]);
-        output.push_back(hex_digits[c & 15]);
-    }
-    return output;
-}
-
 esp_err_t WsHandler::userHandler(httpd_req *req)
 {
     std::unique_lock<std::mutex> lock(mMutex);
@@ -159,7 +145,7 @@ esp_err_t WsHandler::userHandler(httpd_req *req)
 
             if(httpd_ws_send_frame_async(req->handle, httpd_req_to_sockfd(req), &ws_pkt) != ESP_OK)
             {
-                ESP_LOGE(TAG, "Error fd %d", (int)req->handle);
+                ESP_LOGE(TAG, "Error fd %d", httpd_req_to_sockfd(req));
             }
             break;
         }
@@ -0,0 +1,206 @@
+/*
+Copyright (C) Yudoc Kim <craven@crowz.kr>
+ 
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+ 
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#include <string.h>
+#include <algorithm>
+#include "msg_pool.hpp"
+#include "esp_log.h"
+
+static const char *TAG = "MsgPool";
+
+//-------------------------------------------------------------------
+// MsgRef
+//-------------------------------------------------------------------
+MsgRef::MsgRef(MsgBuffer* pBuffer, uint32_t offset, uint32_t length) :
+    mpBuffer(pBuffer),
+    mOffset(offset),
+    mLength(length)
+{
+    if(mpBuffer)
+    {
+        mpBuffer->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+MsgRef::MsgRef(const MsgRef& ref) :
+    MsgRef(ref.mpBuffer, ref.mOffset, ref.mLength)
+{
+}
+
+MsgRef::MsgRef(MsgRef&& ref) :
+    mpBuffer(ref.mpBuffer),
+    mOffset(ref.mOffset),
+    mLength(ref.mLength)
+{
+    ref.mpBuffer = nullptr;
+    ref.mLength = 0;
+}
+
+MsgRef& MsgRef::operator = (const MsgRef& ref)
+{
+    if(this != &ref)
+    {
+        MsgRef copy(ref);
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+MsgRef& MsgRef::operator = (MsgRef&& ref)
+{
+    if(this != &ref)
+    {
+        reset();
+        std::swap(mpBuffer, ref.mpBuffer);
+        std::swap(mOffset, ref.mOffset);
+        std::swap(mLength, ref.mLength);
+    }
+    return *this;
+}
+
+void MsgRef::reset()
+{
+    if(mpBuffer)
+    {
+        MsgPool::create().release(mpBuffer);
+        mpBuffer = nullptr;
+    }
+    mOffset = 0;
+    mLength = 0;
+}
+
+//-------------------------------------------------------------------
+// MsgPool
+//-------------------------------------------------------------------
+MsgPool& MsgPool::create()
+{
+    static MsgPool pool;
+    return pool;
+}
+
+MsgPool::MsgPool() :
+    mFree(cCount == 32 ? UINT32_MAX : (1u << cCount) - 1),
+    mHeapCount(0),
+    mHeapTotal(0),
+    mDropped(0)
+{
+    for(MsgBuffer& buffer : mBuffers)
+    {
+        buffer.refs = 0;
+        buffer.pooled = true;
+    }
+}
+
+MsgBuffer* MsgPool::allocate()
+{
+    uint32_t free = mFree.load(std::memory_order_relaxed);
+    while(free)
+    {
+        const uint32_t idx = __builtin_ctz(free);
+        if(mFree.compare_exchange_weak(free, free & ~(1u << idx), std::memory_order_acquire))
+        {
+            mBuffers[idx].refs.store(1, std::memory_order_relaxed);
+            return &mBuffers[idx];
+        }
+    }
+
+    // every buffer is held by a slow sink, better a heap buffer than a lost line, up to a point
+    const uint32_t heapCount = mHeapCount.fetch_add(1, std::memory_order_relaxed);
+    if(heapCount >= cMaxHeapCount)
+    {
+        mHeapCount.fetch_sub(1, std::memory_order_relaxed);
+        mDropped++;
+        return nullptr;
+    }
+    if((mHeapTotal++ % 100) == 0)
+    {
+        ESP_LOGW(TAG, "pool empty, %lu buffers from the heap", (unsigned long)mHeapTotal.load());
+    }
+    MsgBuffer* pBuffer = new MsgBuffer;
+    pBuffer->refs.store(1, std::memory_order_relaxed);
+    pBuffer->pooled = false;
+    return pBuffer;
+}
+
+void MsgPool::release(MsgBuffer* pBuffer)
+{
+    if(pBuffer->refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+    {
+        return;
+    }
+    if(pBuffer->pooled)
+    {
+        mFree.fetch_or(1u << (pBuffer - mBuffers), std::memory_order_release);
+    }
+    else
+    {
+        delete pBuffer;
+        mHeapCount.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+//-------------------------------------------------------------------
+// MsgArena
+//-------------------------------------------------------------------
+MsgArena::~MsgArena()
+{
+    if(mpBuffer)
+    {
+        MsgPool::create().release(mpBuffer);
+    }
+}
+
+uint8_t* MsgArena::reserve(uint32_t minRoom, uint32_t& room)
+{
+    if((mpBuffer == nullptr) or (MsgBuffer::cSize - mUsed < minRoom))
+    {
+        if(mpBuffer)
+        {
+            MsgPool::create().release(mpBuffer);
+        }
+        mpBuffer = MsgPool::create().allocate();
+        mUsed = 0;
+        if(mpBuffer == nullptr)
+        {
+            room = 0;
+            return nullptr;
+        }
+    }
+    room = MsgBuffer::cSize - mUsed;
+    return mpBuffer->data + mUsed;
+}
+
+MsgRef MsgArena::commit(const uint8_t* pData, uint32_t length)
+{
+    const uint32_t offset = pData - mpBuffer->data;
+    mUsed = std::max(mUsed, offset + length);
+    return MsgRef(mpBuffer, offset, length);
+}
+
+MsgRef MsgArena::copy(const void* data, uint32_t length)
+{
+    uint32_t room;
+    uint8_t* p = reserve(std::min(length, MsgBuffer::cSize), room);
+    if(p == nullptr)
+    {
+        return MsgRef();
+    }
+    length = std::min(length, room);
+    memcpy(p, data, length);
+    return commit(p, length);
+}
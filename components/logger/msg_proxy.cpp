@@ -21,6 +21,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 #include <sstream>
 #include <regex>
 #include <string.h>
+#include <sys/time.h>
 #include "msg_proxy.hpp"
 #include "esp_log.h"
 
@@ -28,9 +29,17 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 //-------------------------------------------------------------------
 // Client
 //-------------------------------------------------------------------
-Client::Client(MsgProxy& debugMsg, int id) :
+Client::Client(MsgProxy& debugMsg, int id, Overflow overflow, uint32_t queueSize, bool timeStamps) :
     cId(id),
-    mDebugMsg(debugMsg)
+    mDebugMsg(debugMsg),
+    cOverflow(overflow),
+    cTimeStamps(timeStamps),
+    mSlots(queueSize),
+    mHead(0),
+    mCount(0),
+    mClosed(false),
+    mDropped(0),
+    mReported(0)
 {
     mDebugMsg.addClient(*this);
 }
@@ -38,6 +47,128 @@ Client::Client(MsgProxy& debugMsg, int id) :
 Client::~Client()
 {
     mDebugMsg.removeClient(*this);
+    stopDelivery();
+}
+
+bool Client::post(const MsgProxy::Msg& msg, bool timeStamp)
+{
+    if(mClosed)
+    {
+        return false;
+    }
+    if(timeStamp and not cTimeStamps)
+    {
+        return true;
+    }
+
+    std::unique_lock<std::mutex> lock(mQueueMutex);
+    if(mCount == mSlots.size())
+    {
+        switch(cOverflow)
+        {
+        case Overflow::eBlock:
+            if(not mNotFull.wait_for(lock, cBlockTime, [this]{ return mCount < mSlots.size() or mClosed; }) or mClosed)
+            {
+                mDropped++;
+                return not mClosed;
+            }
+            break;
+        case Overflow::eDropOldest:
+            mSlots[mHead].clear();
+            mHead = (mHead + 1) % mSlots.size();
+            mCount--;
+            mDropped++;
+            break;
+        case Overflow::eDropNewest:
+            mDropped++;
+            return true;
+        case Overflow::eDisconnect:
+            mDropped++;
+            mClosed = true;
+            return false;
+        }
+    }
+
+    mSlots[(mHead + mCount) % mSlots.size()] = msg;
+    mCount++;
+    lock.unlock();
+    mNotEmpty.notify_one();
+    return true;
+}
+
+uint32_t Client::take(MsgProxy::Msg* msgs, uint32_t maxCount, std::chrono::milliseconds wait)
+{
+    std::unique_lock<std::mutex> lock(mQueueMutex);
+    if(not mNotEmpty.wait_for(lock, wait, [this]{ return mCount > 0; }))
+    {
+        return 0;
+    }
+
+    const uint32_t count = std::min(maxCount, mCount);
+    for(uint32_t i = 0; i < count; i++)
+    {
+        msgs[i] = std::move(mSlots[mHead]);
+        mSlots[mHead].clear();
+        mHead = (mHead + 1) % mSlots.size();
+    }
+    mCount -= count;
+    lock.unlock();
+    mNotFull.notify_one();
+    return count;
+}
+
+bool Client::isQueueEmpty()
+{
+    std::lock_guard<std::mutex> lock(mQueueMutex);
+    return mCount == 0;
+}
+
+void Client::startDelivery()
+{
+    if(mpDelivery == nullptr)
+    {
+        mpDelivery = std::make_unique<Delivery>(*this);
+        mpDelivery->start();
+    }
+}
+
+void Client::stopDelivery()
+{
+    if(mpDelivery)
+    {
+        mpDelivery->stop();
+        mpDelivery.reset();
+    }
+}
+
+Client::Delivery::Delivery(Client& client) :
+    Task("Client::Delivery"),
+    mClient(client)
+{
+}
+
+Client::Delivery::~Delivery()
+{
+    stop();
+}
+
+void Client::Delivery::task()
+{
+    std::vector<MsgProxy::Msg> batch(MsgProxy::cBatchSize);
+    while(mRun)
+    {
+        const uint32_t count = mClient.take(batch.data(), batch.size(), std::chrono::milliseconds(100));
+        for(uint32_t i = 0; i < count; i++)
+        {
+            if(not mClient.mClosed and not mClient.writeStr(batch[i]))
+            {
+                // the proxy removes the client at its next message
+                mClient.mClosed = true;
+                mClient.mNotFull.notify_one();
+            }
+            batch[i].clear();
+        }
+    }
 }
 
 //-------------------------------------------------------------------
@@ -45,7 +176,8 @@ Client::~Client()
 //-------------------------------------------------------------------
 MsgProxy::MsgProxy(const char* cName) :
     Task(cName),
-    mQueue(cQueueSize)
+    mQueue(cQueueSize),
+    mDropped(0)
 {
 }
 
@@ -87,38 +219,105 @@ bool MsgProxy::isAdded(int id)
 
 bool MsgProxy::write(uint8_t* msg, uint32_t length, bool newLine)
 {
-    Msg _msg
+    std::lock_guard<std::mutex> lock(mArenaMutex);
+    bool ret = true;
+    do
     {
-        .str = std::vector<uint8_t>(msg, msg+length),
-        .newLine = newLine,
-    };
+        // longer than a buffer: the rest continues the line
+        MsgRef str = mArena.copy(msg, length);
+        if(str.empty())
+        {
+            // the pool counted the drop
+            return false;
+        }
+        msg += str.size();
+        length -= str.size();
+        ret = write(std::move(str), newLine) and ret;
+        newLine = false;
+    } while(length);
+    return ret;
+}
+
+bool MsgProxy::write(MsgRef&& str, bool newLine)
+{
+    Msg _msg;
+    _msg.str = std::move(str);
+    _msg.newLine = newLine;
     gettimeofday(&_msg.time, NULL);
-    return mQueue.push(std::move(_msg), std::chrono::milliseconds(100));
+    if(not mQueue.push(std::move(_msg), std::chrono::milliseconds(100)))
+    {
+        mDropped++;
+        return false;
+    }
+    return true;
 }
 
-void MsgProxy::sendTimeStamp(const Msg& msg)
-{  
-    std::list<Client*> erase;
-    for(auto it = mClientList.begin(); it != mClientList.end(); ++it)
+uint32_t MsgProxy::write(Msg* pMsgs, uint32_t count)
+{
+    struct timeval time;
+    gettimeofday(&time, NULL);
+    for(uint32_t i = 0; i < count; i++)
     {
-        if(*it == nullptr)
-        {
-            continue;
-        }
-        if((*it)->writeTimeStamp(msg) == false)
+        pMsgs[i].time = time;
+    }
+
+    uint32_t pushed = 0;
+    while(pushed < count)
+    {
+        const uint32_t n = mQueue.push(&pMsgs[pushed], count - pushed, std::chrono::milliseconds(100));
+        if(n == 0)
         {
-            erase.push_back(*it);
+            break;
         }
+        pushed += n;
+    }
+    for(uint32_t i = pushed; i < count; i++)
+    {
+        pMsgs[i].clear();
     }
+    mDropped += count - pushed;
+    return pushed;
+}
 
-    for(auto it = erase.begin(); it != erase.end(); ++it)
+void MsgProxy::reportDropped()
+{
+    const uint32_t dropped = mDropped.exchange(0);
+    if(dropped)
     {
-        delete *it;
+        ESP_LOGW(cName, "%lu messages dropped, the queue was full", (unsigned long)dropped);
+    }
+    const uint32_t poolDropped = MsgPool::create().takeDropped();
+    if(poolDropped)
+    {
+        ESP_LOGW(cName, "%lu messages dropped, no message buffer", (unsigned long)poolDropped);
+    }
+
+    std::lock_guard<std::recursive_mutex> lock(mMutex);
+    for(auto pClient : mClientList)
+    {
+        const uint32_t clientDropped = pClient->mDropped;
+        if(clientDropped != pClient->mReported)
+        {
+            ESP_LOGW(cName, "client %d dropped %lu messages, %lu in total", pClient->cId,
+                (unsigned long)(clientDropped - pClient->mReported), (unsigned long)clientDropped);
+            pClient->mReported = clientDropped;
+        }
     }
 }
 
+void MsgProxy::sendTimeStamp(const Msg& msg)
+{
+    send(msg, true);
+}
+
 void MsgProxy::sendStr(const Msg& msg)
 {
+    send(msg, false);
+}
+
+void MsgProxy::send(const Msg& msg, bool timeStamp)
+{
+    std::lock_guard<std::recursive_mutex> lock(mMutex);
     std::list<Client*> erase;
     for(auto it = mClientList.begin(); it != mClientList.end(); ++it)
     {
@@ -126,7 +325,7 @@ void MsgProxy::sendStr(const Msg& msg)
         {
             continue;
         }
-        if((*it)->writeStr(msg) == false)
+        if((*it)->post(msg, timeStamp) == false)
         {
             erase.push_back(*it);
         }
@@ -138,15 +337,21 @@ void MsgProxy::sendStr(const Msg& msg)
     }
 }
 
-std::vector<uint8_t> MsgProxy::getHeader(const struct timeval& time)
+MsgRef MsgProxy::getHeader(const struct timeval& time, MsgArena& arena)
 {
     std::time_t t = time.tv_sec;
-    tm local = *localtime(&t);
+    tm local;
+    localtime_r(&t, &local);
     int ms = time.tv_usec / 1000;
 
-    char str[60];
-    sprintf(str, "[%02dT%02d:%02d:%02d:%03d] ", local.tm_mday, local.tm_hour, local.tm_min, local.tm_sec, ms);
-    return std::vector<uint8_t>(str, str + strlen(str));
+    uint32_t room;
+    char* str = reinterpret_cast<char*>(arena.reserve(60, room));
+    if(str == nullptr)
+    {
+        return MsgRef();
+    }
+    const int length = snprintf(str, room, "[%02dT%02d:%02d:%02d:%03d] ", local.tm_mday, local.tm_hour, local.tm_min, local.tm_sec, ms);
+    return arena.commit(reinterpret_cast<uint8_t*>(str), length);
 }
 
 //-------------------------------------------------------------------
@@ -173,19 +378,30 @@ DebugMsgRx::~DebugMsgRx()
 
 void DebugMsgRx::task()
 {
+    std::vector<Msg> batch(cBatchSize);
     while (mRun) 
     {
-        Msg msg;
-        if(mQueue.pop(msg, std::chrono::milliseconds(1000)) and msg.str.size())
+        const uint32_t count = mQueue.pop(batch.data(), batch.size(), std::chrono::milliseconds(1000));
+        for(uint32_t i = 0; i < count; i++)
         {
+            Msg& msg = batch[i];
+            if(msg.str.empty())
+            {
+                continue;
+            }
             if(msg.newLine)
             {
                 Msg header;
-                header.str = getHeader(msg.time);
-                sendTimeStamp(header);
+                header.str = getHeader(msg.time, mHeaderArena);
+                if(not header.str.empty())
+                {
+                    sendTimeStamp(header);
+                }
             }
             sendStr(msg);
+            msg.clear();    // the buffer goes back once the clients are done with it
         }
+        reportDropped();
     }
 }
 
@@ -213,13 +429,19 @@ DebugMsgTx::~DebugMsgTx()
 
 void DebugMsgTx::task()
 {
+    std::vector<Msg> batch(cBatchSize);
     while (mRun) 
     {
-        Msg msg;
-        if(mQueue.pop(msg, std::chrono::milliseconds(1000)) and msg.str.size())
+        const uint32_t count = mQueue.pop(batch.data(), batch.size(), std::chrono::milliseconds(1000));
+        std::lock_guard<std::recursive_mutex> lock(mMutex);
+        for(uint32_t i = 0; i < count; i++)
         {
-            std::lock_guard<std::recursive_mutex> lock(mMutex);
-            sendStr(msg);
+            if(batch[i].str.size())
+            {
+                sendStr(batch[i]);
+            }
+            batch[i].clear();
         }
+        reportDropped();
     }
 }
@@ -34,15 +34,19 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 #include "blocking_queue.hpp"
 #include "setting.hpp"
 
-static const int RX_BUF_SIZE = 1024;
-
 //-------------------------------------------------------------------
 // UartTx
 //-------------------------------------------------------------------
 UartTx::UartTx(int uartPortNum):
-    Client(DebugMsgTx::create(), uartPortNum),
+    Client(DebugMsgTx::create(), uartPortNum, Overflow::eBlock),
     cUartNum(uartPortNum)
 {
+    startDelivery();
+}
+
+UartTx::~UartTx()
+{
+    stopDelivery();
 }
 
 bool UartTx::writeStr(const MsgProxy::Msg& msg)
@@ -54,9 +58,13 @@ bool UartTx::writeStr(const MsgProxy::Msg& msg)
 //-------------------------------------------------------------------
 // UartRx
 //-------------------------------------------------------------------
-UartRx::UartRx(int uartPortNum):
+UartRx::UartRx(int uartPortNum, QueueHandle_t eventQueue):
     Task(__func__),
-    cUartNum(uartPortNum)
+    cUartNum(uartPortNum),
+    cEventQueue(eventQueue),
+    mProxy(DebugMsgRx::create()),
+    mLines(cMaxLines),
+    mNewLine(true)
 {
     
 }
@@ -77,29 +85,93 @@ std::string string_to_hex(const std::string& input)
 
 void UartRx::task()
 {
-    char buffer[RX_BUF_SIZE + 1];
-    bool newLine = true;
+    uart_event_t event;
     while(mRun)
     {
-        const int rxBytes = uart_read_bytes(static_cast<uart_port_t>(cUartNum), buffer, RX_BUF_SIZE, 1);
-        if(rxBytes)
+        if(xQueueReceive(cEventQueue, &event, pdMS_TO_TICKS(cStopCheckMs)) != pdTRUE)
         {
-            uint32_t strStartIdx = 0;
-            for(int i = 0; i < rxBytes; i++)
-            {
-                if(buffer[i] == '\n')
-                {
-                    DebugMsgRx::create().write((uint8_t*)&buffer[strStartIdx], (i - strStartIdx) + 1, newLine);
-                    strStartIdx = i + 1;
-                    newLine = true;
-                }
-            }
-            if(strStartIdx < rxBytes)
+            continue;
+        }
+
+        switch(event.type)
+        {
+        case UART_DATA:
+        case UART_PATTERN_DET:
+            read();
+            break;
+        case UART_FIFO_OVF:
+        case UART_BUFFER_FULL:
+            // the driver holds the RX until there is room again, what is buffered is still good
+            ESP_LOGW(cName, "RX %s overflow, target output lost", (event.type == UART_FIFO_OVF) ? "FIFO" : "buffer");
+            read();
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+void UartRx::read()
+{
+    const uart_port_t port = static_cast<uart_port_t>(cUartNum);
+    size_t available = 0;
+    uart_get_buffered_data_len(port, &available);
+    while(available)
+    {
+        uint32_t room;
+        uint8_t* buffer = mArena.reserve(cMinReadSize, room);
+        if(buffer == nullptr)
+        {
+            // the pool is exhausted, the driver's buffer must still drain or the RX stalls
+            uint8_t discard[cMinReadSize];
+            const int rxBytes = uart_read_bytes(port, discard, std::min<size_t>(sizeof(discard), available), 0);
+            if(rxBytes <= 0)
             {
-                DebugMsgRx::create().write((uint8_t*)&buffer[strStartIdx], rxBytes - strStartIdx, newLine);
-                newLine = false;
+                break;
             }
+            available -= rxBytes;
+            continue;
+        }
+        const int rxBytes = uart_read_bytes(port, buffer, std::min<size_t>(room, available), 0);
+        if(rxBytes <= 0)
+        {
+            break;
         }
+        available -= rxBytes;
+        split(buffer, rxBytes);
+    }
+
+    // the lines are split while reading, the positions of the driver are not needed
+    while(uart_pattern_pop_pos(port) != -1)
+    {
+    }
+}
+
+void UartRx::split(uint8_t* buffer, uint32_t length)
+{
+    // memchr of the libc looks at a word at a time, the lines are references to parts of the pool buffer
+    uint8_t* pStart = buffer;
+    uint8_t* const pEnd = buffer + length;
+    uint32_t count = 0;
+    while(pStart < pEnd)
+    {
+        uint8_t* pLineEnd = static_cast<uint8_t*>(memchr(pStart, '\n', pEnd - pStart));
+        uint8_t* pNext = pLineEnd ? (pLineEnd + 1) : pEnd;
+        MsgProxy::Msg& line = mLines[count++];
+        line.str = mArena.commit(pStart, pNext - pStart);
+        line.newLine = mNewLine;
+        mNewLine = (pLineEnd != nullptr);
+        pStart = pNext;
+
+        if(count == mLines.size())
+        {
+            mProxy.write(mLines.data(), count);
+            count = 0;
+        }
+    }
+    if(count)
+    {
+        mProxy.write(mLines.data(), count);
     }
 }
 
@@ -148,7 +220,8 @@ UartService& UartService::create()
 }
 
 UartService::UartService() :
-    mConfig{.baudRate = (int)Setting::create().getDebugUartBaud(), .uartNum = 1}
+    mConfig{.baudRate = (int)Setting::create().getDebugUartBaud(), .uartNum = 1},
+    mEventQueue(nullptr)
 {
     init(mConfig);
 }
@@ -163,18 +236,25 @@ void UartService::init(const Config& cfg)
         .parity = UART_PARITY_DISABLE,
         .stop_bits = UART_STOP_BITS_1,
         .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+        .rx_flow_ctrl_thresh = 0,
         .source_clk = UART_SCLK_APB,
     };
-    uart_driver_delete(static_cast<uart_port_t>(mConfig.uartNum));
+    const uart_port_t port = static_cast<uart_port_t>(mConfig.uartNum);
 
-    // We won't use a buffer for sending data.
-    ESP_ERROR_CHECK(uart_driver_install(static_cast<uart_port_t>(mConfig.uartNum), RX_BUF_SIZE * 2, 0, 0, NULL, 0));
-    ESP_ERROR_CHECK(uart_param_config(static_cast<uart_port_t>(mConfig.uartNum), &uart_config));
-    ESP_ERROR_CHECK(uart_set_pin(static_cast<uart_port_t>(mConfig.uartNum), cTxPin, cRxPin, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE));
-    
+    // the RX task waits on the event queue of the driver, stop it before the driver goes
     pUartRx.reset();
     pUartTx.reset();
-    pUartRx = std::make_unique<UartRx>(mConfig.uartNum);
+    uart_driver_delete(port);
+
+    // We won't use a buffer for sending data.
+    ESP_ERROR_CHECK(uart_driver_install(port, CONFIG_DEBUG_UART_RX_BUFFER_SIZE, 0, CONFIG_DEBUG_UART_EVENT_QUEUE_SIZE, &mEventQueue, 0));
+    ESP_ERROR_CHECK(uart_param_config(port, &uart_config));
+    ESP_ERROR_CHECK(uart_set_pin(port, cTxPin, cRxPin, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE));
+    // a line feed wakes the RX task at once, not at the RX timeout or the FIFO threshold
+    ESP_ERROR_CHECK(uart_enable_pattern_det_baud_intr(port, cLineEnd, 1, cPatternTimeout, 0, 0));
+    ESP_ERROR_CHECK(uart_pattern_queue_reset(port, CONFIG_DEBUG_UART_EVENT_QUEUE_SIZE));
+
+    pUartRx = std::make_unique<UartRx>(mConfig.uartNum, mEventQueue);
     pUartRx->start();
     pUartTx = std::make_unique<UartTx>(mConfig.uartNum);
 }
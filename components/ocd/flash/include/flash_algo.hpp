@@ -0,0 +1,69 @@
+/*
+Copyright (C) Yudoc Kim <craven@crowz.kr>
+ 
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+ 
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "swd.hpp"
+
+//! Sector layout entry of a FlashDevice, the size applies up to the next entry
+struct FlashSector
+{
+    uint32_t size;          // sector size in bytes
+    uint32_t offset;        // offset from the flash start
+};
+
+//! CMSIS flash algorithm placed in target RAM, the addresses are absolute
+struct FlashAlgo
+{
+    // Entry points, 0 when the algorithm doesn't have it
+    uint32_t init;
+    uint32_t uninit;
+    uint32_t eraseChip;
+    uint32_t eraseSector;
+    uint32_t programPage;
+    uint32_t verify;
+
+    Swd::ProgramSysCall sysCall;
+    uint32_t algoStart;             // load address of the blob
+    std::vector<uint32_t> blob;     // breakpoint header, code and data
+    uint32_t programBuffer;         // page buffers in target RAM
+    uint32_t programBufferSize;
+
+    // FlashDevice
+    uint32_t flashStart;
+    uint32_t flashSize;
+    uint32_t pageSize;
+    uint8_t erasedValue;
+    std::vector<FlashSector> sectors;
+
+    uint32_t getSectorSize(uint32_t addr) const
+    {
+        uint32_t size = 0;
+        for(const auto& sector : sectors)
+        {
+            if((addr - flashStart) < sector.offset)
+            {
+                break;
+            }
+            size = sector.size;
+        }
+        return size;
+    }
+};
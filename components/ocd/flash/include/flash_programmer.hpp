@@ -0,0 +1,71 @@
+/*
+Copyright (C) Yudoc Kim <craven@crowz.kr>
+ 
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+ 
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include "swd.hpp"
+#include "flash_algo.hpp"
+
+//! Runs a CMSIS flash algorithm on the target
+//! \note The page data goes to one of two buffers in target RAM while ProgramPage works on the other one
+class FlashProgrammer
+{
+public:
+    FlashProgrammer(Swd& swd);
+    ~FlashProgrammer() = default;
+
+    //! \brief Reset and halt the target and load the algorithm
+    bool begin(const FlashAlgo& algo);
+    //! \brief Finish the last page, UnInit and reset the target to run
+    bool end();
+
+    bool eraseChip();
+    //! \brief Erase the sectors overlapping the range
+    bool erase(uint32_t addr, uint32_t length);
+    //! \brief Program the range, a partial page is padded with the erased value
+    //! \note Ranges should start on a page, only the last page of an image can be partial
+    bool program(uint32_t addr, const uint8_t* pData, uint32_t length);
+    //! \brief Wait until the last page is programmed, the flash can be read back after this
+    bool waitProgramPage();
+    //! \brief Read the flash, after the pending page is done
+    bool read(uint32_t addr, uint8_t* pData, uint32_t length);
+    //! \brief CRC32 of the target memory computed by the target, the same as esp_rom_crc32_le(0, ...)
+    //! \note The routine is loaded into the page buffer, it runs after the pending page is done
+    bool crc32(uint32_t addr, uint32_t length, uint32_t& crc);
+
+protected:
+    // Init() function codes
+    enum class Function : uint32_t
+    {
+        eNone = 0,
+        eErase = 1,
+        eProgram = 2,
+        eVerify = 3,
+    };
+
+    Swd& mSwd;
+    const FlashAlgo* mpAlgo;
+    Function mFunction;
+    uint32_t mBuffer;           // index of the free page buffer
+    bool mBusy;                 // ProgramPage is running on the target
+    std::vector<uint32_t> mPage;
+
+    bool call(uint32_t entry, uint32_t arg1, uint32_t arg2 = 0, uint32_t arg3 = 0);
+    bool setFunction(Function function);
+};
@@ -0,0 +1,75 @@
+/*
+Copyright (C) Yudoc Kim <craven@crowz.kr>
+ 
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+ 
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include "flash_algo.hpp"
+
+//! CMSIS-Pack .FLM flash algorithm loader
+//! \note The algorithm placed in target RAM is cached next to the .FLM as <file>.algo,
+//!       later loads read the blob and the absolute addresses from it instead of the ELF
+class FlmLoader
+{
+public:
+    static const char* cAlgoDir;        // directory of the .FLM files under the mount point
+
+    //! \brief Load an algorithm from its cache or from the .FLM
+    //! \param ramStart, ramSize target RAM for the algorithm, the page buffers and the stack
+    static bool load(const std::string& path, uint32_t ramStart, uint32_t ramSize, FlashAlgo& algo);
+    static std::string getAlgoPath(const std::string& name);
+
+protected:
+    static constexpr uint32_t cCacheMagic = 0x474C4146;    // "FALG"
+    static constexpr uint32_t cCacheVersion = 1;
+    static constexpr uint32_t cStackSize = 0x400;
+
+    //! Cache file header, followed by the sectors and the blob
+    struct CacheHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t flmSize;
+        uint32_t flmTime;
+        uint32_t ramStart;
+        uint32_t ramSize;
+        uint32_t init;
+        uint32_t uninit;
+        uint32_t eraseChip;
+        uint32_t eraseSector;
+        uint32_t programPage;
+        uint32_t verify;
+        uint32_t breakPoint;
+        uint32_t staticBase;
+        uint32_t stackPointer;
+        uint32_t algoStart;
+        uint32_t programBuffer;
+        uint32_t programBufferSize;
+        uint32_t flashStart;
+        uint32_t flashSize;
+        uint32_t pageSize;
+        uint32_t erasedValue;
+        uint32_t sectorCount;
+        uint32_t blobWords;
+    };
+
+    static bool parse(const std::string& path, uint32_t ramStart, uint32_t ramSize, FlashAlgo& algo);
+    static bool loadCache(const std::string& path, const CacheHeader& key, FlashAlgo& algo);
+    static bool saveCache(const std::string& path, const CacheHeader& key, const FlashAlgo& algo);
+};
@@ -0,0 +1,189 @@
+/*
+Copyright (C) Yudoc Kim <craven@crowz.kr>
+ 
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+ 
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <array>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "task.hpp"
+#include "blocking_queue.hpp"
+#include "web_server.hpp"
+#include "swd.hpp"
+#include "pyocd_arbiter.hpp"
+#include "flash_algo.hpp"
+#include "flash_programmer.hpp"
+
+//! Programs a target image from the SD card without a host
+//! \note <mount>/target holds the image and target.cfg, one "key=value" per line:
+//!       algo=<.FLM in flash_algo>, ram=<algo RAM start>, ram_size=<bytes>, address=<image address>
+//!       The programming runs on a task of its own holding the probe, GET /target/status reports it
+class TargetProgrammer
+{
+public:
+    static const char* cTargetDir;      // directory of the image and the config under the mount point
+    static const char* cImageName;
+    static const char* cConfigName;
+
+    enum class State
+    {
+        eIdle,
+        eProgramming,
+        eDone,
+        eFailed,
+    };
+
+    TargetProgrammer(Swd& swd, PyOcdArbiter& arbiter);
+    ~TargetProgrammer() = default;
+
+    //! \brief Take the probe for a programming
+    //! \return false if a pyOCD client holds the lock or a programming runs
+    bool acquire();
+    //! \brief Give the probe back without programming
+    void release();
+    //! \brief Program the image on the programming task after acquire(), the probe is released when it is done
+    //! \return false if the task could not be created, the probe is still acquired
+    bool start(const std::string& imagePath);
+    State getState() const { return mState; }
+    std::string getImagePath() const;
+
+protected:
+    static constexpr uint32_t cChunkSize = 4096;
+    static constexpr uint32_t cChunkCount = 3;
+    static constexpr uint32_t cStackSize = 8192;
+    static constexpr UBaseType_t cPriority = 5;     // the one of httpd
+
+    struct Config
+    {
+        std::string algo;
+        uint32_t ramStart;
+        uint32_t ramSize;
+        uint32_t address;           // 0: start of the flash
+    };
+
+    //! Part of the image, offsets are from the image start
+    struct Segment
+    {
+        uint32_t offset;
+        uint32_t length;
+        uint32_t crc;
+    };
+
+    //! Image data read ahead of the programmer, length 0 marks the end
+    struct Chunk
+    {
+        std::vector<uint8_t> data;
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    //! SD card stage of the pipeline
+    class ImageReader : public Task
+    {
+    public:
+        ImageReader(BlockingQueue<Chunk*>& free, BlockingQueue<Chunk*>& filled);
+        ~ImageReader() = default;
+
+        bool open(const std::string& path, uint32_t& size);
+        //! \brief Continue the image with the file of the flash kept after it
+        bool openTail(const std::string& path);
+        //! \brief Close the files and remove the tail
+        void close();
+        //! \brief CRC32 of a part of the image, read before the task starts
+        bool crc32(uint32_t offset, uint32_t length, std::vector<uint8_t>& buffer, uint32_t& crc);
+        //! \brief Parts of the image the task reads, chunks don't cross them
+        void setRanges(const std::vector<Segment>& ranges) { mRanges = ranges; }
+        bool isFailed() const { return mFailed; }
+
+    protected:
+        BlockingQueue<Chunk*>& mFree;
+        BlockingQueue<Chunk*>& mFilled;
+        FILE* mpFile;
+        FILE* mpTail;                   // offsets from mSize on
+        std::string mTailPath;
+        uint32_t mSize;
+        std::atomic<bool> mFailed;
+        std::vector<Segment> mRanges;
+
+        //! \brief Read the image or the tail after it
+        bool read(uint32_t offset, uint8_t* pData, uint32_t length);
+        void task() override;
+    };
+
+    //! POST /target/program, the request body replaces the image, an empty body programs the image on SD
+    class UploadHandler : public UriHandler
+    {
+    public:
+        UploadHandler(TargetProgrammer& programmer);
+        ~UploadHandler() = default;
+
+    protected:
+        static constexpr uint32_t cRecvSize = 4096;
+        TargetProgrammer& mProgrammer;
+
+        esp_err_t userHandler(httpd_req *req) override;
+        bool receive(httpd_req *req, const std::string& path);
+    };
+
+    //! GET /target/status, the state of the last programming
+    class StatusHandler : public UriHandler
+    {
+    public:
+        StatusHandler(TargetProgrammer& programmer);
+        ~StatusHandler() = default;
+
+    protected:
+        TargetProgrammer& mProgrammer;
+
+        esp_err_t userHandler(httpd_req *req) override;
+    };
+
+    std::mutex mMutex;
+    Swd& mSwd;
+    PyOcdArbiter& mArbiter;
+    std::atomic<State> mState;
+    TaskHandle_t mTask;
+    std::string mImagePath;             // of the programming the task runs
+    std::array<Chunk, cChunkCount> mChunks;
+    BlockingQueue<Chunk*> mFree;
+    BlockingQueue<Chunk*> mFilled;
+    ImageReader mReader;
+    UploadHandler mUploadHandler;
+    StatusHandler mStatusHandler;
+    std::vector<Segment> mSegments;     // image parts to rewrite, one per sector
+
+    static void task(TargetProgrammer* pThis);
+    //! \brief Erase, program and verify the image with the algorithm given by target.cfg
+    //! \note Only the sectors whose CRC32 on the target differs from the image are rewritten.
+    //!       SD reads run in a reader task while the SWD writes a chunk and the algorithm programs a page
+    bool program(const std::string& imagePath);
+    bool loadConfig(const std::string& path, Config& config);
+    bool loadAlgo(const Config& config, FlashAlgo& algo);
+    //! \brief Split the image at the sectors and keep the ones which differ on the target
+    //! \note addr is on a sector, the rest of the last sector is kept by saveTail()
+    bool compare(FlashProgrammer& programmer, const FlashAlgo& algo, uint32_t addr, uint32_t size, const std::string& tailPath);
+    //! \brief Save the flash between the image end and its sector end, it is programmed back after the image
+    bool saveTail(FlashProgrammer& programmer, uint32_t addr, uint32_t length, const std::string& path, Segment& segment);
+    bool writeImage(FlashProgrammer& programmer, uint32_t addr, const std::vector<Segment>& ranges);
+    bool verify(FlashProgrammer& programmer, uint32_t addr);
+};
@@ -0,0 +1,224 @@
+/*
+Copyright (C) Yudoc Kim <craven@crowz.kr>
+ 
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+ 
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#include "flash_programmer.hpp"
+#include <esp_log.h>
+#include <algorithm>
+#include <cstring>
+
+static const char *TAG = "FlashProgrammer";
+
+FlashProgrammer::FlashProgrammer(Swd& swd) :
+    mSwd(swd),
+    mpAlgo(nullptr),
+    mFunction(Function::eNone),
+    mBuffer(0),
+    mBusy(false)
+{
+}
+
+bool FlashProgrammer::begin(const FlashAlgo& algo)
+{
+    mpAlgo = &algo;
+    mFunction = Function::eNone;
+    mBuffer = 0;
+    mBusy = false;
+    mPage.resize((algo.pageSize + 3) / 4);
+
+    if(not mSwd.setStateBySw(Swd::TargetState::eResetProgram))
+    {
+        ESP_LOGE(TAG, "%s target halt failed", __func__);
+        return false;
+    }
+    if(not mSwd.writeMemoryBlcok32(algo.algoStart, algo.blob.data(), algo.blob.size()))
+    {
+        ESP_LOGE(TAG, "%s algo load failed", __func__);
+        return false;
+    }
+    ESP_LOGI(TAG, "algo %u bytes at %08lX, flash %08lX %lu bytes, page %lu", algo.blob.size() * 4, algo.algoStart,
+        algo.flashStart, algo.flashSize, algo.pageSize);
+    return true;
+}
+
+bool FlashProgrammer::end()
+{
+    if(mpAlgo == nullptr)
+    {
+        return false;
+    }
+    const bool ret = waitProgramPage() and setFunction(Function::eNone);
+    mpAlgo = nullptr;
+    return mSwd.setStateBySw(Swd::TargetState::eResetRun) and ret;
+}
+
+bool FlashProgrammer::eraseChip()
+{
+    if(not waitProgramPage() or not setFunction(Function::eErase))
+    {
+        return false;
+    }
+    if(mpAlgo->eraseChip == 0)
+    {
+        return erase(mpAlgo->flashStart, mpAlgo->flashSize);
+    }
+    return call(mpAlgo->eraseChip, 0);
+}
+
+bool FlashProgrammer::erase(uint32_t addr, uint32_t length)
+{
+    if(not waitProgramPage() or not setFunction(Function::eErase))
+    {
+        return false;
+    }
+
+    const uint32_t end = addr + length;
+    uint32_t sector = mpAlgo->flashStart;
+    while(sector < end)
+    {
+        const uint32_t size = mpAlgo->getSectorSize(sector);
+        if(size == 0)
+        {
+            ESP_LOGE(TAG, "%s no sector at %08lX", __func__, sector);
+            return false;
+        }
+        if(((sector + size) > addr) and not call(mpAlgo->eraseSector, sector))
+        {
+            ESP_LOGE(TAG, "%s EraseSector %08lX failed", __func__, sector);
+            return false;
+        }
+        sector += size;
+    }
+    return true;
+}
+
+bool FlashProgrammer::program(uint32_t addr, const uint8_t* pData, uint32_t length)
+{
+    if(not setFunction(Function::eProgram))
+    {
+        return false;
+    }
+
+    const uint32_t pageSize = mpAlgo->pageSize;
+    uint8_t* pPage = reinterpret_cast<uint8_t*>(mPage.data());
+    // Without room for two pages the buffer is written after the previous page is done
+    const bool doubleBuffer = mpAlgo->programBufferSize >= (pageSize * 2);
+    while(length)
+    {
+        const uint32_t offset = (addr - mpAlgo->flashStart) % pageSize;
+        const uint32_t pageAddr = addr - offset;
+        const uint32_t size = std::min(pageSize - offset, length);
+        if(size < pageSize)
+        {
+            memset(pPage, mpAlgo->erasedValue, pageSize);
+        }
+        memcpy(&pPage[offset], pData, size);
+
+        if(not doubleBuffer and not waitProgramPage())
+        {
+            return false;
+        }
+        const uint32_t buffer = mpAlgo->programBuffer + (doubleBuffer ? (mBuffer * pageSize) : 0);
+        if(not mSwd.writeMemoryBlcok32(buffer, mPage.data(), mPage.size()))
+        {
+            return false;
+        }
+        if(not waitProgramPage() or
+           not mSwd.sysCallStart(mpAlgo->sysCall, mpAlgo->programPage, pageAddr, pageSize, buffer, 0))
+        {
+            return false;
+        }
+        mBusy = true;
+        mBuffer ^= 1;
+
+        addr += size;
+        pData += size;
+        length -= size;
+    }
+    return true;
+}
+
+bool FlashProgrammer::read(uint32_t addr, uint8_t* pData, uint32_t length)
+{
+    // the flash is read in the verify state of the algorithm
+    return waitProgramPage() and setFunction(Function::eVerify) and mSwd.readMemoryBlcok8(addr, pData, length);
+}
+
+bool FlashProgrammer::crc32(uint32_t addr, uint32_t length, uint32_t& crc)
+{
+    if(mpAlgo->programBufferSize < (Swd::cCrc32CodeSize * 4))
+    {
+        ESP_LOGE(TAG, "%s page buffer is too small", __func__);
+        return false;
+    }
+    // the flash is read in the verify state of the algorithm
+    if(not waitProgramPage() or not setFunction(Function::eVerify))
+    {
+        return false;
+    }
+
+    const uint32_t entry = mpAlgo->programBuffer | 1;
+    return mSwd.writeMemoryBlcok32(mpAlgo->programBuffer, Swd::cCrc32Code, Swd::cCrc32CodeSize) and
+           mSwd.sysCallStart(mpAlgo->sysCall, entry, addr, length, 0, 0) and
+           mSwd.sysCallWait(crc);
+}
+
+bool FlashProgrammer::call(uint32_t entry, uint32_t arg1, uint32_t arg2, uint32_t arg3)
+{
+    return mSwd.sysCallExec(mpAlgo->sysCall, entry, arg1, arg2, arg3, 0, Swd::FlashAlgoRetType::cBool);
+}
+
+bool FlashProgrammer::setFunction(Function function)
+{
+    if(function == mFunction)
+    {
+        return true;
+    }
+
+    if((mFunction != Function::eNone) and mpAlgo->uninit and not call(mpAlgo->uninit, static_cast<uint32_t>(mFunction)))
+    {
+        ESP_LOGE(TAG, "%s UnInit %lu failed", __func__, static_cast<uint32_t>(mFunction));
+        return false;
+    }
+    mFunction = Function::eNone;
+
+    if((function != Function::eNone) and mpAlgo->init and
+       not call(mpAlgo->init, mpAlgo->flashStart, 0, static_cast<uint32_t>(function)))
+    {
+        ESP_LOGE(TAG, "%s Init %lu failed", __func__, static_cast<uint32_t>(function));
+        return false;
+    }
+    mFunction = function;
+    return true;
+}
+
+bool FlashProgrammer::waitProgramPage()
+{
+    if(not mBusy)
+    {
+        return true;
+    }
+    mBusy = false;
+
+    uint32_t result = 0;
+    if(not mSwd.sysCallWait(result) or (result != 0))
+    {
+        ESP_LOGE(TAG, "%s ProgramPage failed %lu", __func__, result);
+        return false;
+    }
+    return true;
+}
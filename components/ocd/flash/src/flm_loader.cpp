@@ -0,0 +1,427 @@
+/*
+Copyright (C) Yudoc Kim <craven@crowz.kr>
+ 
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+ 
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#include "flm_loader.hpp"
+#include <esp_log.h>
+#include <sys/stat.h>
+#include <fstream>
+#include <cstring>
+#include "fs_manager.hpp"
+
+static const char *TAG = "FlmLoader";
+
+const char* FlmLoader::cAlgoDir = "flash_algo";
+
+// ELF32 little endian, only what a .FLM needs
+#define SHT_SYMTAB  2
+#define SHT_NOBITS  8
+
+struct Elf32Header
+{
+    uint8_t ident[16];
+    uint16_t type;
+    uint16_t machine;
+    uint32_t version;
+    uint32_t entry;
+    uint32_t phoff;
+    uint32_t shoff;
+    uint32_t flags;
+    uint16_t ehsize;
+    uint16_t phentsize;
+    uint16_t phnum;
+    uint16_t shentsize;
+    uint16_t shnum;
+    uint16_t shstrndx;
+};
+
+struct Elf32Section
+{
+    uint32_t name;
+    uint32_t type;
+    uint32_t flags;
+    uint32_t addr;
+    uint32_t offset;
+    uint32_t size;
+    uint32_t link;
+    uint32_t info;
+    uint32_t addralign;
+    uint32_t entsize;
+};
+
+struct Elf32Symbol
+{
+    uint32_t name;
+    uint32_t value;
+    uint32_t size;
+    uint8_t info;
+    uint8_t other;
+    uint16_t shndx;
+};
+
+// FlashDevice of FlashOS.h
+#define FLASH_DEVICE_DEV_NAME       2
+#define FLASH_DEVICE_DEV_TYPE       130
+#define FLASH_DEVICE_DEV_ADR        132
+#define FLASH_DEVICE_SZ_DEV         136
+#define FLASH_DEVICE_SZ_PAGE        140
+#define FLASH_DEVICE_VAL_EMPTY      148
+#define FLASH_DEVICE_SECTORS        160
+#define FLASH_DEVICE_SECTOR_END     0xFFFFFFFF
+#define FLASH_DEVICE_MAX_SECTORS    512
+
+// The functions return to the breakpoint at the start, the rest is the usual header of the algorithm blobs
+static const uint32_t cBlobHeader[] = {
+    0xE00ABE00, 0x062D780D, 0x24084068, 0xD3000040, 0x1E644058, 0x1C49D1FA, 0x2A001E52, 0x4770D1F2,
+};
+
+static bool readAt(std::ifstream& file, uint32_t offset, void* pData, uint32_t size)
+{
+    file.seekg(offset);
+    file.read(static_cast<char*>(pData), size);
+    return file.good();
+}
+
+//! The bytes of a section are within the file, a corrupt size must not reach an allocation
+static bool isInFile(const Elf32Section& section, uint32_t fileSize)
+{
+    return (section.type == SHT_NOBITS) or ((section.offset <= fileSize) and (section.size <= (fileSize - section.offset)));
+}
+
+//! \brief Extend end to the end of the section in the memory
+//! \return false if the section wraps around
+static bool extendEnd(const Elf32Section& section, uint32_t& end)
+{
+    if(section.size > (UINT32_MAX - section.addr))
+    {
+        return false;
+    }
+    end = std::max(end, section.addr + section.size);
+    return true;
+}
+
+static inline uint32_t getWord(const uint8_t* pData)
+{
+    uint32_t word;
+    memcpy(&word, pData, sizeof(word));
+    return word;
+}
+
+std::string FlmLoader::getAlgoPath(const std::string& name)
+{
+    return std::string(FsManager::create().getMountPoint()) + "/" + cAlgoDir + "/" + name;
+}
+
+bool FlmLoader::load(const std::string& path, uint32_t ramStart, uint32_t ramSize, FlashAlgo& algo)
+{
+    struct stat flmStat;
+    if(stat(path.c_str(), &flmStat))
+    {
+        ESP_LOGE(TAG, "%s not found", path.c_str());
+        return false;
+    }
+
+    // The cache is valid for the same .FLM and the same RAM placement
+    CacheHeader key = {};
+    key.magic = cCacheMagic;
+    key.version = cCacheVersion;
+    key.flmSize = flmStat.st_size;
+    key.flmTime = flmStat.st_mtime;
+    key.ramStart = ramStart;
+    key.ramSize = ramSize;
+
+    const std::string cachePath = path + ".algo";
+    if(loadCache(cachePath, key, algo))
+    {
+        ESP_LOGI(TAG, "%s loaded", cachePath.c_str());
+        return true;
+    }
+
+    if(not parse(path, ramStart, ramSize, algo))
+    {
+        return false;
+    }
+    if(not saveCache(cachePath, key, algo))
+    {
+        ESP_LOGW(TAG, "%s write failed", cachePath.c_str());
+    }
+    return true;
+}
+
+bool FlmLoader::parse(const std::string& path, uint32_t ramStart, uint32_t ramSize, FlashAlgo& algo)
+{
+    std::ifstream flm(path, std::ios_base::binary | std::ios_base::ate);
+    const uint32_t fileSize = flm ? static_cast<uint32_t>(flm.tellg()) : 0;
+    Elf32Header header;
+    if(not flm or not readAt(flm, 0, &header, sizeof(header)) or memcmp(header.ident, "\x7F" "ELF", 4) or
+       (header.ident[4] != 1) or (header.shentsize != sizeof(Elf32Section)) or (header.shstrndx >= header.shnum) or
+       (header.shoff > fileSize) or ((header.shnum * sizeof(Elf32Section)) > (fileSize - header.shoff)))
+    {
+        ESP_LOGE(TAG, "%s is not an ELF32 file", path.c_str());
+        return false;
+    }
+
+    std::vector<Elf32Section> sections(header.shnum);
+    if(not readAt(flm, header.shoff, sections.data(), sections.size() * sizeof(Elf32Section)))
+    {
+        return false;
+    }
+    for(const auto& section : sections)
+    {
+        if(not isInFile(section, fileSize))
+        {
+            ESP_LOGE(TAG, "%s section beyond the end of the file", path.c_str());
+            return false;
+        }
+    }
+    const Elf32Section& shstrtab = sections[header.shstrndx];
+    std::vector<char> names(shstrtab.size + 1, 0);
+    if(not readAt(flm, shstrtab.offset, names.data(), shstrtab.size))
+    {
+        return false;
+    }
+
+    // PrgData is there twice, the initialized part and the zero initialized one
+    const Elf32Section* pCode = nullptr;
+    const Elf32Section* pData = nullptr;
+    const Elf32Section* pZero = nullptr;
+    const Elf32Section* pDevice = nullptr;
+    const Elf32Section* pSymtab = nullptr;
+    for(const auto& section : sections)
+    {
+        const char* pName = &names[std::min<uint32_t>(section.name, shstrtab.size)];
+        if(strcmp(pName, "PrgCode") == 0)
+        {
+            pCode = &section;
+        }
+        else if(strcmp(pName, "PrgData") == 0)
+        {
+            ((section.type == SHT_NOBITS) ? pZero : pData) = &section;
+        }
+        else if(strcmp(pName, "DevDscr") == 0)
+        {
+            pDevice = &section;
+        }
+        else if((section.type == SHT_SYMTAB) and (section.link < sections.size()))
+        {
+            pSymtab = &section;
+        }
+    }
+    if((pCode == nullptr) or (pData == nullptr) or (pDevice == nullptr) or (pSymtab == nullptr))
+    {
+        ESP_LOGE(TAG, "%s PrgCode, PrgData, DevDscr or symbols missing", path.c_str());
+        return false;
+    }
+
+    // The code is position independent and linked from 0, the blob keeps the section addresses
+    uint32_t end = 0;
+    if(not extendEnd(*pCode, end) or not extendEnd(*pData, end) or (pZero and not extendEnd(*pZero, end)) or
+       (ramSize < sizeof(cBlobHeader)) or (end > ((ramSize - sizeof(cBlobHeader)) & ~3)))
+    {
+        ESP_LOGE(TAG, "%s sections don't fit %lu bytes of RAM", path.c_str(), ramSize);
+        return false;
+    }
+    const uint32_t blobSize = sizeof(cBlobHeader) + ((end + 3) & ~3);
+    algo.blob.assign(blobSize / 4, 0);
+    memcpy(algo.blob.data(), cBlobHeader, sizeof(cBlobHeader));
+    uint8_t* pBlob = reinterpret_cast<uint8_t*>(algo.blob.data()) + sizeof(cBlobHeader);
+    if(not readAt(flm, pCode->offset, &pBlob[pCode->addr], pCode->size) or
+       not readAt(flm, pData->offset, &pBlob[pData->addr], pData->size))
+    {
+        return false;
+    }
+
+    // Entry points
+    const Elf32Section& strtab = sections[pSymtab->link];
+    std::vector<char> strings(strtab.size + 1, 0);
+    std::vector<Elf32Symbol> symbols(pSymtab->size / sizeof(Elf32Symbol));
+    if(not readAt(flm, strtab.offset, strings.data(), strtab.size) or
+       not readAt(flm, pSymtab->offset, symbols.data(), symbols.size() * sizeof(Elf32Symbol)))
+    {
+        return false;
+    }
+
+    const uint32_t base = ramStart + sizeof(cBlobHeader);
+    uint32_t device = UINT32_MAX;
+    algo.init = algo.uninit = algo.eraseChip = algo.eraseSector = algo.programPage = algo.verify = 0;
+    for(const auto& symbol : symbols)
+    {
+        const char* pName = &strings[std::min<uint32_t>(symbol.name, strtab.size)];
+        const bool entry = (strcmp(pName, "Init") == 0) or (strcmp(pName, "UnInit") == 0) or
+                           (strcmp(pName, "EraseChip") == 0) or (strcmp(pName, "EraseSector") == 0) or
+                           (strcmp(pName, "ProgramPage") == 0) or (strcmp(pName, "Verify") == 0);
+        if(entry and ((symbol.value < pCode->addr) or ((symbol.value - pCode->addr) >= pCode->size)))
+        {
+            ESP_LOGE(TAG, "%s %s is out of PrgCode", path.c_str(), pName);
+            return false;
+        }
+
+        if(strcmp(pName, "Init") == 0)
+        {
+            algo.init = base + symbol.value;
+        }
+        else if(strcmp(pName, "UnInit") == 0)
+        {
+            algo.uninit = base + symbol.value;
+        }
+        else if(strcmp(pName, "EraseChip") == 0)
+        {
+            algo.eraseChip = base + symbol.value;
+        }
+        else if(strcmp(pName, "EraseSector") == 0)
+        {
+            algo.eraseSector = base + symbol.value;
+        }
+        else if(strcmp(pName, "ProgramPage") == 0)
+        {
+            algo.programPage = base + symbol.value;
+        }
+        else if(strcmp(pName, "Verify") == 0)
+        {
+            algo.verify = base + symbol.value;
+        }
+        else if(strcmp(pName, "FlashDevice") == 0)
+        {
+            device = symbol.value;
+        }
+    }
+    if((algo.eraseSector == 0) or (algo.programPage == 0) or
+       (device < pDevice->addr) or ((device - pDevice->addr) >= pDevice->size))
+    {
+        ESP_LOGE(TAG, "%s EraseSector, ProgramPage or FlashDevice missing", path.c_str());
+        return false;
+    }
+
+    // FlashDevice
+    uint8_t flashDevice[FLASH_DEVICE_SECTORS];
+    const uint32_t deviceOffset = pDevice->offset + (device - pDevice->addr);
+    if(not readAt(flm, deviceOffset, flashDevice, sizeof(flashDevice)))
+    {
+        return false;
+    }
+    flashDevice[FLASH_DEVICE_DEV_TYPE - 1] = 0;
+    algo.flashStart = getWord(&flashDevice[FLASH_DEVICE_DEV_ADR]);
+    algo.flashSize = getWord(&flashDevice[FLASH_DEVICE_SZ_DEV]);
+    algo.pageSize = getWord(&flashDevice[FLASH_DEVICE_SZ_PAGE]);
+    algo.erasedValue = flashDevice[FLASH_DEVICE_VAL_EMPTY];
+    algo.sectors.clear();
+    for(uint32_t i = 0; i < FLASH_DEVICE_MAX_SECTORS; i++)
+    {
+        FlashSector sector;
+        if(not readAt(flm, deviceOffset + FLASH_DEVICE_SECTORS + i * sizeof(sector), &sector, sizeof(sector)) or
+           (sector.size == FLASH_DEVICE_SECTOR_END))
+        {
+            break;
+        }
+        algo.sectors.push_back(sector);
+    }
+    if(algo.sectors.empty() or (algo.pageSize == 0))
+    {
+        ESP_LOGE(TAG, "%s bad FlashDevice", path.c_str());
+        return false;
+    }
+
+    // RAM: blob, page buffers, stack
+    if(ramSize < (blobSize + algo.pageSize + cStackSize))
+    {
+        ESP_LOGE(TAG, "%s needs %lu bytes of RAM", path.c_str(), blobSize + algo.pageSize + cStackSize);
+        return false;
+    }
+    algo.algoStart = ramStart;
+    algo.programBuffer = ramStart + blobSize;
+    algo.programBufferSize = ((ramSize - blobSize - cStackSize) >= (algo.pageSize * 2)) ? (algo.pageSize * 2) : algo.pageSize;
+    algo.sysCall.breakPoint = ramStart + 1;
+    algo.sysCall.staticBase = base + pData->addr;
+    algo.sysCall.stackPointer = (algo.programBuffer + algo.programBufferSize + cStackSize) & ~0x07;
+
+    ESP_LOGI(TAG, "%s: %s flash %08lX %lu bytes, page %lu, %u sector entries", path.c_str(),
+        reinterpret_cast<const char*>(&flashDevice[FLASH_DEVICE_DEV_NAME]), algo.flashStart, algo.flashSize,
+        algo.pageSize, algo.sectors.size());
+    return true;
+}
+
+bool FlmLoader::loadCache(const std::string& path, const CacheHeader& key, FlashAlgo& algo)
+{
+    std::ifstream cache(path, std::ios_base::binary);
+    CacheHeader header;
+    if(not cache or not readAt(cache, 0, &header, sizeof(header)))
+    {
+        return false;
+    }
+    if((header.magic != key.magic) or (header.version != key.version) or (header.flmSize != key.flmSize) or
+       (header.flmTime != key.flmTime) or (header.ramStart != key.ramStart) or (header.ramSize != key.ramSize) or
+       (header.sectorCount > FLASH_DEVICE_MAX_SECTORS) or (header.blobWords > (header.ramSize / 4)))
+    {
+        return false;
+    }
+
+    algo.sectors.resize(header.sectorCount);
+    algo.blob.resize(header.blobWords);
+    cache.read(reinterpret_cast<char*>(algo.sectors.data()), algo.sectors.size() * sizeof(FlashSector));
+    cache.read(reinterpret_cast<char*>(algo.blob.data()), algo.blob.size() * sizeof(uint32_t));
+    if(not cache.good())
+    {
+        return false;
+    }
+
+    algo.init = header.init;
+    algo.uninit = header.uninit;
+    algo.eraseChip = header.eraseChip;
+    algo.eraseSector = header.eraseSector;
+    algo.programPage = header.programPage;
+    algo.verify = header.verify;
+    algo.sysCall.breakPoint = header.breakPoint;
+    algo.sysCall.staticBase = header.staticBase;
+    algo.sysCall.stackPointer = header.stackPointer;
+    algo.algoStart = header.algoStart;
+    algo.programBuffer = header.programBuffer;
+    algo.programBufferSize = header.programBufferSize;
+    algo.flashStart = header.flashStart;
+    algo.flashSize = header.flashSize;
+    algo.pageSize = header.pageSize;
+    algo.erasedValue = header.erasedValue;
+    return true;
+}
+
+bool FlmLoader::saveCache(const std::string& path, const CacheHeader& key, const FlashAlgo& algo)
+{
+    CacheHeader header = key;
+    header.init = algo.init;
+    header.uninit = algo.uninit;
+    header.eraseChip = algo.eraseChip;
+    header.eraseSector = algo.eraseSector;
+    header.programPage = algo.programPage;
+    header.verify = algo.verify;
+    header.breakPoint = algo.sysCall.breakPoint;
+    header.staticBase = algo.sysCall.staticBase;
+    header.stackPointer = algo.sysCall.stackPointer;
+    header.algoStart = algo.algoStart;
+    header.programBuffer = algo.programBuffer;
+    header.programBufferSize = algo.programBufferSize;
+    header.flashStart = algo.flashStart;
+    header.flashSize = algo.flashSize;
+    header.pageSize = algo.pageSize;
+    header.erasedValue = algo.erasedValue;
+    header.sectorCount = algo.sectors.size();
+    header.blobWords = algo.blob.size();
+
+    std::ofstream cache(path, std::ios_base::binary | std::ios_base::trunc);
+    cache.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    cache.write(reinterpret_cast<const char*>(algo.sectors.data()), algo.sectors.size() * sizeof(FlashSector));
+    cache.write(reinterpret_cast<const char*>(algo.blob.data()), algo.blob.size() * sizeof(uint32_t));
+    return cache.good();
+}
@@ -0,0 +1,635 @@
+/*
+Copyright (C) Yudoc Kim <craven@crowz.kr>
+ 
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+ 
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#include "target_programmer.hpp"
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_rom_crc.h>
+#include <sys/stat.h>
+#include <sys/unistd.h>
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <cstdlib>
+#include "fs_manager.hpp"
+#include "flm_loader.hpp"
+#include "flash_programmer.hpp"
+
+static const char *TAG = "TargetProgrammer";
+
+const char* TargetProgrammer::cTargetDir = "target";
+const char* TargetProgrammer::cImageName = "image.bin";
+const char* TargetProgrammer::cConfigName = "target.cfg";
+
+static constexpr auto cQueueWait = std::chrono::milliseconds(100);
+
+TargetProgrammer::TargetProgrammer(Swd& swd, PyOcdArbiter& arbiter) :
+    mSwd(swd),
+    mArbiter(arbiter),
+    mState(State::eIdle),
+    mTask(nullptr),
+    mFree(cChunkCount),
+    mFilled(cChunkCount),
+    mReader(mFree, mFilled),
+    mUploadHandler(*this),
+    mStatusHandler(*this)
+{
+}
+
+bool TargetProgrammer::acquire()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if((mState == State::eProgramming) or not mArbiter.tryLock(this))
+    {
+        return false;
+    }
+    mState = State::eProgramming;
+    return true;
+}
+
+void TargetProgrammer::release()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mArbiter.unlock(this);
+    mState = State::eIdle;
+}
+
+bool TargetProgrammer::start(const std::string& imagePath)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mImagePath = imagePath;
+    if((mTask == nullptr) and
+       (xTaskCreate((TaskFunction_t)task, "TargetProgrammer", cStackSize, this, cPriority, &mTask) != pdPASS))
+    {
+        ESP_LOGE(TAG, "%s task creation failed", __func__);
+        mTask = nullptr;
+        return false;
+    }
+    xTaskNotifyGive(mTask);
+    return true;
+}
+
+void TargetProgrammer::task(TargetProgrammer* pThis)
+{
+    while(true)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        std::string imagePath;
+        {
+            std::lock_guard<std::mutex> lock(pThis->mMutex);
+            imagePath = pThis->mImagePath;
+        }
+
+        bool ret;
+        {
+            // the pyOCD executors wait for the probe, their clients get busy errors from the arbiter
+            std::lock_guard<Swd> lock(pThis->mSwd);
+            ret = pThis->program(imagePath);
+        }
+
+        std::lock_guard<std::mutex> lock(pThis->mMutex);
+        pThis->mArbiter.unlock(pThis);
+        pThis->mState = ret ? State::eDone : State::eFailed;
+    }
+}
+
+std::string TargetProgrammer::getImagePath() const
+{
+    return std::string(FsManager::create().getMountPoint()) + "/" + cTargetDir + "/" + cImageName;
+}
+
+bool TargetProgrammer::program(const std::string& imagePath)
+{
+    if(not FsManager::create().isMount())
+    {
+        ESP_LOGE(TAG, "%s SD card is not mounted", __func__);
+        return false;
+    }
+
+    const std::string dir = std::string(FsManager::create().getMountPoint()) + "/" + cTargetDir;
+    Config config;
+    FlashAlgo algo;
+    if(not loadConfig(dir + "/" + cConfigName, config) or not loadAlgo(config, algo))
+    {
+        return false;
+    }
+
+    const uint32_t addr = (config.address == 0) ? algo.flashStart : config.address;
+    uint32_t size = 0;
+    if(not mReader.open(imagePath, size))
+    {
+        return false;
+    }
+    if((size == 0) or (addr < algo.flashStart) or (addr + size > algo.flashStart + algo.flashSize))
+    {
+        ESP_LOGE(TAG, "%s image %lu bytes at %08lX is out of the flash", __func__, size, addr);
+        mReader.close();
+        return false;
+    }
+
+    // a sector is erased as a whole, the flash before the image would be lost
+    uint32_t sector = algo.flashStart;
+    while((sector < addr) and algo.getSectorSize(sector))
+    {
+        sector += algo.getSectorSize(sector);
+    }
+    if(sector != addr)
+    {
+        ESP_LOGE(TAG, "%s address %08lX is not on a sector", __func__, addr);
+        mReader.close();
+        return false;
+    }
+
+    // chunks hold whole pages so only the last one can be partial
+    const uint32_t chunkSize = std::max<uint32_t>(cChunkSize / algo.pageSize, 1) * algo.pageSize;
+    for(auto& chunk : mChunks)
+    {
+        chunk.data.resize(chunkSize);
+    }
+
+    const int64_t start = esp_timer_get_time();
+    FlashProgrammer programmer(mSwd);
+    bool ret = programmer.begin(algo) and compare(programmer, algo, addr, size, imagePath + ".tail");
+
+    // adjacent sectors are erased and read as one range
+    std::vector<Segment> ranges;
+    uint32_t length = 0;
+    for(const auto& segment : mSegments)
+    {
+        if(ranges.empty() or ((ranges.back().offset + ranges.back().length) != segment.offset))
+        {
+            ranges.push_back({segment.offset, 0, 0});
+        }
+        ranges.back().length += segment.length;
+        length += segment.length;
+    }
+
+    if(ret and not ranges.empty())
+    {
+        // the reader fills the queue while the sectors are erased
+        for(auto& chunk : mChunks)
+        {
+            mFree.push(&chunk, cQueueWait);
+        }
+        mReader.setRanges(ranges);
+        mReader.start();
+
+        ret = writeImage(programmer, addr, ranges) and verify(programmer, addr);
+    }
+    mReader.close();
+
+    ret = programmer.end() and ret;
+    ESP_LOGI(TAG, "%s %s %lu of %lu bytes at %08lX, %lld ms", imagePath.c_str(), ret ? "programmed" : "failed",
+        length, size, addr, (esp_timer_get_time() - start) / 1000);
+    return ret;
+}
+
+bool TargetProgrammer::loadConfig(const std::string& path, Config& config)
+{
+    std::ifstream file(path);
+    if(not file)
+    {
+        ESP_LOGE(TAG, "%s cannot open %s", __func__, path.c_str());
+        return false;
+    }
+
+    config = Config{"", 0, 0, 0};
+    bool hasRam = false;
+    std::string line;
+    while(std::getline(file, line))
+    {
+        line.erase(std::remove_if(line.begin(), line.end(), ::isspace), line.end());
+        const size_t pos = line.find('=');
+        if(line.empty() or (line[0] == '#') or (pos == std::string::npos))
+        {
+            continue;
+        }
+
+        const std::string key = line.substr(0, pos);
+        const std::string value = line.substr(pos + 1);
+        if(key == "algo")
+        {
+            config.algo = value;
+        }
+        else if(key == "ram")
+        {
+            config.ramStart = strtoul(value.c_str(), nullptr, 0);
+            hasRam = true;
+        }
+        else if(key == "ram_size")
+        {
+            config.ramSize = strtoul(value.c_str(), nullptr, 0);
+        }
+        else if(key == "address")
+        {
+            config.address = strtoul(value.c_str(), nullptr, 0);
+        }
+        else
+        {
+            ESP_LOGW(TAG, "%s unknown key %s", __func__, key.c_str());
+        }
+    }
+
+    if(config.algo.empty() or not hasRam or (config.ramSize == 0))
+    {
+        ESP_LOGE(TAG, "%s %s needs algo, ram and ram_size", __func__, path.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool TargetProgrammer::loadAlgo(const Config& config, FlashAlgo& algo)
+{
+    if(not FlmLoader::load(FlmLoader::getAlgoPath(config.algo), config.ramStart, config.ramSize, algo))
+    {
+        ESP_LOGE(TAG, "%s %s load failed", __func__, config.algo.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool TargetProgrammer::compare(FlashProgrammer& programmer, const FlashAlgo& algo, uint32_t addr, uint32_t size, const std::string& tailPath)
+{
+    mSegments.clear();
+    const uint32_t end = addr + size;
+    uint32_t sector = algo.flashStart;
+    while(sector < end)
+    {
+        const uint32_t sectorSize = algo.getSectorSize(sector);
+        if(sectorSize == 0)
+        {
+            ESP_LOGE(TAG, "%s no sector at %08lX", __func__, sector);
+            return false;
+        }
+
+        if((sector + sectorSize) > addr)
+        {
+            const uint32_t segmentStart = std::max(sector, addr);
+            const uint32_t segmentEnd = std::min(sector + sectorSize, end);
+            Segment segment = {segmentStart - addr, segmentEnd - segmentStart, 0};
+            uint32_t targetCrc;
+            if(not mReader.crc32(segment.offset, segment.length, mChunks[0].data, segment.crc) or
+               not programmer.crc32(segmentStart, segment.length, targetCrc))
+            {
+                ESP_LOGE(TAG, "%s crc of %08lX failed", __func__, sector);
+                return false;
+            }
+            if(targetCrc != segment.crc)
+            {
+                if((segmentEnd == end) and ((sector + sectorSize) > end) and
+                   not saveTail(programmer, end, sector + sectorSize - end, tailPath, segment))
+                {
+                    return false;
+                }
+                mSegments.push_back(segment);
+            }
+        }
+        sector += sectorSize;
+    }
+    return true;
+}
+
+bool TargetProgrammer::saveTail(FlashProgrammer& programmer, uint32_t addr, uint32_t length, const std::string& path, Segment& segment)
+{
+    // a sector can be larger than the RAM to spare, the tail goes to the SD card
+    FILE* fd = fopen(path.c_str(), "wb");
+    if(fd == nullptr)
+    {
+        ESP_LOGE(TAG, "%s cannot create %s", __func__, path.c_str());
+        return false;
+    }
+
+    std::vector<uint8_t>& buffer = mChunks[0].data;
+    bool ret = true;
+    for(uint32_t done = 0; ret and (done < length);)
+    {
+        const uint32_t size = std::min<uint32_t>(length - done, buffer.size());
+        ret = programmer.read(addr + done, buffer.data(), size) and (fwrite(buffer.data(), 1, size, fd) == size);
+        segment.crc = esp_rom_crc32_le(segment.crc, buffer.data(), size);
+        done += size;
+    }
+    fclose(fd);
+
+    if(not ret or not mReader.openTail(path))
+    {
+        ESP_LOGE(TAG, "%s %lu bytes at %08lX failed", __func__, length, addr);
+        unlink(path.c_str());
+        return false;
+    }
+    segment.length += length;
+    return true;
+}
+
+bool TargetProgrammer::writeImage(FlashProgrammer& programmer, uint32_t addr, const std::vector<Segment>& ranges)
+{
+    uint32_t length = 0;
+    for(const auto& range : ranges)
+    {
+        if(not programmer.erase(addr + range.offset, range.length))
+        {
+            ESP_LOGE(TAG, "%s erase failed", __func__);
+            return false;
+        }
+        length += range.length;
+    }
+
+    bool ret = true;
+    uint32_t done = 0;
+    while(ret and (done < length))
+    {
+        Chunk* pChunk;
+        if(not mFilled.pop(pChunk, cQueueWait))
+        {
+            ret = not mReader.isFailed();
+            continue;
+        }
+        if(pChunk->length == 0)
+        {
+            ESP_LOGE(TAG, "%s image ended at %lu", __func__, done);
+            ret = false;
+            break;
+        }
+
+        ret = programmer.program(addr + pChunk->offset, pChunk->data.data(), pChunk->length);
+        done += pChunk->length;
+        mFree.push(pChunk, cQueueWait);
+    }
+
+    return ret and programmer.waitProgramPage();
+}
+
+bool TargetProgrammer::verify(FlashProgrammer& programmer, uint32_t addr)
+{
+    for(const auto& segment : mSegments)
+    {
+        uint32_t crc;
+        if(not programmer.crc32(addr + segment.offset, segment.length, crc) or (crc != segment.crc))
+        {
+            ESP_LOGE(TAG, "%s %08lX failed", __func__, addr + segment.offset);
+            return false;
+        }
+    }
+    return true;
+}
+
+//-------------------------------------------------------------------
+// ImageReader
+//-------------------------------------------------------------------
+
+TargetProgrammer::ImageReader::ImageReader(BlockingQueue<Chunk*>& free, BlockingQueue<Chunk*>& filled) :
+    Task("target_read"),
+    mFree(free),
+    mFilled(filled),
+    mpFile(nullptr),
+    mpTail(nullptr),
+    mSize(0),
+    mFailed(false)
+{
+}
+
+bool TargetProgrammer::ImageReader::open(const std::string& path, uint32_t& size)
+{
+    struct stat fileStat;
+    if(stat(path.c_str(), &fileStat) != 0)
+    {
+        ESP_LOGE(TAG, "%s %s not found", __func__, path.c_str());
+        return false;
+    }
+
+    mpFile = fopen(path.c_str(), "rb");
+    if(mpFile == nullptr)
+    {
+        ESP_LOGE(TAG, "%s cannot open %s", __func__, path.c_str());
+        return false;
+    }
+    size = fileStat.st_size;
+    mSize = size;
+    mFailed = false;
+    mRanges.clear();
+    return true;
+}
+
+bool TargetProgrammer::ImageReader::openTail(const std::string& path)
+{
+    mpTail = fopen(path.c_str(), "rb");
+    if(mpTail == nullptr)
+    {
+        return false;
+    }
+    mTailPath = path;
+    return true;
+}
+
+void TargetProgrammer::ImageReader::close()
+{
+    stop();
+    if(mpFile)
+    {
+        fclose(mpFile);
+        mpFile = nullptr;
+    }
+    if(mpTail)
+    {
+        fclose(mpTail);
+        mpTail = nullptr;
+        unlink(mTailPath.c_str());
+    }
+
+    // hand every chunk back to the free queue for the next image
+    Chunk* pChunk;
+    while(mFilled.pop(pChunk, std::chrono::milliseconds(0)));
+    while(mFree.pop(pChunk, std::chrono::milliseconds(0)));
+}
+
+bool TargetProgrammer::ImageReader::crc32(uint32_t offset, uint32_t length, std::vector<uint8_t>& buffer, uint32_t& crc)
+{
+    crc = 0;
+    while(length)
+    {
+        const uint32_t size = std::min<uint32_t>(length, buffer.size());
+        if(not read(offset, buffer.data(), size))
+        {
+            return false;
+        }
+        crc = esp_rom_crc32_le(crc, buffer.data(), size);
+        offset += size;
+        length -= size;
+    }
+    return true;
+}
+
+bool TargetProgrammer::ImageReader::read(uint32_t offset, uint8_t* pData, uint32_t length)
+{
+    while(length)
+    {
+        const bool image = offset < mSize;
+        FILE* pFile = image ? mpFile : mpTail;
+        const uint32_t size = image ? std::min(length, mSize - offset) : length;
+        if((pFile == nullptr) or (fseek(pFile, image ? offset : (offset - mSize), SEEK_SET) != 0) or
+           (fread(pData, 1, size, pFile) != size))
+        {
+            return false;
+        }
+        offset += size;
+        pData += size;
+        length -= size;
+    }
+    return true;
+}
+
+void TargetProgrammer::ImageReader::task()
+{
+    auto range = mRanges.begin();
+    uint32_t offset = (range != mRanges.end()) ? range->offset : 0;
+    while(mRun)
+    {
+        Chunk* pChunk;
+        if(not mFree.pop(pChunk, cQueueWait))
+        {
+            continue;
+        }
+
+        pChunk->offset = offset;
+        pChunk->length = 0;
+        if(range != mRanges.end())
+        {
+            const uint32_t size = std::min<uint32_t>(range->offset + range->length - offset, pChunk->data.size());
+            if(not read(offset, pChunk->data.data(), size))
+            {
+                ESP_LOGE(TAG, "%s read failed at %lu", __func__, offset);
+                mFailed = true;
+                return;
+            }
+            pChunk->length = size;
+            offset += size;
+            if(offset == (range->offset + range->length) and (++range != mRanges.end()))
+            {
+                offset = range->offset;
+            }
+        }
+
+        while(mRun and not mFilled.push(pChunk, cQueueWait));
+        if(pChunk->length == 0)
+        {
+            return;
+        }
+    }
+}
+
+//-------------------------------------------------------------------
+// UploadHandler
+//-------------------------------------------------------------------
+
+TargetProgrammer::UploadHandler::UploadHandler(TargetProgrammer& programmer) :
+    UriHandler("/target/program", HTTP_POST),
+    mProgrammer(programmer)
+{
+}
+
+bool TargetProgrammer::UploadHandler::receive(httpd_req *req, const std::string& path)
+{
+    const std::string dir = path.substr(0, path.rfind('/'));
+    struct stat dirStat = {};
+    if(stat(dir.c_str(), &dirStat) and mkdir(dir.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH))
+    {
+        ESP_LOGE(TAG, "Cannot create dir(%s)", dir.c_str());
+        return false;
+    }
+
+    // the old image stays until the new one is complete
+    const std::string tmpPath = path + ".tmp";
+    FILE* fd = fopen(tmpPath.c_str(), "w");
+    if(fd == nullptr)
+    {
+        ESP_LOGE(TAG, "Failed to create file : %s", tmpPath.c_str());
+        return false;
+    }
+
+    std::vector<char> buf(cRecvSize);
+    int remaining = req->content_len;
+    while(remaining > 0)
+    {
+        const int received = httpd_req_recv(req, buf.data(), std::min<int>(remaining, buf.size()));
+        if(received == HTTPD_SOCK_ERR_TIMEOUT)
+        {
+            continue;
+        }
+        if((received <= 0) or (fwrite(buf.data(), 1, received, fd) != static_cast<size_t>(received)))
+        {
+            fclose(fd);
+            unlink(tmpPath.c_str());
+            ESP_LOGE(TAG, "File reception failed!");
+            return false;
+        }
+        remaining -= received;
+    }
+    fclose(fd);
+
+    unlink(path.c_str());
+    return rename(tmpPath.c_str(), path.c_str()) == 0;
+}
+
+esp_err_t TargetProgrammer::UploadHandler::userHandler(httpd_req *req)
+{
+    // the image on SD stays as it is while it is programmed or while a pyOCD session has the target
+    if(not mProgrammer.acquire())
+    {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_sendstr(req, "Probe busy");
+        return ESP_OK;
+    }
+
+    const std::string path = mProgrammer.getImagePath();
+    if((req->content_len > 0) and not receive(req, path))
+    {
+        mProgrammer.release();
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to save the image");
+        return ESP_FAIL;
+    }
+
+    // httpd serves the log sockets meanwhile, a production script polls /target/status for the result
+    if(not mProgrammer.start(path))
+    {
+        mProgrammer.release();
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to start the programming");
+        return ESP_FAIL;
+    }
+    httpd_resp_set_status(req, "202 Accepted");
+    httpd_resp_sendstr(req, "Programming started");
+    return ESP_OK;
+}
+
+//-------------------------------------------------------------------
+// StatusHandler
+//-------------------------------------------------------------------
+
+TargetProgrammer::StatusHandler::StatusHandler(TargetProgrammer& programmer) :
+    UriHandler("/target/status", HTTP_GET),
+    mProgrammer(programmer)
+{
+}
+
+esp_err_t TargetProgrammer::StatusHandler::userHandler(httpd_req *req)
+{
+    static const char* const cStates[] = {"idle", "programming", "done", "failed"};
+    const char* state = cStates[static_cast<int>(mProgrammer.getState())];
+    httpd_resp_set_type(req, "application/json");
+    const std::string body = std::string("{\"state\": \"") + state + "\"}";
+    httpd_resp_sendstr(req, body.c_str());
+    return ESP_OK;
+}
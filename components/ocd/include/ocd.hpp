@@ -21,14 +21,27 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 #include <memory>
 
 class PyOcdServer;
+class PyOcdArbiter;
+class Swd;
+class TargetProgrammer;
 
 class Ocd
 {
 public:
     static Ocd& create();
 
+    //! \brief SWD probe shared by the pyOCD servers
+    //! \note hold it (std::lock_guard<Swd>) while driving it
+    Swd& getSwd();
+
+    //! \brief Sessions on the probe, a front-end honours the lock of the others through it
+    PyOcdArbiter& getArbiter();
+
 protected:
+    std::unique_ptr<Swd> mpSwd;
+    std::unique_ptr<PyOcdArbiter> mpArbiter;
     std::unique_ptr<PyOcdServer> mpPyOcdServer;
+    std::unique_ptr<TargetProgrammer> mpTargetProgrammer;
 
     Ocd();
     ~Ocd();
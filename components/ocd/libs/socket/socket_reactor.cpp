@@ -0,0 +1,410 @@
+/*
+Copyright (C) Yudoc Kim <craven@crowz.kr>
+ 
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+ 
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "socket_reactor.hpp"
+#include <esp_log.h>
+#include "freertos/task.h"
+
+static const char * TAG = "SocketReactor";
+
+namespace
+{
+    bool isWouldBlock(int err)
+    {
+        return (err == EAGAIN) or (err == EWOULDBLOCK) or (err == EINTR);
+    }
+
+    bool setNonBlocking(int socket)
+    {
+        const int flags = fcntl(socket, F_GETFL, 0);
+        return (flags >= 0) and (fcntl(socket, F_SETFL, flags | O_NONBLOCK) == 0);
+    }
+}
+
+//-------------------------------------------------------------------
+// TcpService
+//-------------------------------------------------------------------
+TcpService::TcpService(uint16_t port, uint32_t maxConnections, uint32_t rxBufferSize, uint32_t idleTimeoutMs) :
+    cPort(port),
+    cMaxConnections(maxConnections),
+    cRxBufferSize(rxBufferSize),
+    cIdleTimeoutMs(idleTimeoutMs)
+{
+
+}
+
+//-------------------------------------------------------------------
+// TcpConnection
+//-------------------------------------------------------------------
+TcpConnection::TcpConnection(int socket, TcpService& service) :
+    cSocket(socket),
+    mService(service),
+    mRxBuffer(service.cRxBufferSize),
+    mTxOffset(0),
+    mLastActivity(xTaskGetTickCount()),
+    mLastSent(mLastActivity),
+    mClosing(false),
+    mPaused(false)
+{
+
+}
+
+TcpConnection::~TcpConnection()
+{
+    ::close(cSocket);
+}
+
+uint32_t TcpConnection::write(const char* data, uint32_t len)
+{
+    uint32_t sent = 0;
+    while(sent < len)
+    {
+        const int ret = ::send(cSocket, data + sent, len - sent, 0);
+        if(ret < 0)
+        {
+            if(not isWouldBlock(errno))
+            {
+                ESP_LOGE(TAG, "send failed on %d: errno %d", cSocket, errno);
+                mClosing = true;
+            }
+            break;
+        }
+        sent += ret;
+    }
+    return sent;
+}
+
+void TcpConnection::flush()
+{
+    const uint32_t sent = write(mTxPending.data() + mTxOffset, mTxPending.size() - mTxOffset);
+    if(sent)
+    {
+        mLastSent = xTaskGetTickCount();
+    }
+    mTxOffset += sent;
+    if(not hasPending())
+    {
+        mTxPending.clear();     // keeps the capacity
+        mTxOffset = 0;
+    }
+}
+
+uint32_t TcpConnection::send(const char* data, uint32_t len)
+{
+    if(mClosing)
+    {
+        return 0;
+    }
+    // keep the order behind what is already queued
+    uint32_t sent = 0;
+    if(not hasPending())
+    {
+        sent = write(data, len);
+        mLastSent = xTaskGetTickCount();     // the queue starts waiting for the peer now
+    }
+    if(mClosing or (sent == len))
+    {
+        return sent;
+    }
+    // the reactor writes it on the next writable select()
+    mTxPending.insert(mTxPending.end(), data + sent, data + len);
+    return len;
+}
+
+//-------------------------------------------------------------------
+// SocketReactor
+//-------------------------------------------------------------------
+SocketReactor& SocketReactor::create()
+{
+    static SocketReactor reactor;
+    return reactor;
+}
+
+SocketReactor::SocketReactor() :
+    mWakeSocket(-1),
+    mWakePending(false)
+{
+    // a socket connected to itself, select() sees the wake-ups like any other input
+    const int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    struct sockaddr_in addr = {};
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_family = AF_INET;
+    addr.sin_port = 0;
+    socklen_t addrLen = sizeof(addr);
+    if((sock < 0) or (bind(sock, (const struct sockaddr*) &addr, sizeof(addr)) < 0) or
+       (getsockname(sock, (struct sockaddr*) &addr, &addrLen) < 0) or
+       (connect(sock, (const struct sockaddr*) &addr, addrLen) < 0) or
+       not setNonBlocking(sock))
+    {
+        // the wake-ups are still served, on the poll period
+        ESP_LOGE(TAG, "wake socket failed, errno %d", errno);
+        if(sock >= 0)
+        {
+            ::close(sock);
+        }
+    }
+    else
+    {
+        mWakeSocket = sock;
+    }
+
+    xTaskCreatePinnedToCore(
+                    (TaskFunction_t)task,   /* Function to implement the task */
+                    "SocketReactor",    /* Name of the task */
+                    cStackSize,         /* Stack size */
+                    this,               /* Task input parameter */
+                    cPriority,          /* Priority of the task */
+                    NULL,               /* Task handle. */
+                    cCore);             /* Core where the task should run */
+}
+
+bool SocketReactor::listen(TcpService& service)
+{
+    const int sock = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    if(sock < 0)
+    {
+        ESP_LOGE(TAG, "socket() failed %d", sock);
+        return false;
+    }
+    int opt = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    struct sockaddr_in addr = {};
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(service.cPort);
+    if((bind(sock, (const struct sockaddr*) &addr, sizeof(addr)) < 0) or
+       (::listen(sock, service.cMaxConnections) < 0) or
+       not setNonBlocking(sock))
+    {
+        ESP_LOGE(TAG, "port %d: listen failed, errno %d", service.cPort, errno);
+        ::close(sock);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    mNewListeners.push_back({sock, &service, 0});
+    ESP_LOGI(TAG, "listening on %d", service.cPort);
+    return true;
+}
+
+void SocketReactor::wake()
+{
+    if(not mWakePending.exchange(true) and (mWakeSocket >= 0))
+    {
+        const char c = 0;
+        ::send(mWakeSocket, &c, 1, 0);
+    }
+}
+
+void SocketReactor::onWake()
+{
+    // cleared first, a wake() from here on sends a new datagram
+    mWakePending = false;
+    char buffer[16];
+    while((mWakeSocket >= 0) and (recv(mWakeSocket, buffer, sizeof(buffer), 0) > 0))
+    {
+    }
+    for(Listener& listener : mListeners)
+    {
+        listener.pService->onWake();
+    }
+}
+
+void SocketReactor::task(SocketReactor* pThis)
+{
+    pThis->run();
+}
+
+void SocketReactor::run()
+{
+    while(true)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mListeners.insert(mListeners.end(), mNewListeners.begin(), mNewListeners.end());
+            mNewListeners.clear();
+        }
+
+        fd_set readSet;
+        fd_set writeSet;
+        FD_ZERO(&readSet);
+        FD_ZERO(&writeSet);
+        int maxSocket = mWakeSocket;
+        if(mWakeSocket >= 0)
+        {
+            FD_SET(mWakeSocket, &readSet);
+        }
+        for(const Listener& listener : mListeners)
+        {
+            FD_SET(listener.socket, &readSet);
+            maxSocket = std::max(maxSocket, listener.socket);
+        }
+        for(const auto& pConnection : mConnections)
+        {
+            // no new requests while the replies to the last ones are still queued
+            if(pConnection->hasPending())
+            {
+                FD_SET(pConnection->cSocket, &writeSet);
+            }
+            else if(not pConnection->mPaused)
+            {
+                FD_SET(pConnection->cSocket, &readSet);
+            }
+            maxSocket = std::max(maxSocket, pConnection->cSocket);
+        }
+
+        struct timeval timeout = {0, cPollPeriodMs * 1000};
+        const int ready = select(maxSocket + 1, &readSet, &writeSet, nullptr, &timeout);
+        if(ready < 0)
+        {
+            if(errno != EINTR)
+            {
+                ESP_LOGE(TAG, "select failed: errno %d", errno);
+                vTaskDelay(pdMS_TO_TICKS(cPollPeriodMs));
+            }
+            continue;
+        }
+
+        // a datagram of a wake() that raced with the last onWake() is drained too
+        if(mWakePending or ((ready > 0) and (mWakeSocket >= 0) and FD_ISSET(mWakeSocket, &readSet)))
+        {
+            onWake();
+        }
+        if(ready > 0)
+        {
+            for(auto& pConnection : mConnections)
+            {
+                if(FD_ISSET(pConnection->cSocket, &writeSet))
+                {
+                    pConnection->flush();
+                }
+                else if(FD_ISSET(pConnection->cSocket, &readSet))
+                {
+                    receive(*pConnection);
+                }
+            }
+            // after the connections, the new ones aren't in the sets
+            for(Listener& listener : mListeners)
+            {
+                if(FD_ISSET(listener.socket, &readSet))
+                {
+                    accept(listener);
+                }
+            }
+        }
+        reap(xTaskGetTickCount());
+    }
+}
+
+void SocketReactor::accept(Listener& listener)
+{
+    struct sockaddr_in addr = {};
+    socklen_t addrLen = sizeof(addr);
+    const int sock = ::accept(listener.socket, (struct sockaddr*) &addr, &addrLen);
+    if(sock < 0)
+    {
+        if(not isWouldBlock(errno))
+        {
+            ESP_LOGE(TAG, "accept failed on %d: errno %d", listener.pService->cPort, errno);
+        }
+        return;
+    }
+    if(listener.connections >= listener.pService->cMaxConnections)
+    {
+        ESP_LOGW(TAG, "port %d: connection refused, %lu in use", listener.pService->cPort,
+                 (unsigned long)listener.connections);
+        ::close(sock);
+        return;
+    }
+
+    int opt = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    if(not setNonBlocking(sock))
+    {
+        ESP_LOGE(TAG, "fcntl failed: errno %d", errno);
+        ::close(sock);
+        return;
+    }
+
+    listener.connections++;
+    mConnections.push_back(std::unique_ptr<TcpConnection>(new TcpConnection(sock, *listener.pService)));
+    ESP_LOGI(TAG, "port %d: connection %d accepted", listener.pService->cPort, sock);
+    listener.pService->onAccept(*mConnections.back());
+}
+
+void SocketReactor::receive(TcpConnection& connection)
+{
+    const int len = recv(connection.cSocket, connection.mRxBuffer.data(), connection.mRxBuffer.size(), 0);
+    if(len > 0)
+    {
+        connection.mLastActivity = xTaskGetTickCount();
+        connection.mService.onReceive(connection, connection.mRxBuffer.data(), len);
+    }
+    else if(len == 0)
+    {
+        ESP_LOGI(TAG, "connection %d closed by the peer", connection.cSocket);
+        connection.mClosing = true;
+    }
+    else if(not isWouldBlock(errno))
+    {
+        ESP_LOGE(TAG, "recv failed on %d: errno %d", connection.cSocket, errno);
+        connection.mClosing = true;
+    }
+}
+
+void SocketReactor::reap(TickType_t now)
+{
+    for(auto it = mConnections.begin(); it != mConnections.end();)
+    {
+        TcpConnection& connection = **it;
+        const uint32_t timeoutMs = connection.mService.cIdleTimeoutMs;
+        if(timeoutMs and ((now - connection.mLastActivity) >= pdMS_TO_TICKS(timeoutMs)))
+        {
+            ESP_LOGW(TAG, "connection %d idle, closed", connection.cSocket);
+            connection.mClosing = true;
+        }
+        if(connection.hasPending() and ((now - connection.mLastSent) >= pdMS_TO_TICKS(TcpConnection::cSendTimeoutMs)))
+        {
+            ESP_LOGW(TAG, "peer of %d stopped reading, closed", connection.cSocket);
+            connection.mClosing = true;
+        }
+        if(not connection.mClosing)
+        {
+            ++it;
+            continue;
+        }
+        connection.mService.onClose(connection);
+        for(Listener& listener : mListeners)
+        {
+            if(listener.pService == &connection.mService)
+            {
+                listener.connections--;
+            }
+        }
+        it = mConnections.erase(it);
+    }
+}
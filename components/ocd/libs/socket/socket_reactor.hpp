@@ -0,0 +1,140 @@
+/*
+Copyright (C) Yudoc Kim <craven@crowz.kr>
+ 
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+ 
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "freertos/FreeRTOS.h"
+
+class TcpConnection;
+
+//! A TCP service on one port, its callbacks run on the SocketReactor task
+class TcpService
+{
+public:
+    //! \param idleTimeoutMs closes connections that received nothing for this long, 0 never does
+    TcpService(uint16_t port, uint32_t maxConnections, uint32_t rxBufferSize, uint32_t idleTimeoutMs = 0);
+    virtual ~TcpService() = default;
+
+protected:
+    friend class SocketReactor;
+    friend class TcpConnection;
+
+    const uint16_t cPort;
+    const uint32_t cMaxConnections;     // more are refused
+    const uint32_t cRxBufferSize;
+    const uint32_t cIdleTimeoutMs;
+
+    virtual void onAccept(TcpConnection&) {}
+    virtual void onReceive(TcpConnection& connection, char* data, int len) = 0;
+    virtual void onClose(TcpConnection&) {}
+    //! \brief After SocketReactor::wake()
+    virtual void onWake() {}
+};
+
+//! An accepted non-blocking connection with its own receive buffer and a queue of unsent data
+class TcpConnection
+{
+public:
+    ~TcpConnection();
+
+    //! \brief Send or queue len bytes, SocketReactor task only
+    //! \note Never waits, the reactor writes the queue when the socket takes more and closes
+    //!       the connection when the peer took nothing of it for cSendTimeoutMs
+    //! \return len, or what went out before the connection failed
+    uint32_t send(const char* data, uint32_t len);
+    //! \brief The reactor closes the connection after the current callback
+    void close() { mClosing = true; }
+    //! \brief Stop reading the socket, the peer is held back by TCP until the service can take more
+    void pauseReceive(bool pause) { mPaused = pause; }
+
+    int getSocket() const { return cSocket; }
+    bool isClosing() const { return mClosing; }
+
+protected:
+    friend class SocketReactor;
+
+    static constexpr uint32_t cSendTimeoutMs = 5000;
+
+    const int cSocket;
+    TcpService& mService;
+    std::vector<char> mRxBuffer;
+    std::vector<char> mTxPending;
+    uint32_t mTxOffset;                 // first unsent byte of mTxPending
+    TickType_t mLastActivity;
+    TickType_t mLastSent;               // the peer took data then, checked while data is queued
+    bool mClosing;
+    bool mPaused;
+
+    TcpConnection(int socket, TcpService& service);
+    //! \brief Write what the socket takes without blocking
+    uint32_t write(const char* data, uint32_t len);
+    //! \brief Write the queued data the socket takes
+    void flush();
+    bool hasPending() const { return mTxOffset < mTxPending.size(); }
+};
+
+//! Serves the accepts, reads, writes and idle timeouts of all the TCP services with select() on one task
+class SocketReactor
+{
+public:
+    static SocketReactor& create();
+
+    //! \brief Start serving the service on its port, from any task
+    //! \note Call it once the service can take callbacks, they may run before listen() returns
+    bool listen(TcpService& service);
+    //! \brief Have the reactor call onWake() of the services, from any task
+    //! \note Wake-ups before the reactor got to them are merged into one
+    void wake();
+
+protected:
+    static constexpr uint32_t cStackSize = 10000;
+    static constexpr UBaseType_t cPriority = 22;
+    static constexpr BaseType_t cCore = 0;          // next to WiFi and lwip
+    static constexpr uint32_t cPollPeriodMs = 100;  // new listeners and idle timeouts are checked this often
+
+    struct Listener
+    {
+        int socket;
+        TcpService* pService;
+        uint32_t connections;
+    };
+
+    std::mutex mMutex;                      // guards mNewListeners
+    std::vector<Listener> mNewListeners;
+    std::vector<Listener> mListeners;
+    std::vector<std::unique_ptr<TcpConnection>> mConnections;
+    int mWakeSocket;                        // UDP on the loopback, a datagram from wake() ends the select()
+    std::atomic<bool> mWakePending;
+
+    SocketReactor();
+    ~SocketReactor() = default;
+
+    static void task(SocketReactor* pThis);
+    void run();
+    //! \brief Drain the wake socket and call onWake() of the services
+    void onWake();
+    void accept(Listener& listener);
+    void receive(TcpConnection& connection);
+    //! \brief Drop the connections that closed, idled out or stopped reading
+    void reap(TickType_t now);
+};
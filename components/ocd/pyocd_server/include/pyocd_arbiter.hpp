@@ -0,0 +1,71 @@
+/*
+Copyright (C) Yudoc Kim <craven@crowz.kr>
+ 
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+ 
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <deque>
+#include <mutex>
+#include "freertos/FreeRTOS.h"
+
+//! Shares the probe between the pyOCD clients, the console and the target programmer
+//! \note lock gives a client the probe for itself, it nests like the RLock of pyOCD. It never waits,
+//!       the others get busy errors at once and retry. A failed lock takes a turn though: when the
+//!       probe frees, the oldest of them has it reserved for cReservationMs, nobody else may lock or
+//!       access it meanwhile, so its retry wins. The probe is opened by the first client only.
+//!       A session is any pointer identifying a client, the calls may come from any task
+class PyOcdArbiter
+{
+public:
+    using Session = const void*;
+
+    PyOcdArbiter();
+    ~PyOcdArbiter() = default;
+
+    //! \brief Session holds the lock, or nobody holds it and it isn't reserved for another session
+    bool mayAccess(Session session);
+    //! \brief Take the lock, or take a turn for it when it is held or reserved
+    //! \return true if granted, false to reply busy right away
+    bool lock(Session session);
+    //! \brief Take the lock if nobody holds or waits for it, never queues
+    bool tryLock(Session session);
+    //! \brief Drop one level of the lock
+    //! \return false if session doesn't hold it
+    bool unlock(Session session);
+    //! \brief Count an open
+    //! \return true if the probe must be opened, no other session has it open
+    bool open();
+    void close();
+    //! \brief Session is gone, drops its lock and its place in the queue. Its opens are closed by the caller
+    void remove(Session session);
+
+protected:
+    static constexpr uint32_t cReservationMs = 2000;
+
+    std::mutex mMutex;
+    Session mpOwner;
+    uint32_t mLockCount;
+    std::deque<Session> mWaiters;
+    TickType_t mReservedSince;      // the oldest waiter has the probe reserved from then
+    uint32_t mOpenCount;
+
+    //! \brief Free the probe and reserve it for the oldest waiter
+    void release();
+    //! \brief Drop the waiters that let their reservation expire
+    void expire();
+};
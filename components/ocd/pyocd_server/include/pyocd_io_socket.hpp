@@ -20,16 +20,16 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 
 #include <stdint.h>
 #include "pyocd_io.hpp"
-#include "socket.hpp"
+#include "socket_reactor.hpp"
 
-class PyOcdIoSocket : public PyOcdIo, public ServerSocket
+//! Replies to one pyOCD client connection
+class PyOcdIoSocket : public PyOcdIo
 {
 public:
-    PyOcdIoSocket(RcvCallback&& callback);
+    PyOcdIoSocket(TcpConnection& connection);
     ~PyOcdIoSocket();
     uint32_t send(const char* message, uint32_t len) override;
 
 protected:
-    int socket;
-    bool serverMain(int acceptSocekt) override;    
+    TcpConnection& mConnection;
 };
@@ -0,0 +1,145 @@
+/*
+Copyright (C) Yudoc Kim <craven@crowz.kr>
+ 
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+ 
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class Request
+{
+public:
+    enum Cmd
+    {
+        hello,
+        readprop,
+        open,
+        close,
+        lock,
+        unlock,
+        connect,
+        disconnect,
+        swj_sequence,
+        swd_sequence,
+        jtag_sequence,
+        set_clock,
+        reset,
+        assert_reset,
+        is_reset_asserted,
+        flush,
+        read_dp,
+        write_dp,
+        read_ap,
+        write_ap,
+        read_ap_multiple,
+        write_ap_multiple,
+        get_memory_interface_for_ap,
+        swo_start,
+        swo_stop,
+        swo_read,
+        read_mem,
+        write_mem,
+        read_block32,
+        write_block32,
+        read_block8,
+        write_block8,
+        crc32,
+        cmdSize
+    };
+    enum ArgumentType
+    {
+        eNone,
+        eInt,
+        eString,
+        eArray,
+    };
+    static constexpr uint32_t cMaxCmdLength = 31;
+
+    static const std::string_view cCmdStr[cmdSize];
+
+    static ArgumentType getArgType(Cmd cmd);
+    //! \brief Least number of arguments the executor reads, checked before it runs the request
+    static uint32_t getArgCount(Cmd cmd);
+    static std::string toString(Cmd cmd);
+    //! \brief Look up a command in the perfect hash table, cmdSize if unknown
+    static Cmd fromString(std::string_view str);
+};
+
+//! A decoded request, the parser swaps it into a slot of the executor's command ring
+struct PyOcdCommand
+{
+    static constexpr uint32_t cMaxString = Request::cMaxCmdLength;    // longer strings are cut
+
+    //! What the executor does with it, the front-end answers some requests without the target
+    enum class Action
+    {
+        eExecute,
+        eOkay,
+        eReject,        // replies error
+    };
+
+    int id;
+    Request::Cmd request;
+    Action action;
+    const char* error;
+    uint32_t intArgument;               // first argument
+    char strArgument[cMaxString + 1];
+    std::vector<uint32_t> arrayArgument;
+};
+
+//! Growable text buffer for the replies, keeps its memory from one use to the next
+class ReplyBuffer
+{
+public:
+    ReplyBuffer(uint32_t reserve = 0) :
+        mBuffer(reserve),
+        mLength(0)
+    {
+
+    }
+
+    //! \brief Room for size more bytes at the end, setEnd() takes what was written
+    char* reserve(uint32_t size)
+    {
+        if(mLength + size > mBuffer.size())
+        {
+            mBuffer.resize(std::max<size_t>(mLength + size, mBuffer.size() * 2));
+        }
+        return mBuffer.data() + mLength;
+    }
+
+    void setEnd(const char* pEnd) { mLength = pEnd - mBuffer.data(); }
+
+    void append(const char* str, uint32_t length)
+    {
+        memcpy(reserve(length), str, length);
+        mLength += length;
+    }
+
+    void clear() { mLength = 0; }
+    const char* data() const { return mBuffer.data(); }
+    uint32_t size() const { return mLength; }
+
+private:
+    std::vector<char> mBuffer;
+    uint32_t mLength;
+};
@@ -23,74 +23,45 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 #include <map>
 #include <functional>
 #include <string>
+#include <string_view>
 #include <memory>
-#include "JSON_Decoder.h"
+#include "sdkconfig.h"
 #include "swd.hpp"
+#include "pyocd_request.hpp"
+#include "swd_executor.hpp"
+#include "pyocd_arbiter.hpp"
 #include "pyocd_io_socket.hpp"
 
-class Request
+//! Incremental parser of the pyOCD requests: {"id": N, "request": "name", "arguments": [...]}
+//! \note The fields are decoded into the parser's own command as the bytes arrive, a request may span
+//!       several receives. The complete request is swapped into a command slot of the SWD executor,
+//!       nothing is allocated per request once the argument arrays reached their size.
+//!       Parsers of the same task may share an executor. parse() doesn't wait for the target,
+//!       collect() hands the replies to their parsers and flush() sends them.
+class PyOcdParser
 {
 public:
-    enum Cmd
-    {
-        hello,
-        readprop,
-        open,
-        close,
-        lock,
-        unlock,
-        connect,
-        disconnect,
-        swj_sequence,
-        swd_sequence,
-        jtag_sequence,
-        set_clock,
-        reset,
-        assert_reset,
-        is_reset_asserted,
-        flush,
-        read_dp,
-        write_dp,
-        read_ap,
-        write_ap,
-        read_ap_multiple,
-        write_ap_multiple,
-        get_memory_interface_for_ap,
-        swo_start,
-        swo_stop,
-        swo_read,
-        read_mem,
-        write_mem,
-        read_block32,
-        write_block32,
-        read_block8,
-        write_block8,
-        cmdSize
-    };
-    enum ArgumentType
-    {
-        eNone,
-        eInt,
-        eString,
-        eArray,
-    };
-    static ArgumentType getArgType(Cmd cmd);
-    static std::string toString(Cmd cmd);
-    static Cmd fromString(const std::string& str);
-    
-protected:
-    static const std::string cCmdStr[cmdSize];
-
-};
-
-class PyOcdParser : public JsonListener
-{
-public:
-    PyOcdParser(PyOcdIo& io);
-    ~PyOcdParser() = default;
+    //! \param pArbiter shares the probe with the other clients, nullptr for a parser that has it alone
+    PyOcdParser(PyOcdIo& io, SwdExecutor& executor, PyOcdArbiter* pArbiter = nullptr);
+    ~PyOcdParser();
 
+    //! \brief Submit every request completed by msg
+    //! \note What doesn't fit the executor is kept as a backlog, resume() goes on with it
     void parse(char* msg, int len);
+    //! \brief Parse the backlog, once collect() freed some executor slots
+    void resume();
+    bool isBacklogged() const { return mWaiting or not mBacklog.empty(); }
+    //! \brief Wait for all the requests of msg and send their replies, for a front-end without an event loop
+    void finish();
+    //! \brief Send the queued replies with a single send
+    void flush();
+
+    //! \brief Queue the finished replies of the executor to their parsers
+    //! \param all waits for all the requests in flight
+    static void collect(SwdExecutor& executor, bool all);
 protected:
+    static constexpr uint32_t cMaxString = PyOcdCommand::cMaxString;
+
     enum class Key
     {
         eId,
@@ -98,43 +69,96 @@ protected:
         eArguments,
         eInvalid
     };
+    enum class State
+    {
+        eIdle,          // waiting for the '{' of a request
+        eKey,
+        eKeyString,
+        eColon,
+        eValue,
+        eString,
+        eNumber,
+        eLiteral,       // true, false, null
+        eNext           // ',' or the end of an array or of the request
+    };
     PyOcdIo& mPyOcdIo;
-    int mId;
-    Request::Cmd mRequest;
+    State mState;
+    uint32_t mArrayDepth;
+    char mString[cMaxString + 1];
+    uint32_t mStringLength;
+    bool mEscape;
+    uint64_t mNumber;
+    bool mNegative;
     Key mKey;
 
-    uint32_t mIntArgument;
-    std::string mStrArgument;
-    std::vector<uint32_t> mArrayArgument;
+    SwdExecutor& mExecutor;
+    PyOcdCommand mCommand;          // request being decoded, swapped into a slot of the executor
+    bool mWaiting;                  // mCommand is complete, no slot was free for it
+    PyOcdArbiter* mpArbiter;
+    bool mOpen;                     // counted in the arbiter
+    uint32_t mInFlight;             // requests of this parser in the executor
+    std::vector<char> mBacklog;     // input after a request no slot was free for
+    std::vector<char> mResume;      // the backlog being parsed
+
+    //! \brief Parse until a request finds no free slot
+    //! \return bytes used
+    int consume(const char* msg, int len);
+    void begin();
+    void appendChar(char c);
+    void onKey();
+    void onString();
+    void onNumber();
+    void onLiteral();
+    //! \brief Reject the malformed request with the id decoded so far, -1 without one
+    void fail(const char* reason, char c);
+    //! \brief Arbitrate the decoded request and dispatch it
+    void submit();
+    //! \brief Hand the request to the executor, or answer it when it doesn't need the target
+    void dispatch();
+    //! \brief Move the request into a slot of the executor, false when none is free
+    bool enqueue();
+    //! \brief Decide whether this client may run the request now
+    void arbitrate(PyOcdCommand& command);
 
-    std::unique_ptr<Swd> pSwd;
-    JSON_Decoder mPaser;
+    //! Replies are queued until the receive batch is done
+    static constexpr uint32_t cTxReserve = 2048;     // grows to the largest batch and stays
+    static constexpr uint32_t cMaxQueuedReplies = CONFIG_PYOCD_MAX_QUEUED_REPLIES;
+    ReplyBuffer mTxBuffer;
+    uint32_t mQueuedReplies;
 
-    void startDocument() override;
-    void endDocument() override;
-    void startObject() override;
-    void endObject() override;
-    void startArray() override;
-    void endArray() override;
-    void key(const char *key) override;
-    void value(const char *value) override;
-    void whitespace(char c) override;
-    void error( const char *message ) override;
-    
-    void sendOkay();
-    void sendString(const char * str);
-    void sendInt(uint32_t val);
-    void sendArray(const std::vector<uint32_t>&);
-    void sendError(const char * error);
+    //! \brief Queue a reply, flushes when cMaxQueuedReplies are waiting
+    void queueReply(const char* reply, uint32_t length);
+    //! \brief Queue the reply of a request answered without the executor, error nullptr for okay
+    void queueReply(int id, const char* error);
 };
 
-class PyOcdServer
+//! pyOCD remote probe server, the clients share the probe through the arbiter
+class PyOcdServer : public TcpService
 {
 public:
-    PyOcdServer();
+    PyOcdServer(Swd& swd, PyOcdArbiter& arbiter);
     ~PyOcdServer() = default;
 
 protected:
-    PyOcdIoSocket mPyOcdServerSocket;
-    PyOcdParser mPyOcdParser;
+    static constexpr uint32_t cMaxClients = CONFIG_PYOCD_MAX_CLIENTS;
+
+    //! One connected client
+    struct Client
+    {
+        Client(TcpConnection& connection, SwdExecutor& executor, PyOcdArbiter& arbiter);
+        PyOcdIoSocket io;
+        PyOcdParser parser;
+    };
+
+    SwdExecutor mExecutor;
+    PyOcdArbiter& mArbiter;
+    std::map<TcpConnection*, std::unique_ptr<Client>> mClients;
+
+    void onAccept(TcpConnection& connection) override;
+    void onReceive(TcpConnection& connection, char* data, int len) override;
+    void onClose(TcpConnection& connection) override;
+    //! \brief An executor reply is ready
+    void onWake() override;
+    //! \brief Hand the replies to the clients, go on with their backlogs and send
+    void serveClients();
 };
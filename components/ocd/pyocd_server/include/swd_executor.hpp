@@ -0,0 +1,99 @@
+/*
+Copyright (C) Yudoc Kim <craven@crowz.kr>
+ 
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+ 
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <vector>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "spsc_ring.hpp"
+#include "swd.hpp"
+#include "pyocd_request.hpp"
+
+class PyOcdParser;
+
+//! Runs the pyOCD requests on the target in its own task, away from the network stack
+//! \note One front-end task submits the commands and collects the replies, each through an SPSC ring,
+//!       so it parses the next request while the current one is on the wire.
+//!       The task is created by the first submit and deleted with the executor
+class SwdExecutor
+{
+public:
+    static constexpr uint32_t cDepth = 4;       // requests in flight
+    static constexpr uint32_t cMaxBlockSize = 4096;     // bytes of one block or multiple read
+
+    //! \param onReply called by the executor task after every reply, lets an event loop collect it later
+    SwdExecutor(Swd& swd, std::function<void()>&& onReply = nullptr);
+    //! \brief Stop and delete the task, the front-end has collected all its replies
+    ~SwdExecutor();
+
+    //! \brief Slot to decode the next request into, nullptr while cDepth requests are in flight
+    PyOcdCommand* nextCommand();
+    //! \brief Queue the request decoded into nextCommand(), its reply goes to owner
+    void submit(PyOcdParser& owner);
+    //! \brief Reply of the oldest request in flight, nullptr if it isn't done and wait is not set
+    const ReplyBuffer* reply(bool wait);
+    //! \brief Parser of the oldest request in flight
+    PyOcdParser* getOwner() const { return mOwners[mOldest]; }
+    //! \brief Done with the reply returned by reply()
+    void release();
+
+protected:
+    static constexpr uint32_t cStackSize = 8192;
+    static constexpr UBaseType_t cPriority = 22;
+    static constexpr BaseType_t cCore = portNUM_PROCESSORS - 1;    // WiFi and lwip keep core 0
+
+    Swd& mSwd;
+    SpscRing<PyOcdCommand, cDepth> mCommands;
+    SpscRing<ReplyBuffer, cDepth> mReplies;
+    uint32_t mInFlight;                         // front-end only
+    PyOcdParser* mOwners[cDepth];               // front-end only, parser of each request in flight
+    uint32_t mOldest;                           // front-end only, mOwners index of the oldest request
+    TaskHandle_t mTask;
+    std::atomic<bool> mRun;
+    std::atomic<bool> mStopped;                 // the task left its loop
+    TaskHandle_t mStopper;                      // the destructor's task, notified by the task when it stopped
+    std::atomic<TaskHandle_t> mFrontEnd;        // waiting in reply(), notified when a reply is ready
+    std::function<void()> mOnReply;
+
+    // used by the task only
+    ReplyBuffer* mpReply;
+    const PyOcdCommand* mpCommand;
+    std::vector<uint32_t> mReadBuffer;          // block and multiple read results
+    std::vector<uint8_t> mByteBuffer;           // read_block8 and write_block8 data
+
+    static void task(SwdExecutor* pThis);
+    void run();
+    //! \brief Run a request on the target and format its reply into mpReply
+    void execute(const PyOcdCommand& cmd);
+
+    void sendOkay();
+    void sendString(const char * str);
+    void sendInt(uint32_t val);
+    template<typename T>
+    void sendArray(const T* pData, uint32_t count);
+    void sendError(const char * error);
+
+    void appendUint(uint32_t val);
+    //! \brief Start a reply: {"id": N, "status": S
+    void beginReply(uint32_t status);
+    void endReply();
+};
@@ -0,0 +1,158 @@
+/*
+Copyright (C) Yudoc Kim <craven@crowz.kr>
+ 
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+ 
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#include <algorithm>
+#include "pyocd_arbiter.hpp"
+#include "freertos/task.h"
+#include <esp_log.h>
+
+static const char * TAG = "PyOcdArbiter";
+
+PyOcdArbiter::PyOcdArbiter() :
+    mpOwner(nullptr),
+    mLockCount(0),
+    mReservedSince(0),
+    mOpenCount(0)
+{
+
+}
+
+bool PyOcdArbiter::mayAccess(Session session)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if(mpOwner)
+    {
+        return mpOwner == session;
+    }
+    expire();
+    return mWaiters.empty() or (mWaiters.front() == session);
+}
+
+bool PyOcdArbiter::lock(Session session)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if(mpOwner == session)
+    {
+        mLockCount++;
+        return true;
+    }
+    expire();
+    if((mpOwner == nullptr) and (mWaiters.empty() or (mWaiters.front() == session)))
+    {
+        if(not mWaiters.empty())
+        {
+            mWaiters.pop_front();
+        }
+        mpOwner = session;
+        mLockCount = 1;
+        return true;
+    }
+    if(std::find(mWaiters.begin(), mWaiters.end(), session) == mWaiters.end())
+    {
+        mWaiters.push_back(session);
+        ESP_LOGI(TAG, "%d waiting for the probe", (int)mWaiters.size());
+    }
+    return false;
+}
+
+bool PyOcdArbiter::tryLock(Session session)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if(mpOwner == session)
+    {
+        mLockCount++;
+        return true;
+    }
+    expire();
+    if((mpOwner != nullptr) or not mWaiters.empty())
+    {
+        return false;
+    }
+    mpOwner = session;
+    mLockCount = 1;
+    return true;
+}
+
+bool PyOcdArbiter::unlock(Session session)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if(mpOwner != session)
+    {
+        return false;
+    }
+    if(--mLockCount == 0)
+    {
+        release();
+    }
+    return true;
+}
+
+bool PyOcdArbiter::open()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mOpenCount++ == 0;
+}
+
+void PyOcdArbiter::close()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if(mOpenCount)
+    {
+        mOpenCount--;
+    }
+}
+
+void PyOcdArbiter::remove(Session session)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if(mpOwner == session)
+    {
+        ESP_LOGW(TAG, "lock owner left");
+        release();
+    }
+    const auto it = std::find(mWaiters.begin(), mWaiters.end(), session);
+    if(it != mWaiters.end())
+    {
+        if(it == mWaiters.begin())
+        {
+            mReservedSince = xTaskGetTickCount();   // the next one gets the whole reservation
+        }
+        mWaiters.erase(it);
+    }
+}
+
+void PyOcdArbiter::release()
+{
+    mpOwner = nullptr;
+    mLockCount = 0;
+    mReservedSince = xTaskGetTickCount();
+}
+
+void PyOcdArbiter::expire()
+{
+    if(mpOwner)
+    {
+        return;
+    }
+    const TickType_t now = xTaskGetTickCount();
+    while(not mWaiters.empty() and ((now - mReservedSince) >= pdMS_TO_TICKS(cReservationMs)))
+    {
+        mWaiters.pop_front();
+        mReservedSince = now;
+    }
+}
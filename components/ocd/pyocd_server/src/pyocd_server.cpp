@@ -16,12 +16,10 @@ along with this program; if not, write to the Free Software
 Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 */
 
-#include <sstream>
 #include <algorithm>
+#include <cstring>
 #include "pyocd_server.hpp"
-#include "gpio_swd.hpp"
 #include <esp_log.h>
-#include "lwip/sockets.h"
 
 static const char * TAG = "PyOcdServer";
 
@@ -29,7 +27,7 @@ static const char * TAG = "PyOcdServer";
 //-------------------------------------------------------------------
 // Request
 //-------------------------------------------------------------------
-const std::string Request::cCmdStr[32] = 
+constexpr std::string_view Request::cCmdStr[cmdSize] =
 {
     "hello",
     "readprop",
@@ -62,7 +60,8 @@ const std::string Request::cCmdStr[32] =
     "read_block32",
     "write_block32",
     "read_block8",
-    "write_block8"
+    "write_block8",
+    "crc32"
 };
 
 Request::ArgumentType Request::getArgType(Cmd cmd)
@@ -105,415 +104,652 @@ Request::ArgumentType Request::getArgType(Cmd cmd)
     case Request::write_block32:
     case Request::write_block8:
     case Request::read_block8:
+    case Request::crc32:
         return ArgumentType::eArray;
     }
 }
 
-std::string Request::toString(Cmd cmd)
+uint32_t Request::getArgCount(Cmd cmd)
 {
-    return std::string(cCmdStr[cmd]);
+    switch(cmd)
+    {
+    case Request::hello:
+    case Request::set_clock:
+    case Request::read_dp:
+    case Request::read_ap:
+    case Request::write_ap_multiple:    // [addr, values...]
+        return 1;
+    case Request::swj_sequence:         // [bits, data]
+    case Request::write_dp:
+    case Request::write_ap:
+    case Request::read_ap_multiple:
+    case Request::write_block32:        // [handle, addr, values...]
+    case Request::write_block8:
+        return 2;
+    case Request::read_mem:             // [handle, addr, size]
+    case Request::read_block32:         // [handle, addr, count]
+    case Request::read_block8:
+        return 3;
+    case Request::write_mem:            // [handle, addr, value, size]
+    case Request::crc32:                // [handle, ram, addr, length, ...]
+        return 4;
+    default:
+        return 0;
+    }
 }
 
-Request::Cmd Request::fromString(const std::string& str)
+namespace
 {
-    for(int i = 0; i < Cmd::cmdSize; ++i)
+    // Perfect hash of the command names: FNV-1a with a seed searched at compile time so that
+    // the top cHashBits bits of the hash differ for every command
+    constexpr uint32_t cHashBits = 7;
+    constexpr uint32_t cHashSize = 1 << cHashBits;
+    constexpr uint8_t cHashEmpty = 0xFF;
+    static_assert(Request::cmdSize < cHashEmpty, "command index does not fit the table");
+    static_assert(Request::cmdSize * 3 < cHashSize, "perfect hash table is too full");
+
+    constexpr uint32_t hashCmd(std::string_view str, uint32_t seed)
     {
-        if(str == cCmdStr[i])
+        uint32_t hash = seed;
+        for(const char c : str)
         {
-            return static_cast<Cmd>(i);
+            hash = (hash ^ static_cast<uint8_t>(c)) * 16777619;
         }
+        return hash >> (32 - cHashBits);
     }
-    return Cmd::cmdSize;
-}
 
-//-------------------------------------------------------------------
-// PyOcdParser
-//-------------------------------------------------------------------
-PyOcdParser::PyOcdParser(PyOcdIo& io) :
-    mPyOcdIo(io),
-    mId(-1),
-    mRequest(Request::cmdSize),
-    mKey(Key::eInvalid)
-{
-    mPaser.setListener(this);
-    pSwd = std::make_unique<GpioSwd>();
-}
+    constexpr bool isPerfect(uint32_t seed)
+    {
+        bool used[cHashSize] = {};
+        for(const std::string_view& cmd : Request::cCmdStr)
+        {
+            const uint32_t idx = hashCmd(cmd, seed);
+            if(used[idx])
+            {
+                return false;
+            }
+            used[idx] = true;
+        }
+        return true;
+    }
 
-void PyOcdParser::sendOkay()
-{
-    char buffer[128] = {};
-    const int len = snprintf(buffer, 128, "{\"id\": %d, \"status\": 0}\n", mId);
-    mPyOcdIo.send(buffer, len);
-}
+    constexpr uint32_t findSeed()
+    {
+        uint32_t seed = 1;
+        while(not isPerfect(seed))
+        {
+            seed++;
+        }
+        return seed;
+    }
 
-void PyOcdParser::sendString(const char * str)
-{
-    char buffer[128] = {};
-    const int len = snprintf(buffer, 128, "{\"id\": %d, \"status\": 0, \"result\": %s}\n", mId, str);
-    mPyOcdIo.send(buffer, len);
-}
+    constexpr uint32_t cHashSeed = findSeed();
 
-void PyOcdParser::sendInt(uint32_t val)
-{
-    char buffer[128] = {};
-    const int len = snprintf(buffer, 128, "{\"id\": %d, \"status\": 0, \"result\": %lu}\n", mId, val);
-    mPyOcdIo.send(buffer, len);
-}
-    
-void PyOcdParser::sendArray(const std::vector<uint32_t>& vector)
-{
+    struct CmdTable
     {
-        char buffer[128] = {};
-        const int len = snprintf(buffer, 128, "{\"id\": %d, \"status\": 0, \"result\": [", mId);
-        mPyOcdIo.send(buffer, len);
-    }
-    std::ostringstream arr;
-    arr << vector[0];
-    for(int i = 1; i < vector.size(); i++)
+        uint8_t cmd[cHashSize];
+    };
+
+    constexpr CmdTable makeCmdTable()
     {
-        arr << ", " << vector[i];
+        CmdTable table = {};
+        for(uint32_t i = 0; i < cHashSize; i++)
+        {
+            table.cmd[i] = cHashEmpty;
+        }
+        for(uint32_t i = 0; i < Request::cmdSize; i++)
+        {
+            table.cmd[hashCmd(Request::cCmdStr[i], cHashSeed)] = i;
+        }
+        return table;
     }
-    arr << "]}\n";
-    mPyOcdIo.send(arr.str().c_str(), arr.str().size());
+
+    constexpr CmdTable cCmdTable = makeCmdTable();
 }
 
-void PyOcdParser::sendError(const char * str)
+std::string Request::toString(Cmd cmd)
 {
-    char buffer[128] = {};
-    const int len = snprintf(buffer, 128, "{\"id\": %d, \"status\": 1, \"error\": \"%s\"}\n", mId, str);
-    mPyOcdIo.send(buffer, len);
+    return (cmd < cmdSize) ? std::string(cCmdStr[cmd]) : std::string("unknown");
 }
 
-void PyOcdParser::startDocument()
+Request::Cmd Request::fromString(std::string_view str)
 {
+    const uint8_t idx = cCmdTable.cmd[hashCmd(str, cHashSeed)];
+    if((idx == cHashEmpty) or (cCmdStr[idx] != str))
+    {
+        return Cmd::cmdSize;
+    }
+    return static_cast<Cmd>(idx);
 }
 
-void PyOcdParser::endDocument()
+//-------------------------------------------------------------------
+// PyOcdParser
+//-------------------------------------------------------------------
+PyOcdParser::PyOcdParser(PyOcdIo& io, SwdExecutor& executor, PyOcdArbiter* pArbiter) :
+    mPyOcdIo(io),
+    mState(State::eIdle),
+    mArrayDepth(0),
+    mString{},
+    mStringLength(0),
+    mEscape(false),
+    mNumber(0),
+    mNegative(false),
+    mKey(Key::eInvalid),
+    mExecutor(executor),
+    mCommand{},
+    mWaiting(false),
+    mpArbiter(pArbiter),
+    mOpen(false),
+    mInFlight(0),
+    mTxBuffer(cTxReserve),
+    mQueuedReplies(0)
 {
-    switch(mRequest)
-    {
-    case Request::hello:
-        ESP_LOGI(TAG, "version %d", (int)mIntArgument);
-        sendOkay();                   
-        break;
-    case Request::set_clock:
-        ESP_LOGI(TAG, "clock %d", (int)mIntArgument);
-        sendOkay();                                         
-        break;
-    case Request::lock:
-    case Request::close:
-    case Request::unlock:
-    case Request::disconnect:
-        sendOkay();
-        break;
-    case Request::connect:
-        pSwd->cleareErrors();
-        sendOkay();
-        break;
-    case Request::open:
+}
+
+PyOcdParser::~PyOcdParser()
+{
+    // the executor must not hand a reply to a parser that is gone
+    if(mInFlight)
     {
-        uint64_t swj = 72057594037927935;
-        pSwd->sequence(swj, 51);
-        swj = 59294;
-        pSwd->sequence(swj, 16);
-        swj = 72057594037927935;
-        pSwd->sequence(swj, 51);
-        swj = 0;
-        pSwd->sequence(swj, 8);
-        sendOkay();
-        break;
+        collect(mExecutor, true);
     }
-    case Request::readprop:
+    if(mpArbiter)
     {
-        if(mStrArgument == std::string("capabilities"))
-        {
-            const char* str = "[\"BANKED_DP_REGISTERS\", \"APv2_ADDRESSES\"]";
-            sendString(str);
-        } 
-        else if(mStrArgument == std::string("supported_wire_protocols"))
+        if(mOpen)
         {
-            const char* str = "[\"DEFAULT\", \"SWD\"]";
-            sendString(str);
-        } 
-        else if(mStrArgument == std::string("wire_protocol"))
-        {
-            const char* str = "\"SWD\"";
-            sendString(str);
-        }            
-        break;
-    }
-    case Request::swj_sequence:
-    {
-        uint64_t swj = mArrayArgument[1];
-        if(mArrayArgument.size() > 2)
-        {
-            swj = (swj << 32) | mArrayArgument[2];
+            mpArbiter->close();
         }
-        pSwd->sequence(swj, mArrayArgument[0]);
-        sendOkay();
-        break;
+        mpArbiter->remove(this);
     }
-    case Request::read_dp:
+}
+
+void PyOcdParser::submit()
+{
+    if(mpArbiter)
     {
-        uint32_t val;
-        if(pSwd->readDp(mIntArgument, val))
-        {
-            sendInt(val);
-        }
-        else
-        {
-            sendError("WifiDebugger: ACK FAULT received");
-        }
-        break;
+        arbitrate(mCommand);
     }
-    case Request::write_dp:
+    dispatch();
+    collect(mExecutor, false);
+}
+
+void PyOcdParser::dispatch()
+{
+    if((mCommand.action != PyOcdCommand::Action::eExecute) and (mInFlight == 0))
     {
-        if(pSwd->writeDp(mArrayArgument[0], mArrayArgument[1]))
-        {
-            sendOkay();
-        }
-        else
-        {
-            sendError("WifiDebugger: ACK FAULT received");
-        }
-        break;
+        // nothing of this client to wait for, a busy client hears it at once
+        queueReply(mCommand.id, mCommand.error);
     }
-    case Request::read_ap:
+    else
     {
-        uint32_t val;
-        if(pSwd->readAp(mIntArgument, val))
-        {
-            sendInt(val);
-        }
-        else
-        {
-            sendError("WifiDebugger: ACK FAULT received");
-        }
-        break;
+        mWaiting = not enqueue();
     }
-    case Request::write_ap:
+}
+
+bool PyOcdParser::enqueue()
+{
+    PyOcdCommand* pSlot = mExecutor.nextCommand();
+    if(pSlot == nullptr)
     {
-        if(pSwd->writeAp(mArrayArgument[0], mArrayArgument[1]))
-        {
-            sendOkay();
-        }
-        else
-        {
-            sendError("WifiDebugger: ACK FAULT received");
-        }
-        break;
+        // all the slots are in flight
+        return false;
     }
-    case Request::flush:
-    case Request::get_memory_interface_for_ap:
+    // the argument vectors trade places and keep their capacity
+    std::swap(*pSlot, mCommand);
+    mExecutor.submit(*this);
+    mInFlight++;
+    return true;
+}
+
+void PyOcdParser::arbitrate(PyOcdCommand& command)
+{
+    static const char* cBusy = "WifiDebugger: probe busy, locked by another client";
+    bool allowed = true;
+    switch(command.request)
     {
-        sendOkay();
-        //sendInt(0);
+    case Request::hello:
+    case Request::readprop:
+        // no target access
         break;
-    }
-    case Request::read_ap_multiple:
-    {
-        std::vector<uint32_t> array;
-        array.resize(mArrayArgument[1]);
-        if(pSwd->readApMultiple(&array[0], array.size()))
-        {
-            sendArray(array);
-        }
-        else
-        {
-            sendError("WifiDebugger: ACK FAULT received");
-        }
+    case Request::lock:
+        allowed = mpArbiter->lock(this);
         break;
-    }
-    case Request::write_ap_multiple:
-    {
-        if(pSwd->writeApMultiple(&mArrayArgument[1], mArrayArgument.size() - 1))
-        {
-            sendOkay();
-        }
-        else
+    case Request::unlock:
+        if(not mpArbiter->unlock(this))
         {
-            sendError("WifiDebugger: ACK FAULT received");
+            command.action = PyOcdCommand::Action::eReject;
+            command.error = "WifiDebugger: lock not held";
         }
         break;
-    }
-    case Request::read_mem:
-    {
-        uint32_t data;
-        if(pSwd->readMemory(mArrayArgument[1], mArrayArgument[2], data))
+    case Request::open:
+        allowed = mpArbiter->mayAccess(this);
+        if(allowed and mOpen)
         {
-            sendInt(data);
+            // opened again by the same client, the line reset was done
+            command.action = PyOcdCommand::Action::eOkay;
         }
-        else
+        else if(allowed)
         {
-            sendError("WifiDebugger: ACK FAULT received");
+            mOpen = true;
+            if(not mpArbiter->open())
+            {
+                // already opened and line reset for another client
+                command.action = PyOcdCommand::Action::eOkay;
+            }
         }
         break;
-    }
-    case Request::write_mem:
-    {
-        if(pSwd->writeMemory(mArrayArgument[1], mArrayArgument[3], mArrayArgument[2]))
-        {
-            sendOkay();
-        }
-        else
+    case Request::close:
+        if(mOpen)
         {
-            sendError("WifiDebugger: ACK FAULT received");
+            mOpen = false;
+            mpArbiter->close();
         }
         break;
+    default:
+        allowed = mpArbiter->mayAccess(this);
+        break;
     }
-    case Request::read_block32:
+    if(not allowed)
     {
-        std::vector<uint32_t> array;
-        array.resize(mArrayArgument[2]);
-        if(pSwd->readMemoryBlcok32(mArrayArgument[1], &array[0], array.size()))
-        {
-            sendArray(array);
-        }
-        else
-        {
-            sendError("WifiDebugger: ACK FAULT received");
-        }
-        break;
+        command.action = PyOcdCommand::Action::eReject;
+        command.error = cBusy;
     }
-    case Request::write_block32:
+}
+
+void PyOcdParser::collect(SwdExecutor& executor, bool all)
+{
+    while(const ReplyBuffer* pReply = executor.reply(all))
     {
-        if(pSwd->writeMemoryBlcok32(mArrayArgument[1], &mArrayArgument[2], mArrayArgument.size() - 2))
-        {
-            sendOkay();
-        }
-        else
-        {
-            sendError("WifiDebugger: ACK FAULT received");
-        }
-        break;
+        PyOcdParser* pOwner = executor.getOwner();
+        pOwner->mInFlight--;
+        pOwner->queueReply(pReply->data(), pReply->size());
+        executor.release();
     }
+}
 
-    case Request::swd_sequence:
-    case Request::jtag_sequence:
-    case Request::reset:
-    case Request::assert_reset:
-    case Request::is_reset_asserted:
-    case Request::swo_start:
-    case Request::swo_stop:
-    case Request::swo_read:
-    case Request::read_block8:
-    case Request::write_block8:
-    default:
-        ESP_LOGW(TAG, "Cmd %s Id %d", Request::toString(mRequest).c_str(), mId);
-        break;
+void PyOcdParser::queueReply(const char* reply, uint32_t length)
+{
+    mTxBuffer.append(reply, length);
+    if(++mQueuedReplies >= cMaxQueuedReplies)
+    {
+        flush();
     }
-    mStrArgument.clear();
-    mArrayArgument.clear();
 }
 
-void PyOcdParser::startObject()
+void PyOcdParser::queueReply(int id, const char* error)
 {
+    char reply[160];
+    const int length = error ?
+        snprintf(reply, sizeof(reply), "{\"id\": %d, \"status\": 1, \"error\": \"%s\"}\n", id, error) :
+        snprintf(reply, sizeof(reply), "{\"id\": %d, \"status\": 0}\n", id);
+    queueReply(reply, std::min<uint32_t>(length, sizeof(reply) - 1));
 }
 
-void PyOcdParser::endObject()
+void PyOcdParser::flush()
 {
+    if(mTxBuffer.size())
+    {
+        mPyOcdIo.send(mTxBuffer.data(), mTxBuffer.size());
+    }
+    mTxBuffer.clear();
+    mQueuedReplies = 0;
 }
 
-void PyOcdParser::startArray()
+void PyOcdParser::begin()
 {
+    mArrayDepth = 0;
+    mKey = Key::eInvalid;
+    mCommand.id = -1;
+    mCommand.request = Request::cmdSize;
+    mCommand.action = PyOcdCommand::Action::eExecute;
+    mCommand.error = nullptr;
+    mCommand.strArgument[0] = 0;
+    mCommand.arrayArgument.clear();     // keeps the capacity
 }
 
-void PyOcdParser::endArray()
+void PyOcdParser::appendChar(char c)
 {
+    if(mStringLength < cMaxString)
+    {
+        mString[mStringLength++] = c;
+    }
 }
 
-void PyOcdParser::key(const char *key)
+void PyOcdParser::onKey()
 {
-    const std::string _key(key);
-    if(_key == std::string("id"))
+    const std::string_view key(mString, mStringLength);
+    if(key == "id")
     {
         mKey = Key::eId;
     }
-    else if(_key == std::string("request"))
+    else if(key == "request")
     {
         mKey = Key::eRequest;
     }
-    else if(_key == std::string("arguments"))
+    else if(key == "arguments")
     {
         mKey = Key::eArguments;
     }
     else
     {
         mKey = Key::eInvalid;
-        ESP_LOGE(TAG, "%s: %s", __func__, key);
+        ESP_LOGE(TAG, "%s: %.*s", __func__, (int)key.size(), key.data());
     }
 }
 
-void PyOcdParser::value(const char *value)
+void PyOcdParser::onString()
 {
     switch(mKey)
     {
-    case Key::eId:
-        mId = std::stoi(value);
-        break;
     case Key::eRequest:
-        mRequest = Request::fromString(std::string(value));
+        mCommand.request = Request::fromString(std::string_view(mString, mStringLength));
         break;
     case Key::eArguments:
-        switch(Request::getArgType(mRequest))
-        {
-        case Request::ArgumentType::eInt:
-            mIntArgument = std::stoi(value);
-            break;
-        case Request::ArgumentType::eString:
-            mStrArgument = std::string(value);
-            break;
-        case Request::ArgumentType::eArray:
+        memcpy(mCommand.strArgument, mString, mStringLength);
+        mCommand.strArgument[mStringLength] = 0;
+        break;
+    default:
+        break;
+    }
+}
+
+void PyOcdParser::onNumber()
+{
+    const uint64_t data = mNegative ? static_cast<uint64_t>(-static_cast<int64_t>(mNumber)) & UINT32_MAX : mNumber;
+    switch(mKey)
+    {
+    case Key::eId:
+        mCommand.id = static_cast<int>(data);
+        break;
+    case Key::eArguments:
+        // 64 bit values (swj_sequence data) take two words, upper first
+        if(data > UINT32_MAX)
         {
-            char* pEnd;
-            uint64_t data = std::strtoull(value, &pEnd, 10);
-            if(data > UINT32_MAX)
-            {
-                mArrayArgument.push_back(data >> 32);
-            }
-            mArrayArgument.push_back(data & UINT32_MAX);
-            break;
-        }
-        default:
-            break;
+            mCommand.arrayArgument.push_back(data >> 32);
         }
+        mCommand.arrayArgument.push_back(data & UINT32_MAX);
         break;
     default:
-        ESP_LOGE(TAG, "%s: %s", __func__, value);
         break;
     }
 }
 
-void PyOcdParser::whitespace(char c)
+void PyOcdParser::onLiteral()
 {
+    // true and false as numbers for the integer arguments and as text for the string ones
+    mNumber = (mStringLength == 4) and (memcmp(mString, "true", 4) == 0);
+    mNegative = false;
+    onNumber();
+    onString();
 }
 
-void PyOcdParser::error( const char *message )
+void PyOcdParser::fail(const char* reason, char c)
 {
-    ESP_LOGE(TAG, "%s", message);
+    ESP_LOGE(TAG, "%s '%c', request %d rejected", reason, c, mCommand.id);
+    mState = State::eIdle;
+    // answered in order with the requests in flight
+    mCommand.action = PyOcdCommand::Action::eReject;
+    mCommand.error = "WifiDebugger: malformed request";
+    dispatch();
 }
 
 void PyOcdParser::parse(char* msg, int len)
 {
-    if (len > 0)
+    if(isBacklogged())
     {
-        msg[len] = 0;
-        //ESP_LOGW(TAG, "%s", rx_buffer);
-        for(int i = 0; i < len; i++)
+        // behind the requests already waiting
+        mBacklog.insert(mBacklog.end(), msg, msg + len);
+        return;
+    }
+    const int used = consume(msg, len);
+    mBacklog.insert(mBacklog.end(), msg + used, msg + len);
+    collect(mExecutor, false);
+}
+
+void PyOcdParser::resume()
+{
+    if(mWaiting)
+    {
+        mWaiting = not enqueue();
+        if(mWaiting)
         {
-            mPaser.parse(msg[i]);
+            return;
         }
     }
+    mResume.swap(mBacklog);     // both keep their capacity
+    const int used = consume(mResume.data(), mResume.size());
+    mBacklog.insert(mBacklog.end(), mResume.begin() + used, mResume.end());
+    mResume.clear();
+    collect(mExecutor, false);
+}
+
+void PyOcdParser::finish()
+{
+    collect(mExecutor, true);
+    while(isBacklogged())
+    {
+        resume();
+        collect(mExecutor, true);
+    }
+    flush();
+}
+
+int PyOcdParser::consume(const char* msg, int len)
+{
+    for(int i = 0; i < len; i++)
+    {
+        const char c = msg[i];
+        const bool space = (c == ' ') or (c == '\n') or (c == '\r') or (c == '\t');
+        switch(mState)
+        {
+        case State::eIdle:
+            if(c == '{')
+            {
+                begin();
+                mState = State::eKey;
+            }
+            break;
+        case State::eKey:
+            if(c == '"')
+            {
+                mStringLength = 0;
+                mEscape = false;
+                mState = State::eKeyString;
+            }
+            else if(c == '}')
+            {
+                submit();
+                mState = State::eIdle;
+            }
+            else if(not space)
+            {
+                fail("key expected", c);
+            }
+            break;
+        case State::eKeyString:
+            if(c == '"')
+            {
+                onKey();
+                mState = State::eColon;
+            }
+            else
+            {
+                appendChar(c);
+            }
+            break;
+        case State::eColon:
+            if(c == ':')
+            {
+                mState = State::eValue;
+            }
+            else if(not space)
+            {
+                fail("':' expected", c);
+            }
+            break;
+        case State::eValue:
+            if(c == '"')
+            {
+                mStringLength = 0;
+                mEscape = false;
+                mState = State::eString;
+            }
+            else if((c >= '0') and (c <= '9'))
+            {
+                mNumber = c - '0';
+                mNegative = false;
+                mState = State::eNumber;
+            }
+            else if(c == '-')
+            {
+                mNumber = 0;
+                mNegative = true;
+                mState = State::eNumber;
+            }
+            else if(c == '[')
+            {
+                mArrayDepth++;
+            }
+            else if((c == ']') and mArrayDepth)
+            {
+                // empty array
+                mArrayDepth--;
+                mState = State::eNext;
+            }
+            else if((c == 't') or (c == 'f') or (c == 'n'))
+            {
+                mStringLength = 0;
+                appendChar(c);
+                mState = State::eLiteral;
+            }
+            else if(not space)
+            {
+                fail("value expected", c);
+            }
+            break;
+        case State::eString:
+            if(mEscape)
+            {
+                appendChar(c);
+                mEscape = false;
+            }
+            else if(c == '\\')
+            {
+                mEscape = true;
+            }
+            else if(c == '"')
+            {
+                onString();
+                mState = State::eNext;
+            }
+            else
+            {
+                appendChar(c);
+            }
+            break;
+        case State::eNumber:
+            if((c >= '0') and (c <= '9'))
+            {
+                mNumber = mNumber * 10 + (c - '0');
+                break;
+            }
+            onNumber();
+            mState = State::eNext;
+            [[fallthrough]];
+        case State::eLiteral:
+            if(mState == State::eLiteral)
+            {
+                if((c >= 'a') and (c <= 'z'))
+                {
+                    appendChar(c);
+                    break;
+                }
+                onLiteral();
+                mState = State::eNext;
+            }
+            [[fallthrough]];
+        case State::eNext:
+            if(c == ',')
+            {
+                mState = mArrayDepth ? State::eValue : State::eKey;
+            }
+            else if((c == ']') and mArrayDepth)
+            {
+                mArrayDepth--;
+            }
+            else if((c == '}') and (mArrayDepth == 0))
+            {
+                submit();
+                mState = State::eIdle;
+            }
+            else if(not space)
+            {
+                fail("',' expected", c);
+            }
+            break;
+        }
+        if(mWaiting)
+        {
+            // the rest waits until a slot is free for this request
+            return i + 1;
+        }
+    }
+    return len;
 }
 
 //-------------------------------------------------------------------
 // PyOcdServer
 //-------------------------------------------------------------------
-PyOcdServer::PyOcdServer() :
-    mPyOcdServerSocket([this](char* rcvMsg, int len)
-    {
-        mPyOcdParser.parse(rcvMsg, len);
-    }),
-    mPyOcdParser(mPyOcdServerSocket)
+PyOcdServer::PyOcdServer(Swd& swd, PyOcdArbiter& arbiter) :
+    TcpService(5555, cMaxClients, CONFIG_PYOCD_RX_BUFFER_SIZE),
+    mExecutor(swd, []{ SocketReactor::create().wake(); }),
+    mArbiter(arbiter)
 {
-}
\ No newline at end of file
+    SocketReactor::create().listen(*this);
+}
+
+PyOcdServer::Client::Client(TcpConnection& connection, SwdExecutor& executor, PyOcdArbiter& arbiter) :
+    io(connection),
+    parser(io, executor, &arbiter)
+{
+}
+
+void PyOcdServer::onAccept(TcpConnection& connection)
+{
+    mClients[&connection] = std::make_unique<Client>(connection, mExecutor, mArbiter);
+}
+
+void PyOcdServer::onReceive(TcpConnection& connection, char* data, int len)
+{
+    // the replies done by now go out together, the rest follow the wake-ups of the executor
+    mClients[&connection]->parser.parse(data, len);
+    serveClients();
+}
+
+void PyOcdServer::onClose(TcpConnection& connection)
+{
+    ESP_LOGW(TAG, "client %d left", connection.getSocket());
+    mClients.erase(&connection);
+    serveClients();
+}
+
+void PyOcdServer::onWake()
+{
+    serveClients();
+}
+
+void PyOcdServer::serveClients()
+{
+    PyOcdParser::collect(mExecutor, false);
+    for(auto& client : mClients)
+    {
+        PyOcdParser& parser = client.second->parser;
+        if(parser.isBacklogged())
+        {
+            parser.resume();
+        }
+        // a client with a backlog isn't read until the executor took it
+        client.first->pauseReceive(parser.isBacklogged());
+        parser.flush();
+    }
+}
@@ -0,0 +1,599 @@
+/*
+Copyright (C) Yudoc Kim <craven@crowz.kr>
+ 
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+ 
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#include <cstring>
+#include "swd_executor.hpp"
+#include <esp_log.h>
+
+static const char * TAG = "SwdExecutor";
+
+namespace
+{
+    constexpr char cDigitPairs[] =
+        "00010203040506070809"
+        "10111213141516171819"
+        "20212223242526272829"
+        "30313233343536373839"
+        "40414243444546474849"
+        "50515253545556575859"
+        "60616263646566676869"
+        "70717273747576777879"
+        "80818283848586878889"
+        "90919293949596979899";
+    constexpr uint32_t cMaxDigits = 10;     // UINT32_MAX
+
+    //! \brief Decimal digits of val ending right before pEnd, two digits per division
+    //! \return the first digit
+    char* formatUint(uint32_t val, char* pEnd)
+    {
+        while(val >= 100)
+        {
+            const uint32_t idx = (val % 100) * 2;
+            val /= 100;
+            *--pEnd = cDigitPairs[idx + 1];
+            *--pEnd = cDigitPairs[idx];
+        }
+        if(val >= 10)
+        {
+            *--pEnd = cDigitPairs[val * 2 + 1];
+            *--pEnd = cDigitPairs[val * 2];
+        }
+        else
+        {
+            *--pEnd = '0' + val;
+        }
+        return pEnd;
+    }
+
+    template<uint32_t N>
+    constexpr uint32_t length(const char (&)[N])
+    {
+        return N - 1;
+    }
+}
+
+//-------------------------------------------------------------------
+// SwdExecutor
+//-------------------------------------------------------------------
+SwdExecutor::SwdExecutor(Swd& swd, std::function<void()>&& onReply) :
+    mSwd(swd),
+    mInFlight(0),
+    mOwners{},
+    mOldest(0),
+    mTask(nullptr),
+    mRun(true),
+    mStopped(false),
+    mStopper(nullptr),
+    mFrontEnd(nullptr),
+    mOnReply(std::move(onReply)),
+    mpReply(nullptr),
+    mpCommand(nullptr)
+{
+
+}
+
+SwdExecutor::~SwdExecutor()
+{
+    if(mTask == nullptr)
+    {
+        return;
+    }
+    // the task leaves its loop, reports back and waits in vTaskSuspend() to be deleted
+    mStopper = xTaskGetCurrentTaskHandle();
+    mRun = false;
+    xTaskNotifyGive(mTask);
+    while(not mStopped)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+    vTaskDelete(mTask);
+    ESP_LOGI(TAG, "stopped");
+}
+
+PyOcdCommand* SwdExecutor::nextCommand()
+{
+    return (mInFlight < cDepth) ? mCommands.back() : nullptr;
+}
+
+void SwdExecutor::submit(PyOcdParser& owner)
+{
+    if(mTask == nullptr)
+    {
+        xTaskCreatePinnedToCore(
+                        (TaskFunction_t)task,   /* Function to implement the task */
+                        "SwdExecutor",  /* Name of the task */
+                        cStackSize,     /* Stack size */
+                        this,           /* Task input parameter */
+                        cPriority,      /* Priority of the task */
+                        &mTask,         /* Task handle. */
+                        cCore);         /* Core where the task should run */
+    }
+    mOwners[(mOldest + mInFlight) % cDepth] = &owner;
+    mInFlight++;
+    mCommands.push();
+    xTaskNotifyGive(mTask);
+}
+
+const ReplyBuffer* SwdExecutor::reply(bool wait)
+{
+    if(mInFlight == 0)
+    {
+        return nullptr;
+    }
+    const ReplyBuffer* pReply = mReplies.front();
+    if(wait and (pReply == nullptr))
+    {
+        // any task may wait, it tells the executor who it is before it looks again
+        mFrontEnd = xTaskGetCurrentTaskHandle();
+        pReply = mReplies.front();
+        while(pReply == nullptr)
+        {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            pReply = mReplies.front();
+        }
+        mFrontEnd = nullptr;
+    }
+    return pReply;
+}
+
+void SwdExecutor::release()
+{
+    mReplies.pop();
+    mOldest = (mOldest + 1) % cDepth;
+    mInFlight--;
+}
+
+void SwdExecutor::task(SwdExecutor* pThis)
+{
+    pThis->run();
+}
+
+void SwdExecutor::run()
+{
+    ESP_LOGI(TAG, "start on core %d", (int)cCore);
+    while(mRun)
+    {
+        const PyOcdCommand* pCommand = mCommands.front();
+        if(pCommand == nullptr)
+        {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+        // never full, the front-end keeps at most cDepth requests in flight
+        ReplyBuffer* pReply = mReplies.back();
+        pReply->clear();
+        mpCommand = pCommand;
+        mpReply = pReply;
+        switch(pCommand->action)
+        {
+        case PyOcdCommand::Action::eExecute:
+        {
+            // the console and the target programmer drive the same probe
+            std::lock_guard<Swd> lock(mSwd);
+            execute(*pCommand);
+            break;
+        }
+        case PyOcdCommand::Action::eOkay:
+            sendOkay();
+            break;
+        case PyOcdCommand::Action::eReject:
+            sendError(pCommand->error);
+            break;
+        }
+        mCommands.pop();
+        mReplies.push();
+        if(mOnReply)
+        {
+            mOnReply();
+        }
+        // pairs with the store of reply(), either it sees the reply or the executor sees the waiter
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const TaskHandle_t frontEnd = mFrontEnd;
+        if(frontEnd)
+        {
+            xTaskNotifyGive(frontEnd);
+        }
+    }
+    mStopped = true;
+    xTaskNotifyGive(mStopper);
+    vTaskSuspend(nullptr);
+}
+
+void SwdExecutor::appendUint(uint32_t val)
+{
+    char digits[cMaxDigits];
+    char* pEnd = digits + sizeof(digits);
+    char* pBegin = formatUint(val, pEnd);
+    mpReply->append(pBegin, pEnd - pBegin);
+}
+
+void SwdExecutor::beginReply(uint32_t status)
+{
+    static constexpr char cId[] = "{\"id\": ";
+    static constexpr char cStatus[] = ", \"status\": ";
+    mpReply->append(cId, length(cId));
+    if(mpCommand->id < 0)
+    {
+        mpReply->append("-", 1);
+    }
+    appendUint(static_cast<uint32_t>((mpCommand->id < 0) ? -mpCommand->id : mpCommand->id));
+    mpReply->append(cStatus, length(cStatus));
+    appendUint(status);
+}
+
+void SwdExecutor::sendOkay()
+{
+    beginReply(0);
+    endReply();
+}
+
+void SwdExecutor::sendString(const char * str)
+{
+    static constexpr char cResult[] = ", \"result\": ";
+    beginReply(0);
+    mpReply->append(cResult, length(cResult));
+    mpReply->append(str, strlen(str));
+    endReply();
+}
+
+void SwdExecutor::sendInt(uint32_t val)
+{
+    static constexpr char cResult[] = ", \"result\": ";
+    beginReply(0);
+    mpReply->append(cResult, length(cResult));
+    appendUint(val);
+    endReply();
+}
+
+template<typename T>
+void SwdExecutor::sendArray(const T* pData, uint32_t count)
+{
+    static constexpr char cResult[] = ", \"result\": [";
+    beginReply(0);
+    mpReply->append(cResult, length(cResult));
+
+    // worst case: 10 digits and ", " per word
+    char* pOut = mpReply->reserve(count * (cMaxDigits + 2) + 1);
+    char digits[cMaxDigits];
+    for(uint32_t i = 0; i < count; i++)
+    {
+        if(i)
+        {
+            *pOut++ = ',';
+            *pOut++ = ' ';
+        }
+        char* pEnd = digits + sizeof(digits);
+        char* pBegin = formatUint(pData[i], pEnd);
+        memcpy(pOut, pBegin, pEnd - pBegin);
+        pOut += pEnd - pBegin;
+    }
+    *pOut++ = ']';
+    mpReply->setEnd(pOut);
+    endReply();
+}
+
+void SwdExecutor::sendError(const char * str)
+{
+    static constexpr char cError[] = ", \"error\": \"";
+    beginReply(1);
+    mpReply->append(cError, length(cError));
+    mpReply->append(str, strlen(str));
+    mpReply->append("\"", 1);
+    endReply();
+}
+
+void SwdExecutor::endReply()
+{
+    mpReply->append("}\n", 2);
+}
+
+void SwdExecutor::execute(const PyOcdCommand& cmd)
+{
+    const std::vector<uint32_t>& args = cmd.arrayArgument;
+    if(args.size() < Request::getArgCount(cmd.request))
+    {
+        sendError("WifiDebugger: missing arguments");
+        return;
+    }
+    const uint32_t intArgument = args.empty() ? 0 : args[0];
+    switch(cmd.request)
+    {
+    case Request::hello:
+        ESP_LOGI(TAG, "version %d", (int)intArgument);
+        sendOkay();                   
+        break;
+    case Request::set_clock:
+    {
+        const uint32_t clock = mSwd.setClock(intArgument);
+        ESP_LOGI(TAG, "clock %d achieved %lu", (int)intArgument, clock);
+        sendInt(clock);
+        break;
+    }
+    case Request::lock:
+    case Request::close:
+    case Request::unlock:
+    case Request::disconnect:
+        sendOkay();
+        break;
+    case Request::connect:
+        mSwd.cleareErrors();
+        sendOkay();
+        break;
+    case Request::open:
+    {
+        mSwd.invalidateCache();
+        uint64_t swj = 72057594037927935;
+        mSwd.sequence(swj, 51);
+        swj = 59294;
+        mSwd.sequence(swj, 16);
+        swj = 72057594037927935;
+        mSwd.sequence(swj, 51);
+        swj = 0;
+        mSwd.sequence(swj, 8);
+        sendOkay();
+        break;
+    }
+    case Request::readprop:
+    {
+        if(strcmp(cmd.strArgument, "capabilities") == 0)
+        {
+            const char* str = "[\"BANKED_DP_REGISTERS\", \"APv2_ADDRESSES\"]";
+            sendString(str);
+        } 
+        else if(strcmp(cmd.strArgument, "supported_wire_protocols") == 0)
+        {
+            const char* str = "[\"DEFAULT\", \"SWD\"]";
+            sendString(str);
+        } 
+        else if(strcmp(cmd.strArgument, "wire_protocol") == 0)
+        {
+            const char* str = "\"SWD\"";
+            sendString(str);
+        }
+        else
+        {
+            sendError("WifiDebugger: unknown property");
+        }
+        break;
+    }
+    case Request::swj_sequence:
+    {
+        uint64_t swj = args[1];
+        if(args.size() > 2)
+        {
+            swj = (swj << 32) | args[2];
+        }
+        // It can be a line reset or a protocol switch sequence
+        mSwd.invalidateCache();
+        mSwd.sequence(swj, args[0]);
+        sendOkay();
+        break;
+    }
+    case Request::read_dp:
+    {
+        uint32_t val;
+        if(mSwd.readDp(intArgument, val))
+        {
+            sendInt(val);
+        }
+        else
+        {
+            sendError("WifiDebugger: ACK FAULT received");
+        }
+        break;
+    }
+    case Request::write_dp:
+    {
+        if(mSwd.writeDp(args[0], args[1]))
+        {
+            sendOkay();
+        }
+        else
+        {
+            sendError("WifiDebugger: ACK FAULT received");
+        }
+        break;
+    }
+    case Request::read_ap:
+    {
+        uint32_t val;
+        if(mSwd.readAp(intArgument, val))
+        {
+            sendInt(val);
+        }
+        else
+        {
+            sendError("WifiDebugger: ACK FAULT received");
+        }
+        break;
+    }
+    case Request::write_ap:
+    {
+        if(mSwd.writeAp(args[0], args[1]))
+        {
+            sendOkay();
+        }
+        else
+        {
+            sendError("WifiDebugger: ACK FAULT received");
+        }
+        break;
+    }
+    case Request::flush:
+    case Request::get_memory_interface_for_ap:
+    {
+        sendOkay();
+        //sendInt(0);
+        break;
+    }
+    case Request::read_ap_multiple:
+    {
+        if(args[1] > cMaxBlockSize / sizeof(uint32_t))
+        {
+            sendError("WifiDebugger: block too large");
+            break;
+        }
+        mReadBuffer.resize(args[1]);
+        if(mSwd.readApMultiple(args[0], mReadBuffer.data(), mReadBuffer.size()))
+        {
+            sendArray(mReadBuffer.data(), mReadBuffer.size());
+        }
+        else
+        {
+            sendError("WifiDebugger: ACK FAULT received");
+        }
+        break;
+    }
+    case Request::write_ap_multiple:
+    {
+        if(mSwd.writeApMultiple(args[0], &args[1], args.size() - 1))
+        {
+            sendOkay();
+        }
+        else
+        {
+            sendError("WifiDebugger: ACK FAULT received");
+        }
+        break;
+    }
+    case Request::read_mem:
+    {
+        uint32_t data;
+        if(mSwd.readMemory(args[1], args[2], data))
+        {
+            sendInt(data);
+        }
+        else
+        {
+            sendError("WifiDebugger: ACK FAULT received");
+        }
+        break;
+    }
+    case Request::write_mem:
+    {
+        if(mSwd.writeMemory(args[1], args[3], args[2]))
+        {
+            sendOkay();
+        }
+        else
+        {
+            sendError("WifiDebugger: ACK FAULT received");
+        }
+        break;
+    }
+    case Request::read_block32:
+    {
+        if(args[2] > cMaxBlockSize / sizeof(uint32_t))
+        {
+            sendError("WifiDebugger: block too large");
+            break;
+        }
+        mReadBuffer.resize(args[2]);
+        if(mSwd.readMemoryBlcok32(args[1], mReadBuffer.data(), mReadBuffer.size()))
+        {
+            sendArray(mReadBuffer.data(), mReadBuffer.size());
+        }
+        else
+        {
+            sendError("WifiDebugger: ACK FAULT received");
+        }
+        break;
+    }
+    case Request::write_block32:
+    {
+        if(mSwd.writeMemoryBlcok32(args[1], &args[2], args.size() - 2))
+        {
+            sendOkay();
+        }
+        else
+        {
+            sendError("WifiDebugger: ACK FAULT received");
+        }
+        break;
+    }
+    case Request::read_block8:
+    {
+        if(args[2] > cMaxBlockSize)
+        {
+            sendError("WifiDebugger: block too large");
+            break;
+        }
+        mByteBuffer.resize(args[2]);
+        if(mSwd.readMemoryBlcok8(args[1], mByteBuffer.data(), mByteBuffer.size()))
+        {
+            sendArray(mByteBuffer.data(), mByteBuffer.size());
+        }
+        else
+        {
+            sendError("WifiDebugger: ACK FAULT received");
+        }
+        break;
+    }
+    case Request::write_block8:
+    {
+        mByteBuffer.assign(args.begin() + 2, args.end());
+        if(mSwd.writeMemoryBlcok8(args[1], mByteBuffer.data(), mByteBuffer.size()))
+        {
+            sendOkay();
+        }
+        else
+        {
+            sendError("WifiDebugger: ACK FAULT received");
+        }
+        break;
+    }
+
+    case Request::crc32:
+    {
+        // [handle, ram, addr, length, addr, length, ...], one CRC32 per region
+        if(args.size() % 2)
+        {
+            sendError("WifiDebugger: invalid regions");
+            break;
+        }
+        mReadBuffer.resize((args.size() - 2) / 2);
+        bool ret = true;
+        for(uint32_t i = 0; ret and (i < mReadBuffer.size()); i++)
+        {
+            ret = mSwd.crc32(args[1], args[2 + i * 2], args[3 + i * 2], mReadBuffer[i]);
+        }
+        if(ret)
+        {
+            sendArray(mReadBuffer.data(), mReadBuffer.size());
+        }
+        else
+        {
+            sendError("WifiDebugger: CRC on the target failed");
+        }
+        break;
+    }
+
+    case Request::swd_sequence:
+    case Request::jtag_sequence:
+    case Request::reset:
+    case Request::assert_reset:
+    case Request::is_reset_asserted:
+    case Request::swo_start:
+    case Request::swo_stop:
+    case Request::swo_read:
+    default:
+        ESP_LOGW(TAG, "Cmd %s Id %d", Request::toString(cmd.request).c_str(), cmd.id);
+        sendError("WifiDebugger: unsupported request");
+        break;
+    }
+}
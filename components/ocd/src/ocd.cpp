@@ -16,8 +16,17 @@ along with this program; if not, write to the Free Software
 Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 */
 
+#include "sdkconfig.h"
 #include "ocd.hpp"
 #include "pyocd_server.hpp"
+#if CONFIG_IDF_TARGET_LINUX
+#include "sim_swd.hpp"
+#elif CONFIG_SWD_BACKEND_SPI
+#include "spi_swd.hpp"
+#else
+#include "gpio_swd.hpp"
+#endif
+#include "target_programmer.hpp"
 
 Ocd& Ocd::create()
 {
@@ -26,11 +35,30 @@ Ocd& Ocd::create()
 }
 
 Ocd::Ocd() :
-    mpPyOcdServer(std::make_unique<PyOcdServer>())
+#if CONFIG_IDF_TARGET_LINUX
+    mpSwd(std::make_unique<SimSwd>()),
+#elif CONFIG_SWD_BACKEND_SPI
+    mpSwd(std::make_unique<SpiSwd>()),
+#else
+    mpSwd(std::make_unique<GpioSwd>()),
+#endif
+    mpArbiter(std::make_unique<PyOcdArbiter>()),
+    mpPyOcdServer(std::make_unique<PyOcdServer>(*mpSwd, *mpArbiter)),
+    mpTargetProgrammer(std::make_unique<TargetProgrammer>(*mpSwd, *mpArbiter))
 {
 
 }
 
+Swd& Ocd::getSwd()
+{
+    return *mpSwd;
+}
+
+PyOcdArbiter& Ocd::getArbiter()
+{
+    return *mpArbiter;
+}
+
 Ocd::~Ocd()
 {
 
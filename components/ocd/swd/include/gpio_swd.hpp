@@ -30,6 +30,8 @@ public:
     uint32_t sequence(uint64_t data, uint8_t bitLength) override;
     Response write(Cmd cmd, uint32_t data) override;
     Response read(Cmd cmd, uint32_t& data) override;
+    Response transfer(Transfer* pTransfers, uint32_t count, uint32_t& done) override;
+    uint32_t setClock(uint32_t hz) override;
 
 protected:
 #if (CONFIG_M5STACK_CORE | CONFIG_TTGO_T1)
@@ -49,6 +51,17 @@ protected:
     static constexpr gpio_num_t cPinSwDio = (gpio_num_t)40;
 #endif
 
+    uint32_t mCpuHz;
+    uint32_t mMinBitCycles;     // CPU cycles of a bit without delay
+    uint32_t mBitOverhead;      // CPU cycles of a bit besides the half periods its delays count
+    uint32_t mHalfPeriod;       // CPU cycles of a half SWCLK period
+
+    void calibrate();
+    uint32_t measureBit();
+    inline void setSwClk(bool level);
+    inline void setSwDio(bool level);
+    inline bool getSwDio();
+    inline void setSwDioOutput(bool output);
     inline void delay();
     inline void clkCycle();
     inline void writeBit(bool bit);
@@ -0,0 +1,122 @@
+/*
+Copyright (C) Yudoc Kim <craven@crowz.kr>
+ 
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+ 
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+#include "swd.hpp"
+
+//! Simulated target: an ADIv5 SW-DP, a MEM-AP on a sparse memory and a Cortex-M debug core
+//! \note No wire is driven, every access is counted with the bits a real SWD packet would take,
+//!       so transfer counts and throughput of the Swd code can be measured without hardware
+class SimSwd : public Swd
+{
+public:
+    static constexpr uint32_t cIdcode = 0x2BA01477;    // SW-DP v1
+    static constexpr uint32_t cApIdr = 0x24770011;     // AHB-AP
+    static constexpr uint32_t cCpuid = 0x410FC241;     // Cortex-M4 r0p1
+
+    //! Wire statistics since the last resetStats()
+    struct Stats
+    {
+        uint64_t bits;          // SWCLK cycles
+        uint32_t transfers;     // packets, retries included
+        uint32_t waits;
+        uint32_t faults;
+        uint32_t sequences;     // line resets and switch sequences
+    };
+
+    //! \brief Function run when the core is resumed, its return value goes to R0
+    //! \param pArgs R0-R3
+    //! \note The core halts at LR right after, as if the function returned to the breakpoint
+    using CallHandler = std::function<uint32_t(SimSwd& sim, uint32_t pc, const uint32_t* pArgs)>;
+
+    SimSwd();
+    ~SimSwd() = default;
+
+    uint32_t sequence(uint64_t data, uint8_t bitLength) override;
+    Response write(Cmd cmd, uint32_t data) override;
+    Response read(Cmd cmd, uint32_t& data) override;
+    uint32_t setClock(uint32_t hz) override;
+
+    //! \brief Every n-th AP access is answered with WAIT, 0 disables
+    void setWaitInterval(uint32_t interval);
+    //! \brief Memory accesses to the range set STICKYERR
+    void addFaultRegion(uint32_t addr, uint32_t size);
+    void setCallHandler(CallHandler&& handler);
+
+    void resetStats();
+    const Stats& getStats() const { return mStats; }
+    //! \brief Time the recorded traffic takes at the current clock
+    uint32_t getWireTimeUs() const;
+
+    //! \brief Direct memory access bypassing the DAP
+    uint8_t peek8(uint32_t addr) const;
+    void poke8(uint32_t addr, uint8_t data);
+    uint32_t peek32(uint32_t addr) const;
+    void poke32(uint32_t addr, uint32_t data);
+
+protected:
+    static constexpr uint32_t cRequestBits = 8;
+    static constexpr uint32_t cAckBits = 4;         // turnaround and ACK
+    static constexpr uint32_t cDataBits = 34;       // data, parity and turnaround
+    static constexpr uint32_t cTarIncWindow = 0x400;
+    static constexpr uint32_t cCoreRegs = 21;       // R0-R15, xPSR, MSP, PSP, special, FPSCR
+
+    struct Region
+    {
+        uint32_t addr;
+        uint32_t size;
+    };
+
+    Stats mStats;
+    uint32_t mWaitInterval;
+    uint32_t mApAccesses;
+    std::vector<Region> mFaultRegions;
+    CallHandler mCallHandler;
+
+    // DP
+    uint32_t mDpCtrlStat;
+    uint32_t mDpSelect;
+    uint32_t mDpRdBuff;
+
+    // MEM-AP
+    uint32_t mApCsw;
+    uint32_t mApTar;
+
+    // core
+    uint32_t mDhcsr;
+    uint32_t mDcrdr;
+    uint32_t mDemcr;
+    uint32_t mRegs[cCoreRegs];
+
+    std::unordered_map<uint32_t, uint32_t> mMemory;     // word address to data
+
+    Response access(Cmd cmd, uint32_t& data);
+    Response accessDp(Cmd cmd, uint32_t& data);
+    Response accessAp(Cmd cmd, uint32_t& data);
+    bool isFaultAddr(uint32_t addr) const;
+    bool readBus(uint32_t addr, uint32_t size, uint32_t& data);
+    bool writeBus(uint32_t addr, uint32_t size, uint32_t data);
+    uint32_t readScs(uint32_t addr);
+    void writeScs(uint32_t addr, uint32_t data);
+    void resume();
+};
@@ -21,18 +21,38 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 #include "swd.hpp"
 #include "driver/gpio.h"
 #include "driver/spi_master.h"
+#include "sdkconfig.h"
 
+//! SWD over the SPI peripheral
+//! \note The packet mode runs the bus full duplex and sends a whole run of transfers in one DMA transaction.
+//!       MOSI drives SWDIO through a series resistor and cPinSwDioIn (MISO) reads SWDIO back.
+//!       A WAIT or FAULT is only recoverable in the middle of a packet with overrun detection,
+//!       so the packet mode is used while ORUNDETECT is set.
 class SpiSwd : public Swd
 {
 public:
     SpiSwd();
-    ~SpiSwd() = default;
+    //! \brief Remove the devices and free the bus, a new SpiSwd may take it again
+    ~SpiSwd();
 
     uint32_t sequence(uint64_t data, uint8_t bitLength) override;
     Response write(Cmd cmd, uint32_t data) override;
     Response read(Cmd cmd, uint32_t& data) override;
+    Response transfer(Transfer* pTransfers, uint32_t count, uint32_t& done) override;
+    uint32_t setClock(uint32_t hz) override;
 
 protected:
     static constexpr gpio_num_t cPinSwClk = (gpio_num_t)23;
     static constexpr gpio_num_t cPinSwDio = (gpio_num_t)19;
+    static constexpr int cPinSwDioIn = CONFIG_SWD_SPI_PACKET_DIN_GPIO;
+
+    static constexpr uint32_t cFrameBits = 48;                  // a transfer including trn, data phase and idle
+    static constexpr uint32_t cFrameBytes = cFrameBits / 8;
+    static constexpr uint32_t cMaxPacketTransfers = 64;
+    static constexpr uint32_t cPacketSize = cMaxPacketTransfers * cFrameBytes;
+
+    uint8_t* mpTxPacket;
+    uint8_t* mpRxPacket;
+
+    Response transferPacket(Transfer* pTransfers, uint32_t count, uint32_t& done);
 };
@@ -20,6 +20,8 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 
 #include <stdint.h>
 #include <vector>
+#include <map>
+#include <mutex>
 #include "dap.hpp"
 
 // Debug Port Register Addresses
@@ -30,6 +32,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 #define DP_SELECT                       0x08U   // Select Register (JTAG R/W & SW W)
 #define DP_RESEND                       0x08U   // Resend (SW Read Only)
 #define DP_RDBUFF                       0x0CU   // Read Buffer (Read Only)
+#define DP_DPBANKSEL                    0x0FU   // DP register bank in SELECT
 
 //! SWD interface
 class Swd : public Dap
@@ -77,6 +80,16 @@ public:
 	};
 
     using Cmd = uint8_t;
+
+    //! A wire level transfer of the transfer queue
+    struct Transfer
+    {
+        Cmd cmd;            // SWD_REG_AP/DP | SWD_REG_R/W | SWD_REG_ADR
+        uint32_t data;      // data to write
+        uint32_t* pRead;    // destination of the read data, can be null
+        uint32_t request;   // index of the queued request owning this transfer
+    };
+
     Swd();
     virtual ~Swd() = default;
 
@@ -84,6 +97,45 @@ public:
     virtual Response write(Cmd cmd, uint32_t data) = 0;
     virtual Response read(Cmd cmd, uint32_t& data) = 0;
 
+    //! \brief Set SWCLK frequency
+    //! \return achieved frequency in Hz
+    virtual uint32_t setClock(uint32_t hz) = 0;
+    uint32_t getClock() const { return mClock; }
+
+    //! \brief Execute wire transfers back to back
+    //! \param pTransfers transfers to execute, read data is stored to pRead
+    //! \param count number of transfers
+    //! \param done number of transfers completed with OK
+    //! \note backends should override this with a tight loop
+    virtual Response transfer(Transfer* pTransfers, uint32_t count, uint32_t& done);
+
+    //! \brief Queue a DP/AP access, it is executed by flushQueue()
+    //! \note AP reads are posted, the queue resolves them with the next AP read or RDBUFF
+    void queueReadDp(uint8_t addr, uint32_t* pData);
+    void queueWriteDp(uint8_t addr, uint32_t data);
+    void queueReadAp(uint8_t addr, uint32_t* pData);
+    void queueWriteAp(uint8_t addr, uint32_t data);
+
+    //! \brief Execute all queued accesses
+    //! \param done number of queued requests completed (index of the first fault)
+    Response flushQueue(uint32_t& done);
+    bool flushQueue(const char* func);
+
+    //! \brief Forget the shadowed SELECT, CSW and TAR values
+    //! \note call this when the DP state is changed outside of the queue (line reset, target power cycle)
+    void invalidateCache();
+
+    //! \brief Set or clear ORUNDETECT in CTRL/STAT
+    //! \note with overrun detection WAIT and FAULT responses have a data phase,
+    //!       and every transfer after a WAIT is rejected until STICKYORUN is cleared
+    bool setOverrunDetect(bool enable);
+
+    //! \brief Take the probe for a sequence of calls
+    //! \note The transfer queue and the SELECT/CSW/TAR shadows belong to one user at a time,
+    //!       every task that drives the probe holds it, std::lock_guard<Swd> works
+    void lock() { mUserMutex.lock(); }
+    void unlock() { mUserMutex.unlock(); }
+
     inline uint8_t getCmd(Cmd cmd)
     {
         uint32_t parity = __builtin_popcount(cmd);
@@ -93,15 +145,19 @@ public:
     bool cleareErrors();
     bool readDp(uint8_t addr, uint32_t& dp);
     bool writeDp(uint8_t addr, uint32_t dp);
-    bool readAp(uint8_t addr, uint32_t& ap, bool dpSelect = false);
-    bool readApMultiple(uint32_t* pBuffer, uint32_t length);
-    bool writeAp(uint8_t addr, uint32_t ap, bool dpSelect = false);
-    bool writeApMultiple(const uint32_t* pBuffer, uint32_t length);
+    //! \note addr is APSEL[31:24] | APBANKSEL[7:4] | A[3:2], dpSelect selects the AP and bank first
+    bool readAp(uint32_t addr, uint32_t& ap, bool dpSelect = false);
+    bool readApMultiple(uint32_t addr, uint32_t* pBuffer, uint32_t length, bool dpSelect = false);
+    bool writeAp(uint32_t addr, uint32_t ap, bool dpSelect = false);
+    bool writeApMultiple(uint32_t addr, const uint32_t* pBuffer, uint32_t length, bool dpSelect = false);
 
     bool writeMemory(uint32_t addr, uint32_t transferSize, uint32_t data);
     bool readMemory(uint32_t addr, uint32_t transferSize, uint32_t& data);
     bool writeMemoryBlcok32(uint32_t addr, const uint32_t* pBuffer, uint32_t length);
     bool readMemoryBlcok32(uint32_t addr, uint32_t* pBuffer, uint32_t length);
+    //! \note the aligned middle goes as a 32-bit block, the head and the tail with byte/halfword lanes
+    bool writeMemoryBlcok8(uint32_t addr, const uint8_t* pBuffer, uint32_t length);
+    bool readMemoryBlcok8(uint32_t addr, uint8_t* pBuffer, uint32_t length);
 
     bool errorCheck(const char* func, Response res);
 
@@ -113,12 +169,73 @@ public:
     bool jtagToSwd();
 
     bool sysCallExec(const ProgramSysCall& sysCallParam, uint32_t entry, uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4, FlashAlgoRetType return_type);
+    //! \brief Start a function on the target and return while it runs, the memory stays accessible
+    bool sysCallStart(const ProgramSysCall& sysCallParam, uint32_t entry, uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4);
+    //! \brief Wait until the function started by sysCallStart() returns to the breakpoint
+    //! \param result R0 of the function
+    bool sysCallWait(uint32_t& result);
+    //! \brief CRC32 of the target memory computed by the halted core, the same as esp_rom_crc32_le(0, ...)
+    //! \param ram cCrc32CodeSize words of RAM for the routine, the RAM and the core registers are restored
+    bool crc32(uint32_t ram, uint32_t addr, uint32_t length, uint32_t& crc);
     bool initDebug();
     bool setStateByHw(TargetState state);
     bool setStateBySw(TargetState state);
     void printPC();
+
+    // uint32_t crc32(const uint8_t* p, uint32_t length, uint32_t crc) in ARMv6-M Thumb code
+    static const uint32_t cCrc32Code[];
+    static const uint32_t cCrc32CodeSize;
+
+protected:
+    static constexpr uint32_t cDefaultClock = 1000000;
+    static constexpr uint32_t cMaxWaitRetry = 100;
+    uint32_t mClock;
+    bool mOverrunDetect;        // ORUNDETECT written to CTRL/STAT
+    bool mBlockOverrunDetect;   // block transfers run with overrun detection
+
 private:
-    uint32_t mCsw;
+    static constexpr uint32_t cMaxQueuedTransfers = 256;
+    static constexpr uint32_t cTarIncWindow = 0x400;   // TAR auto increment is guaranteed within 1KB
+
+    //! Shadow of the MEM-AP registers which are written by the queue
+    struct ApCache
+    {
+        uint32_t csw;
+        uint32_t tar;
+        bool cswValid;
+        bool tarValid;
+    };
+
+    std::mutex mUserMutex;
+    uint32_t mSelect;
+    bool mSelectValid;
+    uint32_t mCtrlStat;         // writable bits of CTRL/STAT
+    bool mCtrlStatValid;
+    std::map<uint8_t, ApCache> mApCache;
+    std::vector<Transfer> mQueue;
+    uint32_t mQueuedRequests;
+    uint32_t* mpPostedRead;     // destination of the AP read not resolved yet
+    uint32_t mPostedRequest;    // request index of the last posted AP access
+    bool mPostedRead;
+    bool mPostedWrite;
+
+    void queue(Cmd cmd, uint32_t data, uint32_t* pRead, uint32_t request);
+    void queueSelect(uint32_t apAddr);
+    ApCache* getApCache();
+    static uint32_t getTarIncrement(uint32_t csw);
+    void advanceTar(ApCache& ap);
+    void resolvePostedRead();
+    void queueWriteMem32(uint32_t addr, uint32_t data);
+    void queueReadMem32(uint32_t addr, uint32_t* pData);
+    uint32_t queueLanes(uint32_t addr, uint32_t length, uint32_t* pRead, const uint8_t* pWrite);
+    //! \brief Set ORUNDETECT for a block transfer, cleared again if that fails
+    bool beginBlock();
+    //! \brief Clear ORUNDETECT after a block transfer, also when the shadow was invalidated by a failure
+    bool endBlock();
+    bool recoverBlock(Response res, uint32_t select);
+    //! \brief Stream a block and clear ORUNDETECT whichever way it ends
+    bool transferBlock(uint32_t addr, uint32_t* pRead, const uint32_t* pWrite, uint32_t length);
+    bool streamBlock(uint32_t addr, uint32_t* pRead, const uint32_t* pWrite, uint32_t length);
     bool reset();
     bool switchMode(uint16_t mode);
     bool readIdCode(uint32_t& id);
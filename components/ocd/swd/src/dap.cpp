@@ -19,7 +19,6 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 #include "dap.hpp"
 #include <thread>
 
-static const char *TAG = "Dap";
 using namespace std::chrono_literals;
 Dap::Dap()
 {
@@ -17,13 +17,52 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 */
 
 #include "gpio_swd.hpp"
+#include "debug_cm.h"
 #include <esp_log.h>
+#include <esp_cpu.h>
+#include <esp_rom_sys.h>
+#include <hal/gpio_ll.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 
+static const char * TAG = "GpioSwd";
+
+inline void GpioSwd::setSwClk(bool level)
+{
+    gpio_ll_set_level(&GPIO, cPinSwClk, level);
+}
+
+inline void GpioSwd::setSwDio(bool level)
+{
+    gpio_ll_set_level(&GPIO, cPinSwDio, level);
+}
+
+inline bool GpioSwd::getSwDio()
+{
+    return gpio_ll_get_level(&GPIO, cPinSwDio);
+}
+
+inline void GpioSwd::setSwDioOutput(bool output)
+{
+    // The input path stays enabled, only the output driver is switched
+    if(output)
+    {
+        gpio_ll_output_enable(&GPIO, cPinSwDio);
+    }
+    else
+    {
+        gpio_ll_output_disable(&GPIO, cPinSwDio);
+    }
+}
+
 inline void GpioSwd::delay()
 {
-    for(int i = 0; i < 10; i ++)
+    if(mHalfPeriod == 0)
+    {
+        return;
+    }
+    const uint32_t start = esp_cpu_get_cycle_count();
+    while((esp_cpu_get_cycle_count() - start) < mHalfPeriod)
     {
         ;
     }
@@ -31,28 +70,28 @@ inline void GpioSwd::delay()
 
 inline void GpioSwd::clkCycle()
 {
-    gpio_set_level(cPinSwClk, false);
+    setSwClk(false);
     delay();
-    gpio_set_level(cPinSwClk, true);
+    setSwClk(true);
     delay();
 }
 
 inline void GpioSwd::writeBit(bool bit)
 {
-    gpio_set_level(cPinSwDio, bit);
-    gpio_set_level(cPinSwClk, false);
+    setSwDio(bit);
+    setSwClk(false);
     delay();
-    gpio_set_level(cPinSwClk, true);
+    setSwClk(true);
     delay();
 }
 
 inline bool GpioSwd::readBit()
 {
-    int in;
-    gpio_set_level(cPinSwClk, false);
+    bool in;
+    setSwClk(false);
     delay();
-    in = gpio_get_level(cPinSwDio);
-    gpio_set_level(cPinSwClk, true);
+    in = getSwDio();
+    setSwClk(true);
     delay();
 
     return in;
@@ -90,14 +129,69 @@ inline uint32_t GpioSwd::readAck()
     return ack;
 }
 
-GpioSwd::GpioSwd()
+GpioSwd::GpioSwd() :
+    mCpuHz(esp_rom_get_cpu_ticks_per_us() * 1000000),
+    mMinBitCycles(0),
+    mBitOverhead(0),
+    mHalfPeriod(0)
 {
     gpio_reset_pin(cPinSwDio);
     gpio_reset_pin(cPinSwClk);
-    gpio_set_direction(cPinSwDio, GPIO_MODE_OUTPUT);
+    gpio_set_direction(cPinSwDio, GPIO_MODE_INPUT_OUTPUT);
+    gpio_set_pull_mode(cPinSwDio, GPIO_PULLUP_ONLY);
     gpio_set_direction(cPinSwClk, GPIO_MODE_OUTPUT);
     gpio_set_level(cPinSwDio, false);
     gpio_set_level(cPinSwClk, false);
+
+    calibrate();
+    setClock(cDefaultClock);
+}
+
+uint32_t GpioSwd::measureBit()
+{
+    // SWDIO high looks like a line reset to the target
+    constexpr uint32_t cBits = 64;
+    const uint32_t start = esp_cpu_get_cycle_count();
+    for(uint32_t i = 0; i < cBits; i++)
+    {
+        writeBit(true);
+    }
+    return (esp_cpu_get_cycle_count() - start + cBits - 1) / cBits;
+}
+
+void GpioSwd::calibrate()
+{
+    mHalfPeriod = 0;
+    mMinBitCycles = measureBit();
+    // The shortest delay still reads the cycle counter and spins once, charge that to every delayed bit
+    mHalfPeriod = 1;
+    const uint32_t delayedBit = measureBit();
+    mBitOverhead = (delayedBit > 2) ? delayedBit - 2 : 0;
+    mHalfPeriod = 0;
+    invalidateCache();
+    ESP_LOGI(TAG, "cpu %lu Hz, %lu cycles per bit, %lu with delay, max clock %lu Hz",
+        mCpuHz, mMinBitCycles, delayedBit, mCpuHz / mMinBitCycles);
+}
+
+uint32_t GpioSwd::setClock(uint32_t hz)
+{
+    if(hz == 0)
+    {
+        hz = cDefaultClock;
+    }
+    const uint32_t period = mCpuHz / hz;
+    if(period < mBitOverhead + 2)
+    {
+        // Even the shortest delay is too slow, run without
+        mHalfPeriod = 0;
+        mClock = mCpuHz / mMinBitCycles;
+    }
+    else
+    {
+        mHalfPeriod = (period - mBitOverhead) / 2;
+        mClock = mCpuHz / (mBitOverhead + mHalfPeriod * 2);
+    }
+    return mClock;
 }
 
 uint32_t GpioSwd::sequence(uint64_t data, uint8_t bitLength)
@@ -113,18 +207,18 @@ uint32_t GpioSwd::sequence(uint64_t data, uint8_t bitLength)
 GpioSwd::Response GpioSwd::write(Cmd cmd, uint32_t data)
 {
     Response ack;
+    uint32_t retry = 0;
     do
     {
         sendRequest(cmd);
-        gpio_set_direction(cPinSwDio, GPIO_MODE_INPUT);
-        gpio_set_pull_mode(cPinSwDio, GPIO_PULLUP_ONLY);
+        setSwDioOutput(false);
         clkCycle();
 
         ack = static_cast<Response>(readAck());
         if(ack == Response::Ok)
         {
             clkCycle();
-            gpio_set_direction(cPinSwDio, GPIO_MODE_OUTPUT);
+            setSwDioOutput(true);
 
             uint32_t parity = 0;
             uint32_t val = data;
@@ -135,29 +229,38 @@ GpioSwd::Response GpioSwd::write(Cmd cmd, uint32_t data)
                 val >>= 1;
             }
             writeBit((parity & 1) > 0);
-            gpio_set_level(cPinSwDio, false);
+            setSwDio(false);
             clkCycle();
             clkCycle();
-            gpio_set_level(cPinSwDio, true);
+            setSwDio(true);
         }
         else if((ack == Response::Wait) or (ack == Response::Fault))
         {
             clkCycle();
-            gpio_set_direction(cPinSwDio, GPIO_MODE_OUTPUT);
-            gpio_set_level(cPinSwDio, true);
+            setSwDioOutput(true);
+            if(mOverrunDetect)
+            {
+                // data phase of the rejected write
+                setSwDio(false);
+                for(int i = 33; i; i--)
+                {
+                    clkCycle();
+                }
+            }
+            setSwDio(true);
         }
-    } while(ack == Response::Wait);
+    } while((ack == Response::Wait) and not mOverrunDetect and (++retry < cMaxWaitRetry));
     return ack;
 }
 
 GpioSwd::Response GpioSwd::read(Cmd cmd, uint32_t& data)
 {
     Response ack;
+    uint32_t retry = 0;
     do
     {
         sendRequest(cmd);
-        gpio_set_direction(cPinSwDio, GPIO_MODE_INPUT);
-        gpio_set_pull_mode(cPinSwDio, GPIO_PULLUP_ONLY);
+        setSwDioOutput(false);
         clkCycle();
 
         ack = static_cast<Response>(readAck());
@@ -179,21 +282,55 @@ GpioSwd::Response GpioSwd::read(Cmd cmd, uint32_t& data)
             }
             data = val;
             clkCycle();
-            gpio_set_direction(cPinSwDio, GPIO_MODE_OUTPUT);
-            gpio_set_level(cPinSwDio, false);
+            setSwDioOutput(true);
+            setSwDio(false);
             clkCycle();
             clkCycle();
-            gpio_set_level(cPinSwDio, true);
+            setSwDio(true);
         }
         else if((ack == Response::Wait) or (ack == Response::Fault))
         {
+            if(mOverrunDetect)
+            {
+                // data phase of the rejected read
+                for(int i = 33; i; i--)
+                {
+                    clkCycle();
+                }
+            }
             clkCycle();
-            gpio_set_direction(cPinSwDio, GPIO_MODE_OUTPUT);
-            gpio_set_level(cPinSwDio, true);
+            setSwDioOutput(true);
+            setSwDio(true);
         }
-
-        /* code */
-    } while (ack == Response::Wait);
+    } while((ack == Response::Wait) and not mOverrunDetect and (++retry < cMaxWaitRetry));
     return ack;
 }
 
+GpioSwd::Response GpioSwd::transfer(Transfer* pTransfers, uint32_t count, uint32_t& done)
+{
+    // Same as Swd::transfer but without the virtual calls between the transfers
+    Response ack = Response::Ok;
+    for(done = 0; done < count; done++)
+    {
+        Transfer& t = pTransfers[done];
+        if(t.cmd & SWD_REG_R)
+        {
+            uint32_t data;
+            ack = GpioSwd::read(t.cmd, data);
+            if(t.pRead)
+            {
+                *t.pRead = data;
+            }
+        }
+        else
+        {
+            ack = GpioSwd::write(t.cmd, t.data);
+        }
+
+        if(ack != Response::Ok)
+        {
+            break;
+        }
+    }
+    return ack;
+}
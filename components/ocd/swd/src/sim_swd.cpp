@@ -0,0 +1,483 @@
+/*
+Copyright (C) Yudoc Kim <craven@crowz.kr>
+ 
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+ 
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#include "sim_swd.hpp"
+
+// Default NVIC and Core debug base addresses
+#define NVIC_Addr (0xe000e000)
+#define DBG_Addr (0xe000edf0)
+
+#include "debug_cm.h"
+
+#define REGWnR (1 << 16)
+#define CTRL_STAT_WRITABLE (ORUNDETECT | TRNMODE | MASKLANE | CDBGRSTREQ | CDBGPWRUPREQ | CSYSPWRUPREQ)
+#define CTRL_STAT_STICKY (STICKYORUN | STICKYCMP | STICKYERR | WDATAERR)
+#define DHCSR_CTRL (C_DEBUGEN | C_HALT | C_STEP | C_MASKINTS | C_SNAPSTALL)
+#define AP_ROM_VALUE 0xE00FF003
+
+SimSwd::SimSwd() :
+    mStats{0, 0, 0, 0, 0},
+    mWaitInterval(0),
+    mApAccesses(0),
+    mDpCtrlStat(0),
+    mDpSelect(0),
+    mDpRdBuff(0),
+    mApCsw(CSW_SIZE32),
+    mApTar(0),
+    mDhcsr(0),
+    mDcrdr(0),
+    mDemcr(0),
+    mRegs{0}
+{
+    mClock = cDefaultClock;
+}
+
+uint32_t SimSwd::sequence(uint64_t, uint8_t bitLength)
+{
+    mStats.bits += bitLength;
+    mStats.sequences++;
+    return 0;
+}
+
+SimSwd::Response SimSwd::write(Cmd cmd, uint32_t data)
+{
+    Response ack;
+    uint32_t retry = 0;
+    do
+    {
+        uint32_t value = data;
+        ack = access(cmd, value);
+    } while((ack == Wait) and not mOverrunDetect and (++retry < cMaxWaitRetry));
+    return ack;
+}
+
+SimSwd::Response SimSwd::read(Cmd cmd, uint32_t& data)
+{
+    Response ack;
+    uint32_t retry = 0;
+    do
+    {
+        ack = access(cmd, data);
+    } while((ack == Wait) and not mOverrunDetect and (++retry < cMaxWaitRetry));
+    return ack;
+}
+
+uint32_t SimSwd::setClock(uint32_t hz)
+{
+    mClock = hz;
+    return mClock;
+}
+
+void SimSwd::setWaitInterval(uint32_t interval)
+{
+    mWaitInterval = interval;
+    mApAccesses = 0;
+}
+
+void SimSwd::addFaultRegion(uint32_t addr, uint32_t size)
+{
+    mFaultRegions.push_back({addr, size});
+}
+
+void SimSwd::setCallHandler(CallHandler&& handler)
+{
+    mCallHandler = std::move(handler);
+}
+
+void SimSwd::resetStats()
+{
+    mStats = Stats{0, 0, 0, 0, 0};
+}
+
+uint32_t SimSwd::getWireTimeUs() const
+{
+    return (mClock == 0) ? 0 : static_cast<uint32_t>(mStats.bits * 1000000 / mClock);
+}
+
+uint8_t SimSwd::peek8(uint32_t addr) const
+{
+    return peek32(addr & ~0x03) >> ((addr & 0x03) * 8);
+}
+
+void SimSwd::poke8(uint32_t addr, uint8_t data)
+{
+    const uint32_t shift = (addr & 0x03) * 8;
+    const uint32_t word = peek32(addr & ~0x03);
+    poke32(addr & ~0x03, (word & ~(0xFF << shift)) | (data << shift));
+}
+
+uint32_t SimSwd::peek32(uint32_t addr) const
+{
+    const auto it = mMemory.find(addr & ~0x03);
+    return (it == mMemory.end()) ? 0 : it->second;
+}
+
+void SimSwd::poke32(uint32_t addr, uint32_t data)
+{
+    mMemory[addr & ~0x03] = data;
+}
+
+SimSwd::Response SimSwd::access(Cmd cmd, uint32_t& data)
+{
+    const bool ap = cmd & SWD_REG_AP;
+    const bool rd = cmd & SWD_REG_R;
+    const uint8_t addr = SWD_REG_ADR(cmd);
+    const bool overrunDetect = mDpCtrlStat & ORUNDETECT;
+
+    // with a sticky flag set only IDCODE, CTRL/STAT and ABORT are accepted
+    const bool sticky = mDpCtrlStat & CTRL_STAT_STICKY;
+    const bool errorAccess = not ap and (addr == 0x00 or (rd and (addr == 0x04) and ((mDpSelect & 0x0F) == 0)));
+
+    mStats.transfers++;
+    mStats.bits += cRequestBits + cAckBits;
+
+    Response ack;
+    if(sticky and not errorAccess)
+    {
+        ack = Fault;
+    }
+    else if(ap and mWaitInterval and ((++mApAccesses % mWaitInterval) == 0))
+    {
+        ack = Wait;
+    }
+    else
+    {
+        ack = ap ? accessAp(cmd, data) : accessDp(cmd, data);
+    }
+
+    if(ack == Ok)
+    {
+        mStats.bits += cDataBits;
+        return ack;
+    }
+
+    (ack == Wait) ? mStats.waits++ : mStats.faults++;
+    // WAIT and FAULT have a data phase with overrun detection, else only the turnaround
+    if(overrunDetect)
+    {
+        mDpCtrlStat |= STICKYORUN;
+        mStats.bits += cDataBits;
+    }
+    else
+    {
+        mStats.bits += 1;
+    }
+    return ack;
+}
+
+SimSwd::Response SimSwd::accessDp(Cmd cmd, uint32_t& data)
+{
+    const bool bank0 = (mDpSelect & 0x0F) == 0;
+    if(cmd & SWD_REG_R)
+    {
+        switch(SWD_REG_ADR(cmd))
+        {
+        case 0x00:
+            data = cIdcode;
+            break;
+        case 0x04:
+            data = 0;
+            if(bank0)
+            {
+                // power and reset requests are acknowledged at once
+                data = mDpCtrlStat | ((mDpCtrlStat & (CDBGRSTREQ | CDBGPWRUPREQ | CSYSPWRUPREQ)) << 1);
+            }
+            break;
+        default:
+            // RESEND and RDBUFF
+            data = mDpRdBuff;
+            break;
+        }
+        return Ok;
+    }
+
+    switch(SWD_REG_ADR(cmd))
+    {
+    case 0x00:
+        if(data & ORUNERRCLR)
+        {
+            mDpCtrlStat &= ~STICKYORUN;
+        }
+        if(data & WDERRCLR)
+        {
+            mDpCtrlStat &= ~WDATAERR;
+        }
+        if(data & STKERRCLR)
+        {
+            mDpCtrlStat &= ~STICKYERR;
+        }
+        if(data & STKCMPCLR)
+        {
+            mDpCtrlStat &= ~STICKYCMP;
+        }
+        break;
+    case 0x04:
+        if(bank0)
+        {
+            mDpCtrlStat = (data & CTRL_STAT_WRITABLE) | (mDpCtrlStat & CTRL_STAT_STICKY);
+        }
+        break;
+    case 0x08:
+        mDpSelect = data;
+        break;
+    default:
+        break;
+    }
+    return Ok;
+}
+
+SimSwd::Response SimSwd::accessAp(Cmd cmd, uint32_t& data)
+{
+    const bool rd = cmd & SWD_REG_R;
+    const uint32_t reg = (mDpSelect & APBANKSEL) | SWD_REG_ADR(cmd);
+
+    // AP reads are posted, the result comes with the next AP read or RDBUFF
+    uint32_t value = 0;
+    if(rd)
+    {
+        data = mDpRdBuff;
+    }
+    else
+    {
+        value = data;
+    }
+
+    if((mDpSelect & APSEL) != 0)
+    {
+        // there is only AP 0
+        mDpRdBuff = 0;
+        return Ok;
+    }
+
+    bool ok = true;
+    switch(reg)
+    {
+    case AP_CSW:
+        rd ? (value = mApCsw) : (mApCsw = value & ~CSW_TINPROG);
+        break;
+    case AP_TAR:
+        rd ? (value = mApTar) : (mApTar = value);
+        break;
+    case AP_DRW:
+    {
+        const uint32_t size = mApCsw & CSW_SIZE;
+        ok = rd ? readBus(mApTar, size, value) : writeBus(mApTar, size, value);
+        if(mApCsw & CSW_ADDRINC)
+        {
+            // the address only increments within the 1KB window
+            mApTar = (mApTar & ~(cTarIncWindow - 1)) | ((mApTar + (1 << size)) & (cTarIncWindow - 1));
+        }
+        break;
+    }
+    case AP_BD0:
+    case AP_BD1:
+    case AP_BD2:
+    case AP_BD3:
+    {
+        const uint32_t addr = (mApTar & ~0x0F) | (reg & 0x0C);
+        ok = rd ? readBus(addr, CSW_SIZE32, value) : writeBus(addr, CSW_SIZE32, value);
+        break;
+    }
+    case AP_ROM:
+        value = AP_ROM_VALUE;
+        break;
+    case AP_IDR:
+        value = cApIdr;
+        break;
+    default:
+        value = 0;
+        break;
+    }
+
+    if(not ok)
+    {
+        // the failing access is answered OK, the next one gets FAULT
+        mDpCtrlStat |= STICKYERR;
+        value = 0;
+    }
+    if(rd)
+    {
+        mDpRdBuff = value;
+    }
+    return Ok;
+}
+
+bool SimSwd::isFaultAddr(uint32_t addr) const
+{
+    for(const auto& region : mFaultRegions)
+    {
+        if((addr - region.addr) < region.size)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SimSwd::readBus(uint32_t addr, uint32_t size, uint32_t& data)
+{
+    if(isFaultAddr(addr))
+    {
+        return false;
+    }
+    // the whole word is returned, the lanes of a narrow access are in place
+    const uint32_t word = addr & ~0x03;
+    data = ((size == CSW_SIZE32) and ((word & ~0xFF) == (NVIC_Addr + 0x0D00))) ? readScs(word) : peek32(word);
+    return true;
+}
+
+bool SimSwd::writeBus(uint32_t addr, uint32_t size, uint32_t data)
+{
+    if(isFaultAddr(addr))
+    {
+        return false;
+    }
+
+    const uint32_t word = addr & ~0x03;
+    if((size == CSW_SIZE32) and ((word & ~0xFF) == (NVIC_Addr + 0x0D00)))
+    {
+        writeScs(word, data);
+        return true;
+    }
+
+    const uint32_t lanes = (size == CSW_SIZE8) ? (0xFFu << ((addr & 0x03) * 8)) :
+                           (size == CSW_SIZE16) ? (0xFFFFu << ((addr & 0x02) * 8)) : 0xFFFFFFFF;
+    poke32(word, (peek32(word) & ~lanes) | (data & lanes));
+    return true;
+}
+
+uint32_t SimSwd::readScs(uint32_t addr)
+{
+    switch(addr)
+    {
+    case NVIC_CPUID:
+        return cCpuid;
+    case NVIC_AIRCR:
+        return 0xFA050000;
+    case DBG_HCSR:
+        return mDhcsr | S_REGRDY;
+    case DBG_CRSR:
+        return 0;
+    case DBG_CRDR:
+        return mDcrdr;
+    case DBG_EMCR:
+        return mDemcr;
+    default:
+        return peek32(addr);
+    }
+}
+
+void SimSwd::writeScs(uint32_t addr, uint32_t data)
+{
+    switch(addr)
+    {
+    case NVIC_AIRCR:
+        if(((data & 0xFFFF0000) == VECTKEY) and (data & (SYSRESETREQ | VECTRESET)))
+        {
+            for(auto& reg : mRegs)
+            {
+                reg = 0;
+            }
+            mDhcsr |= S_RESET_ST;
+            const bool catchReset = (mDhcsr & C_DEBUGEN) and (mDemcr & VC_CORERESET);
+            mDhcsr = catchReset ? (mDhcsr | C_HALT | S_HALT) : (mDhcsr & ~(C_HALT | S_HALT));
+        }
+        break;
+    case DBG_HCSR:
+    {
+        if((data & 0xFFFF0000) != DBGKEY)
+        {
+            break;
+        }
+        const bool halted = mDhcsr & S_HALT;
+        mDhcsr = (mDhcsr & ~DHCSR_CTRL) | (data & DHCSR_CTRL);
+        if(not (mDhcsr & C_DEBUGEN))
+        {
+            mDhcsr &= ~S_HALT;
+        }
+        else if(mDhcsr & C_HALT)
+        {
+            if(halted and (mDhcsr & C_STEP))
+            {
+                mRegs[15] += 2;
+            }
+            mDhcsr |= S_HALT;
+        }
+        else if(halted)
+        {
+            resume();
+        }
+        break;
+    }
+    case DBG_CRSR:
+    {
+        const uint32_t sel = data & 0x7F;
+        if(sel < cCoreRegs)
+        {
+            (data & REGWnR) ? (mRegs[sel] = mDcrdr) : (mDcrdr = mRegs[sel]);
+        }
+        break;
+    }
+    case DBG_CRDR:
+        mDcrdr = data;
+        break;
+    case DBG_EMCR:
+        mDemcr = data;
+        break;
+    default:
+        poke32(addr, data);
+        break;
+    }
+}
+
+void SimSwd::resume()
+{
+    const uint32_t pc = mRegs[15] & ~0x01;
+    uint32_t result = 0;
+    if(mCallHandler)
+    {
+        result = mCallHandler(*this, pc, mRegs);
+    }
+    else
+    {
+        // run the CRC32 routine of the Swd, other code returns 0
+        bool crcCode = true;
+        for(uint32_t i = 0; crcCode and (i < (cCrc32CodeSize - 1)); i++)
+        {
+            crcCode = peek32(pc + i * 4) == cCrc32Code[i];
+        }
+        if(crcCode)
+        {
+            uint32_t crc = ~mRegs[2];
+            for(uint32_t i = 0; i < mRegs[1]; i++)
+            {
+                crc ^= peek8(mRegs[0] + i);
+                for(uint32_t bit = 0; bit < 8; bit++)
+                {
+                    crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+                }
+            }
+            result = ~crc;
+        }
+    }
+
+    // the function returns to the breakpoint at LR
+    mRegs[0] = result;
+    mRegs[15] = mRegs[14] & ~0x01;
+    mDhcsr |= C_HALT | S_HALT;
+}
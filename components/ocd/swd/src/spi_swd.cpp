@@ -19,20 +19,34 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 
 #include "driver/spi_master.h"
 #include "driver/gpio.h"
+#include "esp_heap_caps.h"
 #include <esp_log.h>
+#include <algorithm>
+#include <cstring>
 #include "spi_swd.hpp"
+#include "debug_cm.h"
 
 static const char * TAG = "SWDP";
-static spi_device_handle_t txspi;
+static spi_device_handle_t txspi = nullptr;
 static spi_device_handle_t txspi_parity;
 static spi_device_handle_t rxspi;
+static spi_device_handle_t packetspi;
+static bool busFailed = false;      // a transaction failed, the transfer running it fails
 
-#define SPI_CLK 1000000
+static inline void transmit(spi_device_handle_t spi, spi_transaction_t* pTransaction)
+{
+    const esp_err_t err = spi_device_transmit(spi, pTransaction);
+    if(err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "SPI transaction failed: %s", esp_err_to_name(err));
+        busFailed = true;
+    }
+}
 
 spi_device_interface_config_t readCfg = {
 	.command_bits = 0,
 	.mode = 1,          //SPI mode 3
-	.clock_speed_hz = SPI_CLK,
+	.clock_speed_hz = 1000000,
 	.spics_io_num = -1,
 	.flags = SPI_DEVICE_3WIRE | SPI_DEVICE_POSITIVE_CS | SPI_DEVICE_HALFDUPLEX | SPI_DEVICE_BIT_LSBFIRST,
 	.queue_size = 1,
@@ -41,17 +55,26 @@ spi_device_interface_config_t readCfg = {
 spi_device_interface_config_t writeCfg = {
 	.command_bits = 0,
 	.mode = 0,          //SPI mode 3                                                                                                                                                                        
-	.clock_speed_hz = SPI_CLK,
+	.clock_speed_hz = 1000000,
 	.spics_io_num = -1,
 	.flags = SPI_DEVICE_3WIRE | SPI_DEVICE_POSITIVE_CS | SPI_DEVICE_HALFDUPLEX | SPI_DEVICE_BIT_LSBFIRST,
 	.queue_size = 1,
 };
 
+spi_device_interface_config_t packetCfg = {
+	.command_bits = 0,
+	.mode = 0,
+	.clock_speed_hz = 1000000,
+	.spics_io_num = -1,
+	.flags = SPI_DEVICE_POSITIVE_CS | SPI_DEVICE_BIT_LSBFIRST,
+	.queue_size = 1,
+};
+
 spi_device_interface_config_t writeCfgParity = {
 	.command_bits = 2,
 	.address_bits = 32,
 	.mode = 0,          //SPI mode 3
-	.clock_speed_hz = SPI_CLK,
+	.clock_speed_hz = 1000000,
 	.spics_io_num = -1,
 	.flags = SPI_DEVICE_3WIRE | SPI_DEVICE_POSITIVE_CS | SPI_DEVICE_HALFDUPLEX | SPI_DEVICE_BIT_LSBFIRST,
 	.queue_size = 1,
@@ -65,7 +88,7 @@ static inline uint32_t swdptap_seq_in(int ticks)
         .length = (size_t)ticks,
 		.rxlength = (size_t)ticks,
     };
-    spi_device_transmit(rxspi, &t);
+    transmit(rxspi, &t);
 
 	uint32_t data = *((uint32_t*)t.rx_data);
 	return data;
@@ -80,7 +103,7 @@ static inline bool swdptap_seq_in_parity(uint32_t *ret, int ticks)
 		.rxlength = (size_t)(ticks + 3),
 		.rx_buffer = &buffer,
     };
-    spi_device_transmit(rxspi, &t);
+    transmit(rxspi, &t);
 	int parity = (buffer >> 32) & 1;
 	*ret = (uint32_t)(buffer);	
 	//ESP_LOGI(TAG, "%s %d %X", __func__, ticks, *ret);
@@ -102,7 +125,7 @@ static inline void swdptap_seq_out(uint32_t MS, int ticks)
     };
 	*(uint32_t*)t.tx_data = MS;
 	//ESP_LOGI(TAG, "%s %d %X", __func__, ticks, MS);
-    spi_device_transmit(txspi, &t);
+    transmit(txspi, &t);
 }
 
 static inline void swdptap_seq_out_parity(uint32_t MS, int ticks)
@@ -118,29 +141,109 @@ static inline void swdptap_seq_out_parity(uint32_t MS, int ticks)
     };
 	t.tx_data[0] = parity & 1;
 	//ESP_LOGI(TAG, "%s %d %X", __func__, ticks, MS);
-    spi_device_transmit(txspi_parity, &t);
+    transmit(txspi_parity, &t);
 }
 
-SpiSwd::SpiSwd()
+// Frame of a transfer in the packet mode, LSB first
+// write: request(8) trn(1) ack(3) trn(1) data(32) parity(1) idle(2)
+// read:  request(8) trn(1) ack(3) data(32) parity(1) trn(1) idle(2)
+// SWDIO is driven high while the target drives it, the series resistor lets the target win
+#define FRAME_ACK_POS 9
+#define FRAME_READ_DATA_POS 12
+#define FRAME_WRITE_DATA_POS 13
+#define FRAME_READ_IDLE 0x00003FFFFFFFFF00ULL   // trn, ack, data, parity and trn released
+#define FRAME_WRITE_IDLE 0x0000000000001F00ULL  // trn, ack and trn released
+
+SpiSwd::SpiSwd() :
+    mpTxPacket(nullptr),
+    mpRxPacket(nullptr)
 {
     esp_err_t ret;
+    const bool packet = cPinSwDioIn >= 0;
     ESP_LOGI(TAG, "Initializing bus SPI%d...", SPI2_HOST+1);
     spi_bus_config_t buscfg={
         .mosi_io_num = cPinSwDio,
-        .miso_io_num = -1,
+        .miso_io_num = cPinSwDioIn,
         .sclk_io_num = cPinSwClk,
         .quadwp_io_num = -1,
         .quadhd_io_num = -1,
-        .max_transfer_sz = 32,
+        .max_transfer_sz = packet ? (int)cPacketSize : 32,
     };
 
     //Initialize the SPI bus
-    ret = spi_bus_initialize(SPI2_HOST, &buscfg, SPI_DMA_DISABLED);
+    ret = spi_bus_initialize(SPI2_HOST, &buscfg, packet ? SPI_DMA_CH_AUTO : SPI_DMA_DISABLED);
     ESP_ERROR_CHECK(ret);
+    if(packet)
+    {
+        mpTxPacket = (uint8_t*)heap_caps_malloc(cPacketSize, MALLOC_CAP_DMA);
+        mpRxPacket = (uint8_t*)heap_caps_malloc(cPacketSize, MALLOC_CAP_DMA);
+        if((mpTxPacket == nullptr) or (mpRxPacket == nullptr))
+        {
+            ESP_LOGE(TAG, "no DMA memory for the packet mode");
+            heap_caps_free(mpTxPacket);
+            heap_caps_free(mpRxPacket);
+            mpTxPacket = nullptr;
+            mpRxPacket = nullptr;
+        }
+        ESP_LOGI(TAG, "packet mode SWDIO in %d", cPinSwDioIn);
+    }
+    setClock(cDefaultClock);
+    gpio_set_pull_mode(cPinSwDio, GPIO_PULLUP_ONLY);
+}
+
+SpiSwd::~SpiSwd()
+{
+    if(txspi)
+    {
+        spi_bus_remove_device(txspi);
+        spi_bus_remove_device(rxspi);
+        spi_bus_remove_device(txspi_parity);
+        if(mpTxPacket)
+        {
+            spi_bus_remove_device(packetspi);
+        }
+        txspi = nullptr;
+    }
+    heap_caps_free(mpTxPacket);
+    heap_caps_free(mpRxPacket);
+    spi_bus_free(SPI2_HOST);
+}
+
+uint32_t SpiSwd::setClock(uint32_t hz)
+{
+    if(hz == 0)
+    {
+        hz = cDefaultClock;
+    }
+
+    // The SPI clock can only be changed by adding the devices again
+    if(txspi)
+    {
+        spi_bus_remove_device(txspi);
+        spi_bus_remove_device(rxspi);
+        spi_bus_remove_device(txspi_parity);
+        if(mpTxPacket)
+        {
+            spi_bus_remove_device(packetspi);
+        }
+    }
+    readCfg.clock_speed_hz = hz;
+    writeCfg.clock_speed_hz = hz;
+    writeCfgParity.clock_speed_hz = hz;
+    packetCfg.clock_speed_hz = hz;
     spi_bus_add_device(SPI2_HOST, &writeCfg, &txspi);
     spi_bus_add_device(SPI2_HOST, &readCfg, &rxspi);
     spi_bus_add_device(SPI2_HOST, &writeCfgParity, &txspi_parity);
-    gpio_set_pull_mode(cPinSwDio, GPIO_PULLUP_ONLY);
+    if(mpTxPacket)
+    {
+        spi_bus_add_device(SPI2_HOST, &packetCfg, &packetspi);
+    }
+
+    int khz = 0;
+    spi_device_get_actual_freq(txspi, &khz);
+    mClock = khz * 1000;
+    ESP_LOGI(TAG, "clock %lu Hz achieved %lu Hz", hz, mClock);
+    return mClock;
 }
 
 uint32_t SpiSwd::sequence(uint64_t data, uint8_t bitLength)
@@ -159,6 +262,8 @@ uint32_t SpiSwd::sequence(uint64_t data, uint8_t bitLength)
 SpiSwd::Response SpiSwd::write(Cmd cmd, uint32_t data)
 {
     Response ack;
+    uint32_t retry = 0;
+    busFailed = false;
     do
     {
         swdptap_seq_out(getCmd(cmd), 8);
@@ -170,14 +275,22 @@ SpiSwd::Response SpiSwd::write(Cmd cmd, uint32_t data)
         else if((ack == Response::Wait) or (ack == Response::Fault))
         {
             sequence(0, 1);
+            if(mOverrunDetect)
+            {
+                // data phase of the rejected write
+                swdptap_seq_out(0, 32);
+                swdptap_seq_out(0, 1);
+            }
         }
-    } while(ack == Response::Wait);
-    return ack;
+    } while((ack == Response::Wait) and not mOverrunDetect and (++retry < cMaxWaitRetry) and not busFailed);
+    return busFailed ? Response::Error : ack;
 }
 
 SpiSwd::Response SpiSwd::read(Cmd cmd, uint32_t& data)
 {
     Response ack;
+    uint32_t retry = 0;
+    busFailed = false;
     do
     {
         swdptap_seq_out(getCmd(cmd), 8);
@@ -188,8 +301,111 @@ SpiSwd::Response SpiSwd::read(Cmd cmd, uint32_t& data)
         }
         else if((ack == Response::Wait) or (ack == Response::Fault))
         {
+            if(mOverrunDetect)
+            {
+                // data phase of the rejected read
+                swdptap_seq_in(32);
+                swdptap_seq_in(1);
+            }
             sequence(0, 1);
         }
-    } while(ack == Response::Wait);
-    return ack;
+    } while((ack == Response::Wait) and not mOverrunDetect and (++retry < cMaxWaitRetry) and not busFailed);
+    return busFailed ? Response::Error : ack;
+}
+
+SpiSwd::Response SpiSwd::transfer(Transfer* pTransfers, uint32_t count, uint32_t& done)
+{
+    // Without overrun detection a WAIT has no data phase and the rest of a packet would be out of sync
+    if(mpTxPacket and mOverrunDetect)
+    {
+        return transferPacket(pTransfers, count, done);
+    }
+    return Swd::transfer(pTransfers, count, done);
+}
+
+SpiSwd::Response SpiSwd::transferPacket(Transfer* pTransfers, uint32_t count, uint32_t& done)
+{
+    uint32_t retry = 0;
+    done = 0;
+    while(done < count)
+    {
+        Transfer* pTransfer = &pTransfers[done];
+        const uint32_t n = std::min(count - done, cMaxPacketTransfers);
+        for(uint32_t i = 0; i < n; i++)
+        {
+            uint64_t frame = getCmd(pTransfer[i].cmd);
+            if(pTransfer[i].cmd & SWD_REG_R)
+            {
+                frame |= FRAME_READ_IDLE;
+            }
+            else
+            {
+                const uint32_t data = pTransfer[i].data;
+                frame |= FRAME_WRITE_IDLE | ((uint64_t)data << FRAME_WRITE_DATA_POS) |
+                         ((uint64_t)(__builtin_popcount(data) & 1) << (FRAME_WRITE_DATA_POS + 32));
+            }
+            memcpy(&mpTxPacket[i * cFrameBytes], &frame, cFrameBytes);
+        }
+
+        // Pad to a word, DMA receives words
+        const uint32_t bytes = (n * cFrameBytes + 3) & ~3;
+        memset(&mpTxPacket[n * cFrameBytes], 0, bytes - n * cFrameBytes);
+        spi_transaction_t t = {};
+        t.length = bytes * 8;
+        t.rxlength = bytes * 8;
+        t.tx_buffer = mpTxPacket;
+        t.rx_buffer = mpRxPacket;
+        const esp_err_t err = spi_device_polling_transmit(packetspi, &t);
+        if(err != ESP_OK)
+        {
+            ESP_LOGE(TAG, "%s SPI transaction failed: %s", __func__, esp_err_to_name(err));
+            return Response::Error;
+        }
+
+        Response ack = Response::Ok;
+        uint32_t i = 0;
+        for(; i < n; i++)
+        {
+            uint64_t frame = 0;
+            memcpy(&frame, &mpRxPacket[i * cFrameBytes], cFrameBytes);
+            ack = static_cast<Response>((frame >> FRAME_ACK_POS) & 0x07);
+            if(ack != Response::Ok)
+            {
+                break;
+            }
+            if(pTransfer[i].cmd & SWD_REG_R)
+            {
+                const uint32_t data = frame >> FRAME_READ_DATA_POS;
+                if(((frame >> (FRAME_READ_DATA_POS + 32)) + __builtin_popcount(data)) & 1)
+                {
+                    ack = Response::ParityError;
+                    break;
+                }
+                if(pTransfer[i].pRead)
+                {
+                    *pTransfer[i].pRead = data;
+                }
+            }
+        }
+        done += i;
+
+        if(ack == Response::Ok)
+        {
+            retry = 0;
+            continue;
+        }
+        if((ack != Response::Wait) or (++retry > cMaxWaitRetry))
+        {
+            return ack;
+        }
+
+        // The WAIT set STICKYORUN and the target rejected the rest of the packet,
+        // clear it and resume from the transfer which got the WAIT
+        ack = write(SWD_REG_DP | SWD_REG_W | SWD_REG_ADR(DP_ABORT), ORUNERRCLR);
+        if(ack != Response::Ok)
+        {
+            return ack;
+        }
+    }
+    return Response::Ok;
 }
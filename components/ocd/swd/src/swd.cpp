@@ -19,6 +19,8 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 #include "swd.hpp"
 #include <esp_log.h>
 #include <chrono>
+#include <algorithm>
+#include <cstring>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
@@ -39,13 +41,77 @@ using namespace std::chrono_literals;
 #define DHCSR 0xE000EDF0
 #define REGWnR (1 << 16)
 
-#define MAX_SWD_RETRY 100   // 10
 #define MAX_TIMEOUT 1000000 // Timeout for syscalls on target
 
 static const char *TAG = "Swd";
 
-Swd::Swd() : mCsw(UINT32_MAX)
+// Bitwise reflected CRC32 (polynomial 0xEDB88320) with the inverted seed and result
+//      mvns    r2, r2
+//      ldr     r3, =0xEDB88320
+//      cmp     r1, #0
+//      beq     done
+// byte:
+//      ldrb    r4, [r0]
+//      adds    r0, #1
+//      eors    r2, r4
+//      movs    r4, #8
+// bit:
+//      lsrs    r2, r2, #1
+//      bcc     next
+//      eors    r2, r3
+// next:
+//      subs    r4, #1
+//      bne     bit
+//      subs    r1, #1
+//      bne     byte
+// done:
+//      mvns    r0, r2
+//      bx      lr
+const uint32_t Swd::cCrc32Code[] =
 {
+    0x4B0843D2, 0xD00A2900, 0x30017804, 0x24084062, 0xD3000852,
+    0x3C01405A, 0x3901D1FA, 0x43D0D1F4, 0x46C04770, 0xEDB88320,
+    0xBE00BE00,     // bkpt, the return address when there is no algorithm
+};
+const uint32_t Swd::cCrc32CodeSize = sizeof(cCrc32Code) / sizeof(cCrc32Code[0]);
+
+static inline uint32_t getLaneSize(uint32_t addr, uint32_t length)
+{
+    return ((addr & 0x01) or (length < 2)) ? 1 : 2;
+}
+
+static void extractLanes(uint32_t addr, uint32_t length, const uint32_t *pData, uint8_t *pBuffer)
+{
+    while (length)
+    {
+        const uint32_t size = getLaneSize(addr, length);
+        const uint32_t data = *pData++ >> ((addr & 0x03) << 3);
+        pBuffer[0] = data;
+        if (size == 2)
+        {
+            pBuffer[1] = data >> 8;
+        }
+        pBuffer += size;
+        addr += size;
+        length -= size;
+    }
+}
+
+Swd::Swd() :
+    mClock(0),
+    mOverrunDetect(false),
+    mBlockOverrunDetect(true),
+    mSelect(0),
+    mSelectValid(false),
+    mCtrlStat(0),
+    mCtrlStatValid(false),
+    mQueuedRequests(0),
+    mpPostedRead(nullptr),
+    mPostedRequest(0),
+    mPostedRead(false),
+    mPostedWrite(false)
+{
+    mQueue.reserve(cMaxQueuedTransfers + 4);
 }
 
 bool Swd::errorCheck(const char *func, Response res)
@@ -58,103 +124,324 @@ bool Swd::errorCheck(const char *func, Response res)
     return true;
 }
 
-bool Swd::cleareErrors()
+Swd::Response Swd::transfer(Transfer *pTransfers, uint32_t count, uint32_t &done)
 {
-    return writeDp(DP_ABORT, STKCMPCLR | STKERRCLR | WDERRCLR | ORUNERRCLR);
+    Response res = Response::Ok;
+    for (done = 0; done < count; done++)
+    {
+        Transfer &t = pTransfers[done];
+        if (t.cmd & SWD_REG_R)
+        {
+            uint32_t data;
+            res = read(t.cmd, data);
+            if (t.pRead)
+            {
+                *t.pRead = data;
+            }
+        }
+        else
+        {
+            res = write(t.cmd, t.data);
+        }
+
+        if (res != Response::Ok)
+        {
+            break;
+        }
+    }
+    return res;
 }
 
-bool Swd::readDp(uint8_t addr, uint32_t &dp)
+void Swd::queue(Cmd cmd, uint32_t data, uint32_t *pRead, uint32_t request)
 {
-    auto res = read(SWD_REG_DP | SWD_REG_R | SWD_REG_ADR(addr), dp);
-    return errorCheck(__func__, res);
+    mQueue.push_back(Transfer{.cmd = cmd, .data = data, .pRead = pRead, .request = request});
 }
 
-bool Swd::writeDp(uint8_t addr, uint32_t dp)
+void Swd::resolvePostedRead()
 {
-    auto res = write(SWD_REG_DP | SWD_REG_W | SWD_REG_ADR(addr), dp);
-    return errorCheck(__func__, res);
+    // The data of the posted AP read is returned by the next AP read or RDBUFF
+    if (mPostedRead or mPostedWrite)
+    {
+        queue(SWD_REG_DP | SWD_REG_R | SWD_REG_ADR(DP_RDBUFF), 0, mpPostedRead, mPostedRequest);
+        mpPostedRead = nullptr;
+        mPostedRead = false;
+        mPostedWrite = false;
+    }
 }
 
-bool Swd::readAp(uint8_t addr, uint32_t &ap, bool dpSelect)
+void Swd::invalidateCache()
 {
-    if (dpSelect)
+    mSelectValid = false;
+    mCtrlStatValid = false;
+    mOverrunDetect = false;     // the backend stops expecting the data phase of an overrun
+    mApCache.clear();
+}
+
+Swd::ApCache *Swd::getApCache()
+{
+    if (not mSelectValid)
     {
-        constexpr uint32_t apsel = DP_SELECT & 0xff000000;
-        constexpr uint32_t bank_sel = DP_SELECT & APBANKSEL;
-        if (not writeDp(DP_SELECT, apsel | bank_sel))
-        {
-            return false;
-        }
+        return nullptr;
     }
-    read(SWD_REG_AP | SWD_REG_R | SWD_REG_ADR(addr), ap);
-    auto res = read(SWD_REG_AP | SWD_REG_R | SWD_REG_ADR(addr), ap);
-    return errorCheck(__func__, res);
+    return &mApCache[mSelect >> 24];
 }
 
-bool Swd::readApMultiple(uint32_t *pBuffer, uint32_t length)
+uint32_t Swd::getTarIncrement(uint32_t csw)
 {
-    uint32_t ap;
-    Response res;
+    switch (csw & CSW_ADDRINC)
+    {
+    case CSW_SADDRINC:
+        return 1 << (csw & CSW_SIZE);
+    case CSW_PADDRINC:
+        return 4;
+    default:
+        return 0;
+    }
+}
 
-    res = read(SWD_REG_AP | SWD_REG_R | AP_DRW, ap);
-    if (not errorCheck(__func__, res))
+void Swd::advanceTar(ApCache &ap)
+{
+    if (not(ap.cswValid and ap.tarValid))
     {
-        return false;
+        ap.tarValid = false;
+        return;
     }
-    for (int i = 0; i < length - 1; i++)
+
+    // The TAR value is implementation defined when the increment crosses the window
+    const uint32_t tar = ap.tar + getTarIncrement(ap.csw);
+    ap.tarValid = ((tar ^ ap.tar) & ~(cTarIncWindow - 1)) == 0;
+    ap.tar = tar;
+}
+
+void Swd::queueSelect(uint32_t apAddr)
+{
+    const uint32_t dpBank = mSelectValid ? (mSelect & DP_DPBANKSEL) : 0;
+    queueWriteDp(DP_SELECT, (apAddr & (APSEL | APBANKSEL)) | dpBank);
+}
+
+void Swd::queueReadDp(uint8_t addr, uint32_t *pData)
+{
+    if (mPostedRead)
     {
-        res = read(SWD_REG_AP | SWD_REG_R | AP_DRW, ap);
-        if (not errorCheck(__func__, res))
+        resolvePostedRead();
+    }
+    queue(SWD_REG_DP | SWD_REG_R | SWD_REG_ADR(addr), 0, pData, mQueuedRequests++);
+}
+
+void Swd::queueWriteDp(uint8_t addr, uint32_t data)
+{
+    if (SWD_REG_ADR(addr) == DP_SELECT)
+    {
+        if (mSelectValid and (mSelect == data))
         {
-            return false;
+            mQueuedRequests++;
+            return;
         }
-        pBuffer[i] = ap;
+        mSelect = data;
+        mSelectValid = true;
+    }
+    else if ((SWD_REG_ADR(addr) == DP_CTRL_STAT) and not(mSelectValid and (mSelect & DP_DPBANKSEL)))
+    {
+        mCtrlStat = data & (CSYSPWRUPREQ | CDBGPWRUPREQ | CDBGRSTREQ | TRNMODE | MASKLANE | ORUNDETECT);
+        mCtrlStatValid = true;
+        mOverrunDetect = data & ORUNDETECT;
     }
-    res = read(SWD_REG_DP | SWD_REG_R | SWD_REG_ADR(DP_RDBUFF), ap);
-    pBuffer[length - 1] = ap;
-    return errorCheck(__func__, res);
+
+    if (mPostedRead)
+    {
+        resolvePostedRead();
+    }
+    queue(SWD_REG_DP | SWD_REG_W | SWD_REG_ADR(addr), data, nullptr, mQueuedRequests++);
 }
 
-bool Swd::writeAp(uint8_t addr, uint32_t ap, bool dpSelect)
+void Swd::queueReadAp(uint8_t addr, uint32_t *pData)
 {
-    if (dpSelect)
+    ApCache *pAp = getApCache();
+    if (pAp == nullptr)
     {
-        constexpr uint32_t apsel = DP_SELECT & 0xff000000;
-        constexpr uint32_t bank_sel = DP_SELECT & APBANKSEL;
-        if (not writeDp(DP_SELECT, apsel | bank_sel))
+        // Unknown AP, any TAR could be changed
+        mApCache.clear();
+    }
+    else if (((mSelect & APBANKSEL) | SWD_REG_ADR(addr)) == AP_DRW)
+    {
+        advanceTar(*pAp);
+    }
+
+    if (mPostedWrite)
+    {
+        resolvePostedRead();
+    }
+    // This transfer returns the data of the previous posted read
+    queue(SWD_REG_AP | SWD_REG_R | SWD_REG_ADR(addr), 0, mpPostedRead, mPostedRead ? mPostedRequest : mQueuedRequests);
+    mpPostedRead = pData;
+    mPostedRequest = mQueuedRequests++;
+    mPostedRead = true;
+}
+
+void Swd::queueWriteAp(uint8_t addr, uint32_t data)
+{
+    ApCache *pAp = getApCache();
+    const uint32_t reg = (mSelect & APBANKSEL) | SWD_REG_ADR(addr);
+    if (pAp == nullptr)
+    {
+        mApCache.clear();
+    }
+    else if (reg == AP_CSW)
+    {
+        if (pAp->cswValid and (pAp->csw == data))
         {
-            return false;
+            mQueuedRequests++;
+            return;
         }
-        if ((addr == AP_CSW) and (ap == mCsw))
+        pAp->csw = data;
+        pAp->cswValid = true;
+    }
+    else if (reg == AP_TAR)
+    {
+        if (pAp->tarValid and (pAp->tar == data))
         {
-            return true;
+            mQueuedRequests++;
+            return;
         }
+        pAp->tar = data;
+        pAp->tarValid = true;
+    }
+    else if (reg == AP_DRW)
+    {
+        advanceTar(*pAp);
     }
 
-    auto res = write(SWD_REG_AP | SWD_REG_W | SWD_REG_ADR(addr), ap);
-    if (not errorCheck(__func__, res))
+    if (mPostedRead)
     {
+        resolvePostedRead();
+    }
+    mPostedRequest = mQueuedRequests++;
+    queue(SWD_REG_AP | SWD_REG_W | SWD_REG_ADR(addr), data, nullptr, mPostedRequest);
+    mPostedWrite = true;
+}
+
+Swd::Response Swd::flushQueue(uint32_t &done)
+{
+    // The last posted AP access is completed by RDBUFF
+    resolvePostedRead();
+
+    uint32_t transferred = 0;
+    Response res = Response::Ok;
+    if (mQueue.size())
+    {
+        res = transfer(mQueue.data(), mQueue.size(), transferred);
+    }
+    done = (transferred < mQueue.size()) ? mQueue[transferred].request : mQueuedRequests;
+    if (res != Response::Ok)
+    {
+        // The shadow was updated when the transfers were queued
+        invalidateCache();
+    }
+
+    mQueue.clear();
+    mQueuedRequests = 0;
+    return res;
+}
+
+bool Swd::flushQueue(const char *func)
+{
+    uint32_t done;
+    auto res = flushQueue(done);
+    if (res != Response::Ok)
+    {
+        ESP_LOGE(TAG, "%s Res %d at %lu", func, (int)res, done);
         return false;
     }
+    return true;
+}
 
-    res = read(SWD_REG_DP | SWD_REG_R | SWD_REG_ADR(DP_RDBUFF), ap);
-    return errorCheck(__func__, res);
+bool Swd::cleareErrors()
+{
+    invalidateCache();
+    return writeDp(DP_ABORT, STKCMPCLR | STKERRCLR | WDERRCLR | ORUNERRCLR);
 }
 
-bool Swd::writeApMultiple(const uint32_t *pBuffer, uint32_t length)
+bool Swd::setOverrunDetect(bool enable)
 {
-    Response res;
-    for (int i = 0; i < length; i++)
+    if (mCtrlStatValid and (mOverrunDetect == enable))
     {
-        res = write(SWD_REG_AP | SWD_REG_W | AP_DRW, pBuffer[i]);
-        if (not errorCheck(__func__, res))
+        return true;
+    }
+
+    // CTRL/STAT is in DP bank 0
+    if (not mSelectValid or (mSelect & DP_DPBANKSEL))
+    {
+        queueWriteDp(DP_SELECT, mSelectValid ? (mSelect & ~DP_DPBANKSEL) : 0);
+    }
+    if (not mCtrlStatValid)
+    {
+        uint32_t ctrlStat;
+        queueReadDp(DP_CTRL_STAT, &ctrlStat);
+        if (not flushQueue(__func__))
         {
             return false;
         }
+        mCtrlStat = ctrlStat & (CSYSPWRUPREQ | CDBGPWRUPREQ | CDBGRSTREQ | TRNMODE | MASKLANE | ORUNDETECT);
+    }
+    return writeDp(DP_CTRL_STAT, enable ? (mCtrlStat | ORUNDETECT) : (mCtrlStat & ~ORUNDETECT));
+}
+
+bool Swd::readDp(uint8_t addr, uint32_t &dp)
+{
+    queueReadDp(addr, &dp);
+    return flushQueue(__func__);
+}
+
+bool Swd::writeDp(uint8_t addr, uint32_t dp)
+{
+    queueWriteDp(addr, dp);
+    return flushQueue(__func__);
+}
+
+bool Swd::readAp(uint32_t addr, uint32_t &ap, bool dpSelect)
+{
+    if (dpSelect)
+    {
+        queueSelect(addr);
+    }
+    queueReadAp(addr, &ap);
+    return flushQueue(__func__);
+}
+
+bool Swd::readApMultiple(uint32_t addr, uint32_t *pBuffer, uint32_t length, bool dpSelect)
+{
+    if (not beginBlock())
+    {
+        return false;
+    }
+    if (dpSelect)
+    {
+        queueSelect(addr);
+    }
+    return transferBlock(addr, pBuffer, nullptr, length);
+}
+
+bool Swd::writeAp(uint32_t addr, uint32_t ap, bool dpSelect)
+{
+    if (dpSelect)
+    {
+        queueSelect(addr);
+    }
+    queueWriteAp(addr, ap);
+    return flushQueue(__func__);
+}
+
+bool Swd::writeApMultiple(uint32_t addr, const uint32_t *pBuffer, uint32_t length, bool dpSelect)
+{
+    if (not beginBlock())
+    {
+        return false;
+    }
+    if (dpSelect)
+    {
+        queueSelect(addr);
     }
-    uint32_t dummy;
-    res = read(SWD_REG_DP | SWD_REG_R | SWD_REG_ADR(DP_RDBUFF), dummy);
-    return errorCheck(__func__, res);
+    return transferBlock(addr, nullptr, pBuffer, length);
 }
 
 bool Swd::writeMemory(uint32_t addr, uint32_t transferSize, uint32_t data)
@@ -178,28 +465,14 @@ bool Swd::writeMemory(uint32_t addr, uint32_t transferSize, uint32_t data)
     default:
         return false;
     }
-    if (not writeAp(AP_CSW, csw, true))
-    {
-        return false;
-    }
-
-    // TAR
-    auto res = write(SWD_REG_AP | SWD_REG_W | AP_TAR, addr);
-    if (not errorCheck(__func__, res))
-    {
-        return false;
-    }
-
-    // data
-    res = write(SWD_REG_AP | SWD_REG_W | AP_DRW, tmp);
-    if (not errorCheck(__func__, res))
-    {
-        return false;
-    }
 
-    // dummy read
-    res = read(SWD_REG_DP | SWD_REG_R | SWD_REG_ADR(DP_RDBUFF), tmp);
-    return errorCheck(__func__, res);
+    // SELECT, CSW, TAR, data and the RDBUFF read for the posted write go out in one batch,
+    // SELECT, CSW and TAR are skipped when the shadowed value is already in effect
+    queueSelect(AP_CSW);
+    queueWriteAp(AP_CSW, csw);
+    queueWriteAp(AP_TAR, addr);
+    queueWriteAp(AP_DRW, tmp);
+    return flushQueue(__func__);
 }
 
 bool Swd::readMemory(uint32_t addr, uint32_t transferSize, uint32_t &data)
@@ -220,30 +493,12 @@ bool Swd::readMemory(uint32_t addr, uint32_t transferSize, uint32_t &data)
         return false;
     }
 
-    // CSW
-    if (not writeAp(AP_CSW, csw, true))
-    {
-        return false;
-    }
-
-    // TAR
-    Response res = write(SWD_REG_AP | SWD_REG_W | AP_TAR, addr);
-    if (not errorCheck(__func__, res))
-    {
-        return false;
-    }
-
     uint32_t tmp;
-    // dummy read
-    res = read(SWD_REG_AP | SWD_REG_R | AP_DRW, tmp);
-    if (not errorCheck(__func__, res))
-    {
-        return false;
-    }
-
-    // read data
-    res = read(SWD_REG_AP | SWD_REG_R | SWD_REG_ADR(DP_RDBUFF), tmp);
-    if (not errorCheck(__func__, res))
+    queueSelect(AP_CSW);
+    queueWriteAp(AP_CSW, csw);
+    queueWriteAp(AP_TAR, addr);
+    queueReadAp(AP_DRW, &tmp);
+    if (not flushQueue(__func__))
     {
         return false;
     }
@@ -267,56 +522,294 @@ bool Swd::readMemory(uint32_t addr, uint32_t transferSize, uint32_t &data)
 
 bool Swd::writeMemoryBlcok32(uint32_t addr, const uint32_t *pBuffer, uint32_t length)
 {
-    if (not writeAp(AP_CSW, (CSW_VALUE | CSW_SIZE32), true))
+    if (not beginBlock())
     {
         return false;
     }
+    queueSelect(AP_CSW);
+    queueWriteAp(AP_CSW, CSW_VALUE | CSW_SIZE32);
+    queueWriteAp(AP_TAR, addr);
+    return transferBlock(AP_DRW, nullptr, pBuffer, length);
+}
 
-    // TAR
-    Response res = write(SWD_REG_AP | SWD_REG_W | AP_TAR, addr);
-    if (not errorCheck(__func__, res))
+bool Swd::readMemoryBlcok32(uint32_t addr, uint32_t *pBuffer, uint32_t length)
+{
+    if (not beginBlock())
     {
         return false;
     }
+    queueSelect(AP_CSW);
+    queueWriteAp(AP_CSW, CSW_VALUE | CSW_SIZE32);
+    queueWriteAp(AP_TAR, addr);
+    return transferBlock(AP_DRW, pBuffer, nullptr, length);
+}
+
+bool Swd::writeMemoryBlcok8(uint32_t addr, const uint8_t *pBuffer, uint32_t length)
+{
+    const uint32_t head = std::min((4 - (addr & 0x03)) & 0x03, length);
+    const uint32_t words = (length - head) / 4;
+    const uint32_t tail = length - head - words * 4;
 
-    return writeApMultiple(pBuffer, length);
+    if (words)
+    {
+        std::vector<uint32_t> buffer(words);
+        memcpy(buffer.data(), &pBuffer[head], words * 4);
+        if (not writeMemoryBlcok32(addr + head, buffer.data(), words))
+        {
+            return false;
+        }
+    }
+
+    if (head or tail)
+    {
+        queueSelect(AP_CSW);
+        queueLanes(addr, head, nullptr, pBuffer);
+        queueLanes(addr + length - tail, tail, nullptr, &pBuffer[length - tail]);
+        return flushQueue(__func__);
+    }
+    return true;
 }
 
-bool Swd::readMemoryBlcok32(uint32_t addr, uint32_t *pBuffer, uint32_t length)
+bool Swd::readMemoryBlcok8(uint32_t addr, uint8_t *pBuffer, uint32_t length)
 {
-    if (not writeAp(AP_CSW, (CSW_VALUE | CSW_SIZE32), true))
+    const uint32_t head = std::min((4 - (addr & 0x03)) & 0x03, length);
+    const uint32_t words = (length - head) / 4;
+    const uint32_t tail = length - head - words * 4;
+
+    if (words)
     {
-        return false;
+        std::vector<uint32_t> buffer(words);
+        if (not readMemoryBlcok32(addr + head, buffer.data(), words))
+        {
+            return false;
+        }
+        memcpy(&pBuffer[head], buffer.data(), words * 4);
+    }
+
+    if (head or tail)
+    {
+        uint32_t data[4];
+        queueSelect(AP_CSW);
+        const uint32_t n = queueLanes(addr, head, data, nullptr);
+        queueLanes(addr + length - tail, tail, &data[n], nullptr);
+        if (not flushQueue(__func__))
+        {
+            return false;
+        }
+        extractLanes(addr, head, data, pBuffer);
+        extractLanes(addr + length - tail, tail, &data[n], &pBuffer[length - tail]);
+    }
+    return true;
+}
+
+uint32_t Swd::queueLanes(uint32_t addr, uint32_t length, uint32_t *pRead, const uint8_t *pWrite)
+{
+    // A range within a word, halfword where it is aligned and byte otherwise
+    uint32_t n = 0;
+    while (length)
+    {
+        const uint32_t size = getLaneSize(addr, length);
+        queueWriteAp(AP_CSW, CSW_VALUE | ((size == 1) ? CSW_SIZE8 : CSW_SIZE16));
+        queueWriteAp(AP_TAR, addr);
+        if (pRead)
+        {
+            queueReadAp(AP_DRW, &pRead[n]);
+        }
+        else
+        {
+            const uint32_t data = (size == 1) ? pWrite[0] : (pWrite[0] | (pWrite[1] << 8));
+            queueWriteAp(AP_DRW, data << ((addr & 0x03) << 3));
+            pWrite += size;
+        }
+        addr += size;
+        length -= size;
+        n++;
+    }
+    return n;
+}
+
+bool Swd::beginBlock()
+{
+    // Called with an empty queue, the backend switches to the data phase on WAIT/FAULT with the flag
+    if (not mBlockOverrunDetect or setOverrunDetect(true))
+    {
+        return true;
     }
+    // The write may have reached the target
+    endBlock();
+    return false;
+}
 
-    // TAR
-    Response res = write(SWD_REG_AP | SWD_REG_W | AP_TAR, addr);
-    if (not errorCheck(__func__, res))
+bool Swd::endBlock()
+{
+    // Without a valid CTRL/STAT shadow it is read back and written without the flag
+    return not mBlockOverrunDetect or setOverrunDetect(false);
+}
+
+bool Swd::recoverBlock(Response res, uint32_t select)
+{
+    uint32_t ctrlStat = 0;
+    if (not(select & DP_DPBANKSEL))
+    {
+        readDp(DP_CTRL_STAT, ctrlStat);
+    }
+    // ABORT is accepted with the sticky flags set
+    if ((res != Response::Wait) or (ctrlStat & STICKYERR))
+    {
+        ESP_LOGE(TAG, "%s Res %d CTRL/STAT %08lX", __func__, (int)res, ctrlStat);
+        cleareErrors();
+        return false;
+    }
+    if (not writeDp(DP_ABORT, ORUNERRCLR))
     {
         return false;
     }
+    // Word by word without overrun detection, the backend retries on WAIT
+    queueWriteDp(DP_SELECT, select);
+    return setOverrunDetect(false);
+}
+
+bool Swd::transferBlock(uint32_t addr, uint32_t *pRead, const uint32_t *pWrite, uint32_t length)
+{
+    // The single transfers after it don't expect overrun detection
+    const bool ret = streamBlock(addr, pRead, pWrite, length);
+    return endBlock() and ret;
+}
+
+bool Swd::streamBlock(uint32_t addr, uint32_t *pRead, const uint32_t *pWrite, uint32_t length)
+{
+    // With the first TAR a DRW stream can be split at the auto increment window and resumed word by word
+    const uint32_t select = mSelect;
+    const ApCache *pAp = getApCache();
+    const bool drw = (pAp != nullptr) and (((mSelect & APBANKSEL) | SWD_REG_ADR(addr)) == AP_DRW);
+    const bool tarKnown = drw and pAp->cswValid and pAp->tarValid;
+    const uint32_t csw = tarKnown ? pAp->csw : 0;
+    const uint32_t tar = tarKnown ? pAp->tar : 0;
+    const uint32_t inc = tarKnown ? getTarIncrement(pAp->csw) : 0;
+    uint32_t stalls = 0;
+
+    for (uint32_t i = 0; i < length;)
+    {
+        uint32_t size = std::min(length - i, cMaxQueuedTransfers);
+        if (tarKnown and inc)
+        {
+            // A chunk ends at the auto increment window, the next one writes TAR again.
+            // The TAR write is skipped by the shadow while the prediction is still valid
+            const uint32_t addrInWindow = (tar + i * inc) & (cTarIncWindow - 1);
+            size = std::min(size, (cTarIncWindow - addrInWindow + inc - 1) / inc);
+            queueWriteAp(AP_TAR, tar + i * inc);
+        }
+
+        // Stream a chunk without looking at the ACKs in between, with overrun detection
+        // the target rejects everything after a WAIT so the first failure tells where to resume
+        const uint32_t end = i + size;
+        const uint32_t first = mQueuedRequests;
+        for (uint32_t j = i; j < end; j++)
+        {
+            if (pRead)
+            {
+                queueReadAp(addr, &pRead[j]);
+            }
+            else
+            {
+                queueWriteAp(addr, pWrite[j]);
+            }
+        }
+
+        uint32_t done;
+        const Response res = flushQueue(done);
+        if (res == Response::Ok)
+        {
+            i = end;
+            continue;
+        }
+
+        // The words before the failed request are complete
+        if (((done < first) and not tarKnown) or (drw and pRead and not tarKnown) or
+            (++stalls > cMaxWaitRetry) or not recoverBlock(res, select))
+        {
+            ESP_LOGE(TAG, "%s Res %d at %lu", __func__, (int)res, done);
+            return false;
+        }
+        if (done < first)
+        {
+            // CSW or TAR got the WAIT, the chunk starts over with both written again
+            if (not beginBlock())
+            {
+                return false;
+            }
+            queueWriteAp(AP_CSW, csw);
+            continue;
+        }
+        i += done - first;
+        ESP_LOGW(TAG, "%s Res %d, retry word %lu", __func__, (int)res, i);
+
+        // The word which got the WAIT goes alone, the backend retries it,
+        // then the stream continues from the TAR the target has now
+        if (tarKnown)
+        {
+            queueWriteAp(AP_TAR, tar + i * inc);
+        }
+        if (pRead)
+        {
+            queueReadAp(addr, &pRead[i]);
+        }
+        else
+        {
+            queueWriteAp(addr, pWrite[i]);
+        }
+        if (not flushQueue(__func__) or not beginBlock())
+        {
+            return false;
+        }
+        i++;
+        stalls = 0;
+    }
+    return true;
+}
 
-    return readApMultiple(pBuffer, length);
+void Swd::queueWriteMem32(uint32_t addr, uint32_t data)
+{
+    queueWriteAp(AP_TAR, addr);
+    queueWriteAp(AP_DRW, data);
+}
+
+void Swd::queueReadMem32(uint32_t addr, uint32_t *pData)
+{
+    queueWriteAp(AP_TAR, addr);
+    queueReadAp(AP_DRW, pData);
 }
 
 bool Swd::readGPR(uint32_t n, uint32_t &regVal)
 {
     int i = 0, timeout = 100;
-
-    if (not writeMemory(DCRSR, 32, n))
+    uint32_t status = 0;
+
+    // Select the register and read it back in one batch, S_REGRDY is usually set by then
+    queueSelect(AP_CSW);
+    queueWriteAp(AP_CSW, CSW_VALUE | CSW_SIZE32);
+    queueWriteMem32(DCRSR, n);
+    queueReadMem32(DHCSR, &status);
+    queueReadMem32(DCRDR, &regVal);
+    if (not flushQueue(__func__))
     {
         return false;
     }
 
+    if (status & S_REGRDY)
+    {
+        return true;
+    }
+
     // wait for S_REGRDY
     for (i = 0; i < timeout; i++)
     {
-        if (!readMemory(DHCSR, 32, regVal))
+        if (!readMemory(DHCSR, 32, status))
         {
             return false;
         }
 
-        if (regVal & S_REGRDY)
+        if (status & S_REGRDY)
         {
             break;
         }
@@ -338,13 +831,14 @@ bool Swd::readGPR(uint32_t n, uint32_t &regVal)
 bool Swd::writeGPR(uint32_t n, uint32_t regVal)
 {
     int i = 0, timeout = 100;
-
-    if (not writeMemory(DCRDR, 32, regVal))
-    {
-        return false;
-    }
-
-    if (not writeMemory(DCRSR, 32, n | REGWnR))
+    uint32_t status = 0;
+
+    queueSelect(AP_CSW);
+    queueWriteAp(AP_CSW, CSW_VALUE | CSW_SIZE32);
+    queueWriteMem32(DCRDR, regVal);
+    queueWriteMem32(DCRSR, n | REGWnR);
+    queueReadMem32(DHCSR, &status);
+    if (not flushQueue(__func__))
     {
         return false;
     }
@@ -352,14 +846,14 @@ bool Swd::writeGPR(uint32_t n, uint32_t regVal)
     // wait for S_REGRDY
     for (i = 0; i < timeout; i++)
     {
-        if (not readMemory(DHCSR, 32, regVal))
+        if (status & S_REGRDY)
         {
-            return false;
+            return true;
         }
 
-        if (regVal & S_REGRDY)
+        if (not readMemory(DHCSR, 32, status))
         {
-            return true;
+            return false;
         }
     }
 
@@ -433,7 +927,6 @@ bool Swd::waitUntilHalted()
 {
     // Wait for target to stop
     uint32_t val, i, timeout = MAX_TIMEOUT;
-    uint32_t pc;
     for (i = 0; i < timeout; i++)
     {
         if (not readMemory(DBG_HCSR, 32, val))
@@ -461,6 +954,34 @@ bool Swd::jtagToSwd()
 }
 
 bool Swd::sysCallExec(const ProgramSysCall& sysCallParam, uint32_t entry, uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4, FlashAlgoRetType return_type)
+{
+    uint32_t result;
+    if (not sysCallStart(sysCallParam, entry, arg1, arg2, arg3, arg4) or not sysCallWait(result))
+    {
+        return false;
+    }
+
+    if (return_type == FlashAlgoRetType::cPointer)
+    {
+        // Flash verify functions return pointer to byte following the buffer if successful.
+        if (result != (arg1 + arg2))
+        {
+            return false;
+        }
+    }
+    else
+    {
+        // Flash functions return 0 if successful.
+        if (result != 0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool Swd::sysCallStart(const ProgramSysCall& sysCallParam, uint32_t entry, uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4)
 {
     if(entry == 0)
     {
@@ -480,48 +1001,67 @@ bool Swd::sysCallExec(const ProgramSysCall& sysCallParam, uint32_t entry, uint32
     gprs.r[15] = entry;                       // PC: Entry Point
     gprs.xpsr = 0x01000000;                   // xPSR: T = 1, ISR = 0
 
-    ESP_LOGI(TAG, "%s PC %lX SP %lX SB %lX LR %lX", __func__, entry, sysCallParam.stackPointer,  sysCallParam.staticBase,  sysCallParam.breakPoint);
-    if (not writeDebugState(gprs))
-    {
-        return false;
-    }
-    ESP_LOGI(TAG, "%s Res writeDebugState done", __func__);
+    ESP_LOGD(TAG, "%s PC %lX SP %lX SB %lX LR %lX", __func__, entry, sysCallParam.stackPointer,  sysCallParam.staticBase,  sysCallParam.breakPoint);
+    return writeDebugState(gprs);
+}
 
+bool Swd::sysCallWait(uint32_t& result)
+{
     if (not waitUntilHalted())
     {
         return false;
     }
-    ESP_LOGI(TAG, "%s Res waitUntilHalted done", __func__);
 
-    if (not readGPR(0, gprs.r[0]))
+    if (not readGPR(0, result))
     {
         return false;
     }
 
     // remove the C_MASKINTS
-    if (not writeMemory(DBG_HCSR, 32, DBGKEY | C_DEBUGEN | C_HALT))
+    return writeMemory(DBG_HCSR, 32, DBGKEY | C_DEBUGEN | C_HALT);
+}
+
+bool Swd::crc32(uint32_t ram, uint32_t addr, uint32_t length, uint32_t& crc)
+{
+    uint32_t dhcsr;
+    if(not readMemory(DBG_HCSR, 32, dhcsr))
     {
         return false;
     }
+    if(not (dhcsr & S_HALT))
+    {
+        ESP_LOGE(TAG, "%s core is not halted", __func__);
+        return false;
+    }
 
-    if (return_type == FlashAlgoRetType::cPointer)
+    // R0-R4 are used by the routine, R9, SP, LR, PC and xPSR by sysCallStart()
+    static constexpr uint8_t cRegs[] = {0, 1, 2, 3, 4, 9, 13, 14, 15, 16};
+    uint32_t regs[sizeof(cRegs)];
+    std::vector<uint32_t> ramSave(cCrc32CodeSize);
+    for(uint32_t i = 0; i < sizeof(cRegs); i++)
     {
-        // Flash verify functions return pointer to byte following the buffer if successful.
-        if (gprs.r[0] != (arg1 + arg2))
+        if(not readGPR(cRegs[i], regs[i]))
         {
             return false;
         }
     }
-    else
+    if(not readMemoryBlcok32(ram, ramSave.data(), ramSave.size()))
     {
-        // Flash functions return 0 if successful.
-        if (gprs.r[0] != 0)
-        {
-            return false;
-        }
+        return false;
     }
 
-    return true;
+    const ProgramSysCall sysCall = {ram + (cCrc32CodeSize - 1) * 4 + 1, regs[5], regs[6]};
+    bool ret = writeMemoryBlcok32(ram, cCrc32Code, cCrc32CodeSize) and
+               sysCallStart(sysCall, ram | 1, addr, length, 0, 0) and
+               sysCallWait(crc);
+    // halt it in case the routine didn't return, then put back the debugger's state
+    ret = writeMemory(DBG_HCSR, 32, DBGKEY | C_DEBUGEN | C_HALT) and ret;
+    ret = writeMemoryBlcok32(ram, ramSave.data(), ramSave.size()) and ret;
+    for(uint32_t i = 0; i < sizeof(cRegs); i++)
+    {
+        ret = writeGPR(cRegs[i], regs[i]) and ret;
+    }
+    return writeMemory(DBG_HCSR, 32, DBGKEY | (dhcsr & (C_DEBUGEN | C_HALT | C_STEP | C_MASKINTS))) and ret;
 }
 
 bool Swd::initDebug()
@@ -879,6 +1419,7 @@ bool Swd::setStateBySw(TargetState state)
 
 bool Swd::reset()
 {
+    invalidateCache();
     uint64_t tmp = 0xffffffffffffffff;
     sequence(tmp, 51);
     return true;
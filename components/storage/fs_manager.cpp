@@ -16,10 +16,16 @@ along with this program; if not, write to the Free Software
 Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 */
 
+#include "sdkconfig.h"
 #include "fs_manager.hpp"
 #include "sdcard.hpp"
 
+#if CONFIG_IDF_TARGET_LINUX
+// the host build keeps the card in a directory under the working directory
+const char* FsManager::cMountPoint = "sdcard";
+#else
 const char* FsManager::cMountPoint = "/sdcard";
+#endif
 
 FsManager& FsManager::create()
 {
@@ -0,0 +1,167 @@
+/*
+Copyright (C) Yudoc Kim <craven@crowz.kr>
+ 
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+ 
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <esp_log.h>
+#include "driver/uart.h"
+#include "esp_timer.h"
+#include "logger_web.hpp"
+#include "uart.hpp"
+#include "file_server.hpp"
+#include "ocd.hpp"
+#include "log_file.hpp"
+#include "status.hpp"
+#include "console.hpp"
+
+static const char* TAG = "host";
+
+//! Bytes for the debug UART RX, paced as a target printing lines at a fixed rate
+class UartFeeder
+{
+public:
+    struct Config
+    {
+        std::string inputPath;      // lines replayed in a loop, empty: synthetic lines
+        uint32_t linesPerSec;
+        uint32_t seconds;           // 0: forever
+    };
+
+    UartFeeder(const Config& cfg) :
+        mConfig(cfg),
+        mLineIdx(0),
+        mSent(0),
+        mDropped(0)
+    {
+        if(not mConfig.inputPath.empty())
+        {
+            std::ifstream file(mConfig.inputPath);
+            std::string line;
+            while(std::getline(file, line))
+            {
+                mLines.push_back(line + '\n');
+            }
+            if(mLines.empty())
+            {
+                ESP_LOGE(TAG, "%s has no line, synthetic lines are used", mConfig.inputPath.c_str());
+            }
+        }
+    }
+
+    void run()
+    {
+        static constexpr uint32_t cPeriodMs = 10;
+        const int64_t start = esp_timer_get_time();
+        uint64_t lines = 0;
+        while((mConfig.seconds == 0) or ((esp_timer_get_time() - start) < mConfig.seconds * 1000000LL))
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(cPeriodMs));
+            const uint64_t due = (esp_timer_get_time() - start) * mConfig.linesPerSec / 1000000;
+            for(; lines < due; lines++)
+            {
+                const std::string line = getLine();
+                const int accepted = uart_host_inject(UartService::create().getCfg().uartNum, line.data(), line.size());
+                mSent += (accepted > 0) ? accepted : 0;
+                mDropped += line.size() - ((accepted > 0) ? accepted : 0);
+            }
+        }
+        ESP_LOGI(TAG, "UART RX %llu lines, %llu bytes, %llu bytes dropped in %.1f s",
+            (unsigned long long)lines, (unsigned long long)mSent, (unsigned long long)mDropped,
+            (esp_timer_get_time() - start) / 1e6);
+    }
+
+protected:
+    const Config mConfig;
+    std::vector<std::string> mLines;
+    uint64_t mLineIdx;
+    uint64_t mSent;
+    uint64_t mDropped;
+
+    std::string getLine()
+    {
+        if(mLines.size())
+        {
+            return mLines[mLineIdx++ % mLines.size()];
+        }
+        char line[96];
+        snprintf(line, sizeof(line), "[%10lld] synthetic line %llu: adc=%4u state=%s\n",
+            (long long)esp_timer_get_time(), (unsigned long long)mLineIdx, (unsigned)(mLineIdx * 37 % 4096),
+            (mLineIdx % 3) ? "run" : "idle");
+        mLineIdx++;
+        return line;
+    }
+};
+
+static void usage(const char* name)
+{
+    printf("usage: %s [-f file] [-r lines/s] [-t seconds]\n", name);
+    printf("  -f  replay the lines of the file as UART RX, synthetic lines by default\n");
+    printf("  -r  UART RX lines per second, default 100\n");
+    printf("  -t  exit after the time, 0 runs forever (default)\n");
+    printf("pyOCD server on localhost:5555 with a simulated target, SD card in ./%s\n", "sdcard");
+    printf("ESP_LOG_LEVEL=0-5 sets the log level, the log goes to stderr\n");
+}
+
+int main(int argc, char* argv[])
+{
+    UartFeeder::Config cfg{.inputPath = "", .linesPerSec = 100, .seconds = 0};
+    int opt;
+    while((opt = getopt(argc, argv, "f:r:t:h")) != -1)
+    {
+        switch(opt)
+        {
+        case 'f':
+            cfg.inputPath = optarg;
+            break;
+        case 'r':
+            cfg.linesPerSec = strtoul(optarg, nullptr, 0);
+            break;
+        case 't':
+            cfg.seconds = strtoul(optarg, nullptr, 0);
+            break;
+        default:
+            usage(argv[0]);
+            return (opt == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    // same order as app_main, without the network
+    Status::create();
+    Console::create();
+    UartService::create();
+    IndexHandler::create();
+    WsHandler::create();
+    Ocd::create();
+    FileServerHandler::create();
+    LogFile::create().init();
+
+    UartFeeder feeder(cfg);
+    feeder.run();
+
+    // the tasks block in socket and stdin reads, skip their destructors
+    fflush(stdout);
+    fflush(stderr);
+    std::quick_exit(EXIT_SUCCESS);
+}
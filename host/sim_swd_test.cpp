@@ -0,0 +1,408 @@
+/*
+Copyright (C) Yudoc Kim <craven@crowz.kr>
+ 
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+ 
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <esp_log.h>
+#include "sim_swd.hpp"
+#include "swd_executor.hpp"
+#include "pyocd_server.hpp"
+
+static const char* TAG = "sim_swd_test";
+
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+//! pyOCD client of the test, keeps the replies of the last request
+class TestIo : public PyOcdIo
+{
+public:
+    TestIo() : PyOcdIo([](char*, int){}) {}
+
+    uint32_t send(const char* message, uint32_t len) override
+    {
+        mReply.append(message, len);
+        return len;
+    }
+
+    std::string mReply;
+};
+
+//! Runs the pyOCD command set through the parser and the executor against SimSwd,
+//! the way a pyOCD client on the socket does
+class SimSwdTest
+{
+public:
+    static constexpr uint32_t cRam = 0x20000000;
+    static constexpr uint32_t cScratch = 0x20010000;    // the CRC32 routine
+    static constexpr uint32_t cFault = 0x30000000;
+    static constexpr uint32_t cDhcsr = 0xE000EDF0;
+    static constexpr uint32_t cClock = 4000000;
+    static constexpr uint32_t cOkBits = 8 + 4 + 34;     // request, ACK, data
+    static constexpr uint32_t cWaitBits = 8 + 4 + 1;    // request, ACK, turnaround
+
+    struct Reply
+    {
+        uint32_t status;
+        std::vector<uint32_t> result;
+    };
+
+    SimSwdTest() :
+        mExecutor(mSim),
+        mParser(mIo, mExecutor),
+        mId(0),
+        mFailures(0)
+    {
+
+    }
+
+    int run()
+    {
+        testConnect();
+        testMemory();
+        testCounters();
+        testTraffic();
+        testWait();
+        testFault();
+        testCrc32();
+        testErrors();
+        ESP_LOGI(TAG, "%lu failures", (unsigned long)mFailures);
+        return mFailures ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+protected:
+    SimSwd mSim;
+    SwdExecutor mExecutor;
+    TestIo mIo;
+    PyOcdParser mParser;
+    int mId;
+    uint32_t mFailures;
+
+    void check(bool ok, const char* cond, int line)
+    {
+        if(not ok)
+        {
+            ESP_LOGE(TAG, "line %d: %s", line, cond);
+            mFailures++;
+        }
+    }
+
+    //! \brief Send one request and decode its reply
+    Reply request(const char* name, const std::vector<uint32_t>& args = {})
+    {
+        std::string msg = "{\"id\": " + std::to_string(++mId) + ", \"request\": \"" + name + "\", \"arguments\": [";
+        for(size_t i = 0; i < args.size(); i++)
+        {
+            msg += (i ? ", " : "") + std::to_string(args[i]);
+        }
+        msg += "]}\n";
+        return send(msg);
+    }
+
+    //! \brief Parse raw input and decode the reply
+    Reply send(std::string msg)
+    {
+        mIo.mReply.clear();
+        mParser.parse(msg.data(), msg.size());
+        mParser.finish();
+
+        Reply reply{UINT32_MAX, {}};
+        const char* p = strstr(mIo.mReply.c_str(), "\"status\": ");
+        if(p)
+        {
+            reply.status = strtoul(p + strlen("\"status\": "), nullptr, 0);
+        }
+        p = strstr(mIo.mReply.c_str(), "\"result\": ");
+        if(p)
+        {
+            p += strlen("\"result\": ");
+            const bool array = (*p == '[');
+            char* pEnd = const_cast<char*>(p + (array ? 1 : 0));
+            do
+            {
+                const char* pStart = pEnd;
+                const uint32_t value = strtoul(pStart, &pEnd, 0);
+                if(pEnd == pStart)
+                {
+                    break;
+                }
+                reply.result.push_back(value);
+                pEnd += (*pEnd == ',') ? 1 : 0;
+            } while(array);
+        }
+        return reply;
+    }
+
+    //! \brief The first value of the result, UINT32_MAX for an error or no result
+    uint32_t value(const Reply& reply)
+    {
+        return ((reply.status == 0) and reply.result.size()) ? reply.result[0] : UINT32_MAX;
+    }
+
+    //! \brief Wire bits of the traffic since resetStats() without WAIT and FAULT
+    uint64_t okBits(const SimSwd::Stats& stats)
+    {
+        return static_cast<uint64_t>(stats.transfers - stats.waits - stats.faults) * cOkBits;
+    }
+
+    static std::vector<uint32_t> pattern(uint32_t count, uint32_t seed)
+    {
+        std::vector<uint32_t> data(count);
+        for(auto& word : data)
+        {
+            seed = seed * 1664525 + 1013904223;
+            word = seed;
+        }
+        return data;
+    }
+
+    // esp_rom_crc32_le(0, ...)
+    static uint32_t crc32(const std::vector<uint32_t>& bytes)
+    {
+        uint32_t crc = UINT32_MAX;
+        for(uint32_t byte : bytes)
+        {
+            crc ^= byte;
+            for(uint32_t bit = 0; bit < 8; bit++)
+            {
+                crc = (crc >> 1) ^ ((crc & 1) ? 0xEDB88320 : 0);
+            }
+        }
+        return ~crc;
+    }
+
+    void testConnect()
+    {
+        CHECK(request("hello", {1}).status == 0);
+        CHECK(request("open").status == 0);
+        CHECK(value(request("set_clock", {cClock})) == cClock);
+        CHECK(request("connect").status == 0);
+        CHECK(value(request("read_dp", {0x00})) == SimSwd::cIdcode);
+        // CSYSPWRUPREQ and CDBGPWRUPREQ, the simulated DP acknowledges both at once
+        CHECK(request("write_dp", {0x04, 0x50000000}).status == 0);
+        CHECK((value(request("read_dp", {0x04})) & 0xF0000000) == 0xF0000000);
+        CHECK(request("write_dp", {0x08, 0x000000F0}).status == 0);
+        CHECK(value(request("read_ap", {0x0C})) == SimSwd::cApIdr);
+        CHECK(request("write_dp", {0x08, 0}).status == 0);
+    }
+
+    void testMemory()
+    {
+        const std::vector<uint32_t> words = pattern(300, 1);
+        std::vector<uint32_t> args = {0, cRam};
+        args.insert(args.end(), words.begin(), words.end());
+        CHECK(request("write_block32", args).status == 0);
+        CHECK(request("read_block32", {0, cRam, 300}).result == words);
+        CHECK(mSim.peek32(cRam + 299 * 4) == words[299]);
+
+        std::vector<uint32_t> bytes = pattern(77, 2);
+        for(auto& byte : bytes)
+        {
+            byte &= 0xFF;
+        }
+        args = {0, cRam + 0x401};
+        args.insert(args.end(), bytes.begin(), bytes.end());
+        CHECK(request("write_block8", args).status == 0);
+        CHECK(request("read_block8", {0, cRam + 0x401, 77}).result == bytes);
+        CHECK(mSim.peek8(cRam + 0x401 + 76) == bytes[76]);
+
+        CHECK(request("write_mem", {0, cRam + 0x802, 0xBEEF, 16}).status == 0);
+        CHECK(value(request("read_mem", {0, cRam + 0x802, 16})) == 0xBEEF);
+        CHECK(value(request("read_mem", {0, cRam + 0x803, 8})) == 0xBE);
+    }
+
+    void testCounters()
+    {
+        {
+            std::lock_guard<Swd> lock(mSim);
+            mSim.resetStats();
+        }
+        // 2 KB crosses the 1 KB TAR window of the MEM-AP
+        CHECK(request("read_block32", {0, cRam, 512}).result.size() == 512);
+
+        std::lock_guard<Swd> lock(mSim);
+        const SimSwd::Stats stats = mSim.getStats();
+        CHECK((stats.waits == 0) and (stats.faults == 0) and (stats.sequences == 0));
+        CHECK((stats.transfers >= 512) and (stats.transfers < (512 + 32)));
+        CHECK(stats.bits == okBits(stats));
+        CHECK(mSim.getWireTimeUs() == (stats.bits * 1000000 / cClock));
+        ESP_LOGI(TAG, "read_block32 of 2 KB: %lu transfers, %llu bits, %lu us on the wire",
+            (unsigned long)stats.transfers, (unsigned long long)stats.bits, (unsigned long)mSim.getWireTimeUs());
+    }
+
+    //! \brief Run a request and return the traffic it made
+    SimSwd::Stats measure(const char* name, const std::vector<uint32_t>& args, uint32_t& status)
+    {
+        {
+            std::lock_guard<Swd> lock(mSim);
+            mSim.resetStats();
+        }
+        status = request(name, args).status;
+        std::lock_guard<Swd> lock(mSim);
+        return mSim.getStats();
+    }
+
+    //! \brief A clean request takes at least minTransfers and less than maxTransfers, all of them OK
+    void checkTraffic(const char* name, const std::vector<uint32_t>& args, uint32_t minTransfers, uint32_t maxTransfers, int line)
+    {
+        uint32_t status;
+        const SimSwd::Stats stats = measure(name, args, status);
+        check(status == 0, name, line);
+        check((stats.waits == 0) and (stats.faults == 0) and (stats.sequences == 0), name, line);
+        check((stats.transfers >= minTransfers) and (stats.transfers < maxTransfers), name, line);
+        check(stats.bits == okBits(stats), name, line);
+        ESP_LOGI(TAG, "%s: %lu transfers, %llu bits", name, (unsigned long)stats.transfers, (unsigned long long)stats.bits);
+    }
+
+    void testTraffic()
+    {
+        const std::vector<uint32_t> words = pattern(512, 5);
+        std::vector<uint32_t> args = {0, cRam + 0x2000};
+        args.insert(args.end(), words.begin(), words.end());
+        // a word per transfer, the TAR is written again at each 1 KB window
+        checkTraffic("write_block32", args, 512, 512 + 32, __LINE__);
+
+        std::vector<uint32_t> bytes = pattern(256, 6);
+        for(auto& byte : bytes)
+        {
+            byte &= 0xFF;
+        }
+        args = {0, cRam + 0x2801};
+        args.insert(args.end(), bytes.begin(), bytes.end());
+        // the unaligned head and tail by lanes, the aligned words as 32 bit
+        checkTraffic("write_block8", args, 256 / 4, 256 / 4 + 32, __LINE__);
+        checkTraffic("read_block8", {0, cRam + 0x2801, 256}, 256 / 4, 256 / 4 + 32, __LINE__);
+
+        // CSW, TAR and DRW, SELECT and RDBUFF when needed
+        checkTraffic("write_mem", {0, cRam + 0x2C00, 0x12345678, 32}, 3, 6, __LINE__);
+        checkTraffic("read_mem", {0, cRam + 0x2C00, 32}, 3, 6, __LINE__);
+    }
+
+    void testWait()
+    {
+        {
+            std::lock_guard<Swd> lock(mSim);
+            mSim.setWaitInterval(7);
+            mSim.resetStats();
+        }
+        const std::vector<uint32_t> words = pattern(600, 3);
+        std::vector<uint32_t> args = {0, cRam + 0x1000};
+        args.insert(args.end(), words.begin(), words.end());
+        CHECK(request("write_block32", args).status == 0);
+        CHECK(request("read_block32", {0, cRam + 0x1000, 600}).result == words);
+        CHECK(value(request("read_mem", {0, cRam + 0x1000, 32})) == words[0]);
+
+        std::lock_guard<Swd> lock(mSim);
+        const SimSwd::Stats stats = mSim.getStats();
+        CHECK(stats.waits > 0);
+        CHECK(stats.faults == 0);
+        // a WAIT takes the data phase too with overrun detection
+        CHECK(stats.bits >= (okBits(stats) + stats.waits * cWaitBits));
+        CHECK(stats.bits <= (okBits(stats) + stats.waits * cOkBits + stats.sequences * 64));
+        ESP_LOGI(TAG, "2.4 KB written and read with a WAIT every 7 AP accesses: %lu transfers, %lu waits",
+            (unsigned long)stats.transfers, (unsigned long)stats.waits);
+        mSim.setWaitInterval(0);
+    }
+
+    void testFault()
+    {
+        {
+            std::lock_guard<Swd> lock(mSim);
+            mSim.addFaultRegion(cFault, 0x100);
+            mSim.poke32(cFault - 4, 0x12345678);
+            mSim.resetStats();
+        }
+        CHECK(request("read_mem", {0, cFault + 0x10, 32}).status == 1);
+        CHECK(request("connect").status == 0);
+        CHECK(request("read_block32", {0, cFault - 8, 8}).status == 1);
+        // ORUNDETECT is cleared after a failed block too
+        CHECK((value(request("read_dp", {0x04})) & 1) == 0);
+        CHECK(request("connect").status == 0);
+        CHECK(request("write_mem", {0, cFault + 0xFC, 0x55, 8}).status == 1);
+        CHECK(request("connect").status == 0);
+        {
+            std::lock_guard<Swd> lock(mSim);
+            CHECK(mSim.getStats().faults > 0);
+        }
+
+        // the errors were cleared, the memory next to the region is fine
+        CHECK(value(request("read_mem", {0, cFault - 4, 32})) == 0x12345678);
+        CHECK(value(request("read_dp", {0x00})) == SimSwd::cIdcode);
+    }
+
+    void testCrc32()
+    {
+        std::vector<uint32_t> bytes = pattern(1000, 4);
+        for(auto& byte : bytes)
+        {
+            byte &= 0xFF;
+        }
+        std::vector<uint32_t> args = {0, cRam + 0x3000};
+        args.insert(args.end(), bytes.begin(), bytes.end());
+        CHECK(request("write_block8", args).status == 0);
+
+        // C_DEBUGEN and C_HALT, the routine runs on the halted core
+        CHECK(request("write_mem", {0, cDhcsr, 0xA05F0003, 32}).status == 0);
+        const Reply reply = request("crc32", {0, cScratch, cRam + 0x3000, 1000, cRam + 0x3000, 10});
+        CHECK(reply.status == 0);
+        CHECK(reply.result.size() == 2);
+        CHECK((reply.result.size() == 2) and (reply.result[0] == crc32(bytes)));
+        CHECK((reply.result.size() == 2) and (reply.result[1] == crc32({bytes.begin(), bytes.begin() + 10})));
+
+        // a call handler replaces the built-in routine, it gets the arguments in R0-R3
+        uint32_t address = 0;
+        uint32_t length = 0;
+        {
+            std::lock_guard<Swd> lock(mSim);
+            mSim.setCallHandler([&address, &length](SimSwd&, uint32_t, const uint32_t* pArgs) {
+                address = pArgs[0];
+                length = pArgs[1];
+                return 0xC0FFEE;
+            });
+        }
+        CHECK(value(request("crc32", {0, cScratch, cRam + 0x3000, 1000})) == 0xC0FFEE);
+        std::lock_guard<Swd> lock(mSim);
+        CHECK((address == (cRam + 0x3000)) and (length == 1000));
+        mSim.setCallHandler(nullptr);
+    }
+
+    void testErrors()
+    {
+        CHECK(request("write_dp", {0x08}).status == 1);
+        CHECK(request("read_block32", {0, cRam}).status == 1);
+        CHECK(request("write_mem", {0, cRam, 0x55}).status == 1);
+        CHECK(request("read_block32", {0, cRam, SwdExecutor::cMaxBlockSize / 4 + 1}).status == 1);
+        CHECK(request("read_block8", {0, cRam, SwdExecutor::cMaxBlockSize + 1}).status == 1);
+        CHECK(request("read_ap_multiple", {0x0C, UINT32_MAX}).status == 1);
+        CHECK(request("swd_sequence").status == 1);
+        // malformed, answered with the id decoded so far
+        CHECK(send("{\"id\": 99, \"request\": \"read_dp\" : }\n").status == 1);
+        CHECK(mIo.mReply.find("\"id\": 99") != std::string::npos);
+        CHECK(send("{\"request\" ]}\n").status == 1);
+        CHECK(value(request("read_dp", {0x00})) == SimSwd::cIdcode);
+    }
+};
+
+int main()
+{
+    SimSwdTest test;
+    return test.run();
+}
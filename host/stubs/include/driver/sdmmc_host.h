@@ -0,0 +1,56 @@
+/*
+Copyright (C) Yudoc Kim <craven@crowz.kr>
+ 
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+ 
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include "driver/gpio.h"
+#include "sdmmc_cmd.h"
+
+#define SDMMC_HOST_SLOT_1               1
+#define SDMMC_SLOT_FLAG_INTERNAL_PULLUP (1 << 0)
+#define SDMMC_SLOT_NO_CD                GPIO_NUM_NC
+#define SDMMC_SLOT_WIDTH_DEFAULT        0
+
+typedef struct
+{
+    gpio_num_t clk;
+    gpio_num_t cmd;
+    gpio_num_t d0;
+    gpio_num_t d1;
+    gpio_num_t d2;
+    gpio_num_t d3;
+    gpio_num_t cd;
+    gpio_num_t wp;
+    uint8_t width;
+    uint32_t flags;
+} sdmmc_slot_config_t;
+
+#define SDMMC_HOST_DEFAULT() { .slot = SDMMC_HOST_SLOT_1, .max_freq_khz = 20000 }
+#define SDMMC_SLOT_CONFIG_DEFAULT() {   \
+    .clk = GPIO_NUM_NC,                 \
+    .cmd = GPIO_NUM_NC,                 \
+    .d0 = GPIO_NUM_NC,                  \
+    .d1 = GPIO_NUM_NC,                  \
+    .d2 = GPIO_NUM_NC,                  \
+    .d3 = GPIO_NUM_NC,                  \
+    .cd = SDMMC_SLOT_NO_CD,             \
+    .wp = GPIO_NUM_NC,                  \
+    .width = SDMMC_SLOT_WIDTH_DEFAULT,  \
+    .flags = 0,                         \
+}
@@ -0,0 +1,33 @@
+/*
+Copyright (C) Yudoc Kim <craven@crowz.kr>
+ 
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+ 
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#pragma once
+
+#include "esp_vfs_dev.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void usb_serial_jtag_vfs_use_driver(void);
+esp_err_t usb_serial_jtag_vfs_set_rx_line_endings(esp_line_endings_t mode);
+esp_err_t usb_serial_jtag_vfs_set_tx_line_endings(esp_line_endings_t mode);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,45 @@
+/*
+Copyright (C) Yudoc Kim <craven@crowz.kr>
+ 
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+ 
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#pragma once
+
+#include "FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! \brief Tasks are detached threads, priority and stack size are ignored
+BaseType_t xTaskCreate(TaskFunction_t pvTaskCode, const char* pcName, uint32_t usStackDepth,
+    void* pvParameters, UBaseType_t uxPriority, TaskHandle_t* pvCreatedTask);
+void vTaskDelay(TickType_t xTicksToDelay);
+//! \brief Only a task suspending itself, NULL, it waits there until vTaskDelete()
+void vTaskSuspend(TaskHandle_t xTaskToSuspend);
+//! \brief Ends a task suspended in vTaskSuspend(NULL) and returns once its thread is done, NULL ends the caller
+void vTaskDelete(TaskHandle_t xTaskToDelete);
+TickType_t xTaskGetTickCount(void);
+
+//! \brief Handle of the calling thread, threads not made by xTaskCreate get one on first use
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+//! \brief Notification counter of a task, functions here where ESP-IDF has macros
+BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify);
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,59 @@
+/*
+Copyright (C) Yudoc Kim <craven@crowz.kr>
+ 
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+ 
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#pragma once
+
+// lwIP's BSD API on top of the host sockets
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <sys/select.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+
+// functions rather than macros: members named like the BSD calls (send, read) must not be hit
+
+static inline int lwip_socket(int domain, int type, int protocol) { return socket(domain, type, protocol); }
+static inline int lwip_bind(int s, const struct sockaddr* name, socklen_t namelen) { return bind(s, name, namelen); }
+static inline int lwip_listen(int s, int backlog) { return listen(s, backlog); }
+static inline int lwip_accept(int s, struct sockaddr* addr, socklen_t* addrlen) { return accept(s, addr, addrlen); }
+static inline int lwip_connect(int s, const struct sockaddr* name, socklen_t namelen) { return connect(s, name, namelen); }
+static inline ssize_t lwip_send(int s, const void* dataptr, size_t size, int flags) { return send(s, dataptr, size, flags); }
+static inline ssize_t lwip_recv(int s, void* mem, size_t len, int flags) { return recv(s, mem, len, flags); }
+static inline ssize_t lwip_write(int s, const void* dataptr, size_t size) { return write(s, dataptr, size); }
+static inline ssize_t lwip_writev(int s, const struct iovec* iov, int iovcnt) { return writev(s, iov, iovcnt); }
+static inline ssize_t lwip_read(int s, void* mem, size_t len) { return read(s, mem, len); }
+static inline int lwip_close(int s) { return close(s); }
+static inline int lwip_shutdown(int s, int how) { return shutdown(s, how); }
+static inline int lwip_setsockopt(int s, int level, int optname, const void* opval, socklen_t optlen)
+{
+    return setsockopt(s, level, optname, opval, optlen);
+}
+static inline int lwip_getsockopt(int s, int level, int optname, void* opval, socklen_t* optlen)
+{
+    return getsockopt(s, level, optname, opval, optlen);
+}
+static inline int lwip_poll(struct pollfd* fds, nfds_t nfds, int timeout) { return poll(fds, nfds, timeout); }
+static inline int lwip_select(int maxfdp1, fd_set* readset, fd_set* writeset, fd_set* exceptset, struct timeval* timeout)
+{
+    return select(maxfdp1, readset, writeset, exceptset, timeout);
+}
@@ -0,0 +1,69 @@
+/*
+Copyright (C) Yudoc Kim <craven@crowz.kr>
+ 
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+ 
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "nvs.h"
+
+namespace nvs
+{
+
+//! Namespace of the in-memory NVS, integer items only
+class NVSHandle
+{
+public:
+    NVSHandle(std::string&& ns) : cNamespace(std::move(ns)) {}
+    virtual ~NVSHandle() = default;
+
+    template<typename T>
+    esp_err_t set_item(const char* key, T value)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mItems[key] = static_cast<int64_t>(value);
+        return ESP_OK;
+    }
+
+    template<typename T>
+    esp_err_t get_item(const char* key, T& value)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto it = mItems.find(key);
+        if(it == mItems.end())
+        {
+            return ESP_ERR_NVS_NOT_FOUND;
+        }
+        value = static_cast<T>(it->second);
+        return ESP_OK;
+    }
+
+    esp_err_t commit() { return ESP_OK; }
+
+protected:
+    const std::string cNamespace;
+    std::mutex mMutex;
+    std::map<std::string, int64_t> mItems;
+};
+
+std::unique_ptr<NVSHandle> open_nvs_handle(const char* ns_name, nvs_open_mode_t open_mode, esp_err_t* err = nullptr);
+
+}
@@ -0,0 +1,41 @@
+/*
+Copyright (C) Yudoc Kim <craven@crowz.kr>
+ 
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+ 
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#pragma once
+
+// Configuration of the Linux host build, stands in for the one generated by menuconfig
+#define CONFIG_IDF_TARGET "linux"
+#define CONFIG_IDF_TARGET_LINUX 1
+
+// pins are not used on the host, the board only selects the code paths
+#define CONFIG_WIFI_DEBUGGER_V_0_6 1
+#define CONFIG_SD_SDIO_4BIT 1
+#define CONFIG_SWD_BACKEND_GPIO 1
+#define CONFIG_PYOCD_RX_BUFFER_SIZE 2048
+#define CONFIG_PYOCD_MAX_QUEUED_REPLIES 32
+#define CONFIG_PYOCD_MAX_CLIENTS 4
+#define CONFIG_DEBUG_UART_RX_BUFFER_SIZE 8192
+#define CONFIG_DEBUG_UART_EVENT_QUEUE_SIZE 32
+#define CONFIG_LOG_MSG_POOL_COUNT 16
+#define CONFIG_LOG_MSG_MAX_HEAP_COUNT 8
+
+#define CONFIG_FREERTOS_HZ 100
+#define CONFIG_SPIFFS_OBJ_NAME_LEN 32
+#define CONFIG_HTTPD_MAX_REQ_HDR_LEN 1024
+#define CONFIG_HTTPD_MAX_URI_LEN 1024
+#define CONFIG_HTTPD_WS_SUPPORT 1
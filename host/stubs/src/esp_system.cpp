@@ -0,0 +1,149 @@
+/*
+Copyright (C) Yudoc Kim <craven@crowz.kr>
+ 
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+ 
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_rom_crc.h"
+#include "esp_sntp.h"
+
+//-------------------------------------------------------------------
+// esp_err
+//-------------------------------------------------------------------
+const char* esp_err_to_name(esp_err_t code)
+{
+    switch(code)
+    {
+    case ESP_OK:                        return "ESP_OK";
+    case ESP_FAIL:                      return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:                return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:           return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE:         return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE:          return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND:             return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED:         return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT:               return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_NVS_NOT_FOUND:         return "ESP_ERR_NVS_NOT_FOUND";
+    default:                            return "UNKNOWN ERROR";
+    }
+}
+
+//-------------------------------------------------------------------
+// esp_log
+//-------------------------------------------------------------------
+// function local so that the logs of static constructors see it initialized
+static std::atomic<esp_log_level_t>& logLevel()
+{
+    static std::atomic<esp_log_level_t> level([]
+    {
+        const char* env = getenv("ESP_LOG_LEVEL");
+        return env ? static_cast<esp_log_level_t>(atoi(env)) : ESP_LOG_INFO;
+    }());
+    return level;
+}
+
+void esp_log_level_set(const char*, esp_log_level_t level)
+{
+    // one level for all the tags
+    logLevel() = level;
+}
+
+uint32_t esp_log_timestamp(void)
+{
+    static const auto start = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+void esp_log_write(esp_log_level_t level, const char*, const char* format, ...)
+{
+    if(level > logLevel())
+    {
+        return;
+    }
+    va_list list;
+    va_start(list, format);
+    vfprintf(stderr, format, list);
+    va_end(list);
+}
+
+//-------------------------------------------------------------------
+// esp_system
+//-------------------------------------------------------------------
+void esp_restart(void)
+{
+    fprintf(stderr, "esp_restart\n");
+    exit(EXIT_FAILURE);
+}
+
+//-------------------------------------------------------------------
+// esp_rom_crc
+//-------------------------------------------------------------------
+uint32_t esp_rom_crc32_le(uint32_t crc, uint8_t const* buf, uint32_t len)
+{
+    static const std::array<uint32_t, 256> cTable = []
+    {
+        std::array<uint32_t, 256> table;
+        for(uint32_t i = 0; i < table.size(); i++)
+        {
+            uint32_t c = i;
+            for(int bit = 0; bit < 8; bit++)
+            {
+                c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+            }
+            table[i] = c;
+        }
+        return table;
+    }();
+
+    crc = ~crc;
+    for(uint32_t i = 0; i < len; i++)
+    {
+        crc = cTable[(crc ^ buf[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+//-------------------------------------------------------------------
+// newlib
+//-------------------------------------------------------------------
+#if HOST_NEED_STRLCPY
+size_t strlcpy(char* dst, const char* src, size_t size)
+{
+    const size_t len = strlen(src);
+    if(size)
+    {
+        const size_t copy = (len < size) ? len : (size - 1);
+        memcpy(dst, src, copy);
+        dst[copy] = 0;
+    }
+    return len;
+}
+#endif
+
+//-------------------------------------------------------------------
+// esp_sntp
+//-------------------------------------------------------------------
+sntp_sync_status_t sntp_get_sync_status(void)
+{
+    return SNTP_SYNC_STATUS_COMPLETED;
+}
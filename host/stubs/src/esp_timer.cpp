@@ -0,0 +1,183 @@
+/*
+Copyright (C) Yudoc Kim <craven@crowz.kr>
+ 
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+ 
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#include <chrono>
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <thread>
+#include "esp_timer.h"
+
+struct esp_timer
+{
+    esp_timer_create_args_t args;
+    int64_t due;                // us, 0: not armed
+    uint64_t period;            // us, 0: one shot
+};
+
+//! Single timer task like the one of ESP-IDF, callbacks run one at a time in the order they are due
+class TimerTask
+{
+public:
+    static TimerTask& create()
+    {
+        static TimerTask task;
+        return task;
+    }
+
+    esp_err_t add(esp_timer* pTimer)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mTimers.push_back(pTimer);
+        return ESP_OK;
+    }
+
+    esp_err_t remove(esp_timer* pTimer)
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        // a running callback may still use the timer
+        mIdle.wait(lock, [this, pTimer]{ return mpRunning != pTimer; });
+        mTimers.remove(pTimer);
+        return ESP_OK;
+    }
+
+    esp_err_t arm(esp_timer* pTimer, uint64_t timeoutUs, uint64_t periodUs)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        pTimer->due = esp_timer_get_time() + timeoutUs;
+        pTimer->period = periodUs;
+        mWake.notify_one();
+        return ESP_OK;
+    }
+
+    esp_err_t disarm(esp_timer* pTimer)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        const bool armed = pTimer->due != 0;
+        pTimer->due = 0;
+        return armed ? ESP_OK : ESP_ERR_INVALID_STATE;
+    }
+
+protected:
+    std::mutex mMutex;
+    std::condition_variable mWake;
+    std::condition_variable mIdle;
+    std::list<esp_timer*> mTimers;
+    esp_timer* mpRunning;
+    std::thread mThread;
+
+    TimerTask() :
+        mpRunning(nullptr),
+        mThread([this]{ task(); })
+    {
+        mThread.detach();
+    }
+
+    void task()
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        while(true)
+        {
+            esp_timer* pNext = nullptr;
+            for(esp_timer* pTimer : mTimers)
+            {
+                if(pTimer->due and ((pNext == nullptr) or (pTimer->due < pNext->due)))
+                {
+                    pNext = pTimer;
+                }
+            }
+            if(pNext == nullptr)
+            {
+                mWake.wait(lock);
+                continue;
+            }
+            const int64_t now = esp_timer_get_time();
+            if(pNext->due > now)
+            {
+                mWake.wait_for(lock, std::chrono::microseconds(pNext->due - now));
+                continue;
+            }
+
+            pNext->due = pNext->period ? (pNext->due + pNext->period) : 0;
+            if(pNext->period and pNext->args.skip_unhandled_events and (pNext->due <= now))
+            {
+                pNext->due = now + pNext->period;
+            }
+            mpRunning = pNext;
+            lock.unlock();
+            pNext->args.callback(pNext->args.arg);
+            lock.lock();
+            mpRunning = nullptr;
+            mIdle.notify_all();
+        }
+    }
+};
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* create_args, esp_timer_handle_t* out_handle)
+{
+    if((create_args == nullptr) or (create_args->callback == nullptr) or (out_handle == nullptr))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *out_handle = new esp_timer{*create_args, 0, 0};
+    return TimerTask::create().add(*out_handle);
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    if(timer == nullptr)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return TimerTask::create().arm(timer, timeout_us, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period)
+{
+    if((timer == nullptr) or (period == 0))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return TimerTask::create().arm(timer, period, period);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    if(timer == nullptr)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return TimerTask::create().disarm(timer);
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    if(timer == nullptr)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    TimerTask::create().remove(timer);
+    delete timer;
+    return ESP_OK;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    static const auto cStart = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - cStart).count();
+}
@@ -0,0 +1,82 @@
+/*
+Copyright (C) Yudoc Kim <craven@crowz.kr>
+ 
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+ 
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "esp_log.h"
+#include "esp_vfs_fat.h"
+
+static const char* TAG = "vfs_fat";
+
+static esp_err_t mount(const char* base_path, sdmmc_card_t** out_card)
+{
+    if((base_path == nullptr) or (strlen(base_path) >= sizeof(sdmmc_card_t::path)))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    struct stat st;
+    if(stat(base_path, &st) != 0)
+    {
+        if(mkdir(base_path, 0755) != 0)
+        {
+            ESP_LOGE(TAG, "mkdir %s failed: errno %d", base_path, errno);
+            return ESP_FAIL;
+        }
+    }
+    else if(not S_ISDIR(st.st_mode))
+    {
+        ESP_LOGE(TAG, "%s is not a directory", base_path);
+        return ESP_FAIL;
+    }
+
+    sdmmc_card_t* pCard = new sdmmc_card_t{};
+    strcpy(pCard->path, base_path);
+    if(out_card)
+    {
+        *out_card = pCard;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_vfs_fat_sdmmc_mount(const char* base_path, const sdmmc_host_t*, const void*,
+    const esp_vfs_fat_sdmmc_mount_config_t*, sdmmc_card_t** out_card)
+{
+    return mount(base_path, out_card);
+}
+
+esp_err_t esp_vfs_fat_sdspi_mount(const char* base_path, const sdmmc_host_t*,
+    const sdspi_device_config_t*, const esp_vfs_fat_sdmmc_mount_config_t*, sdmmc_card_t** out_card)
+{
+    return mount(base_path, out_card);
+}
+
+esp_err_t esp_vfs_fat_sdcard_unmount(const char*, sdmmc_card_t* card)
+{
+    if(card == nullptr)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    delete card;
+    return ESP_OK;
+}
+
+void sdmmc_card_print_info(FILE* stream, const sdmmc_card_t* card)
+{
+    fprintf(stream, "Name: host directory\nPath: %s\n", card->path);
+}
@@ -0,0 +1,228 @@
+/*
+Copyright (C) Yudoc Kim <craven@crowz.kr>
+ 
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+ 
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+
+static const auto cStart = std::chrono::steady_clock::now();
+
+namespace
+{
+    //! What a task handle points to, freed only by vTaskDelete() from another task as tasks outlive their handles
+    struct HostTask
+    {
+        std::mutex mutex;
+        std::condition_variable notified;
+        uint32_t notifyCount = 0;
+        bool deleted = false;
+        std::thread thread;
+    };
+
+    //! Unwinds a deleted task to its thread function
+    struct TaskDeleted
+    {
+    };
+
+    thread_local HostTask* tpCurrentTask = nullptr;
+
+    struct HostQueue
+    {
+        const UBaseType_t length;
+        const UBaseType_t itemSize;
+        std::mutex mutex;
+        std::condition_variable changed;
+        std::deque<std::vector<uint8_t>> items;
+
+        HostQueue(UBaseType_t length, UBaseType_t itemSize) : length(length), itemSize(itemSize) {}
+    };
+
+    //! \brief Wait for ready like a FreeRTOS call with ticks timeout
+    template<typename Ready>
+    bool waitTicks(std::condition_variable& cv, std::unique_lock<std::mutex>& lock, TickType_t ticks, Ready ready)
+    {
+        if(ticks == portMAX_DELAY)
+        {
+            cv.wait(lock, ready);
+            return true;
+        }
+        return cv.wait_for(lock, std::chrono::milliseconds(ticks * portTICK_PERIOD_MS), ready);
+    }
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t pvTaskCode, const char*, uint32_t,
+    void* pvParameters, UBaseType_t, TaskHandle_t* pvCreatedTask, BaseType_t)
+{
+    HostTask* pTask = new HostTask();
+    pTask->thread = std::thread([pTask, pvTaskCode, pvParameters]
+    {
+        tpCurrentTask = pTask;
+        try
+        {
+            pvTaskCode(pvParameters);
+        }
+        catch(const TaskDeleted&)
+        {
+        }
+    });
+    if(pvCreatedTask)
+    {
+        *pvCreatedTask = pTask;
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t pvTaskCode, const char* pcName, uint32_t usStackDepth,
+    void* pvParameters, UBaseType_t uxPriority, TaskHandle_t* pvCreatedTask)
+{
+    return xTaskCreatePinnedToCore(pvTaskCode, pcName, usStackDepth, pvParameters, uxPriority, pvCreatedTask, 0);
+}
+
+void vTaskDelay(TickType_t xTicksToDelay)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(xTicksToDelay * portTICK_PERIOD_MS));
+}
+
+void vTaskSuspend(TaskHandle_t xTaskToSuspend)
+{
+    HostTask* pTask = static_cast<HostTask*>(xTaskGetCurrentTaskHandle());
+    if(xTaskToSuspend and (xTaskToSuspend != pTask))
+    {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(pTask->mutex);
+    pTask->notified.wait(lock, [pTask]{ return pTask->deleted; });
+    throw TaskDeleted();
+}
+
+void vTaskDelete(TaskHandle_t xTaskToDelete)
+{
+    HostTask* pTask = static_cast<HostTask*>(xTaskToDelete);
+    if((pTask == nullptr) or (pTask == xTaskGetCurrentTaskHandle()))
+    {
+        throw TaskDeleted();
+    }
+    {
+        std::lock_guard<std::mutex> lock(pTask->mutex);
+        pTask->deleted = true;
+        pTask->notified.notify_all();
+    }
+    pTask->thread.join();
+    delete pTask;
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    const auto elapsed = std::chrono::steady_clock::now() - cStart;
+    return std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() / portTICK_PERIOD_MS;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    if(tpCurrentTask == nullptr)
+    {
+        tpCurrentTask = new HostTask();
+    }
+    return tpCurrentTask;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify)
+{
+    HostTask* pTask = static_cast<HostTask*>(xTaskToNotify);
+    {
+        std::lock_guard<std::mutex> lock(pTask->mutex);
+        pTask->notifyCount++;
+    }
+    pTask->notified.notify_all();
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait)
+{
+    HostTask* pTask = static_cast<HostTask*>(xTaskGetCurrentTaskHandle());
+    std::unique_lock<std::mutex> lock(pTask->mutex);
+    const auto ready = [pTask]{ return pTask->notifyCount != 0; };
+    if(xTicksToWait == portMAX_DELAY)
+    {
+        pTask->notified.wait(lock, ready);
+    }
+    else
+    {
+        pTask->notified.wait_for(lock, std::chrono::milliseconds(xTicksToWait * portTICK_PERIOD_MS), ready);
+    }
+    const uint32_t count = pTask->notifyCount;
+    if(count)
+    {
+        pTask->notifyCount = xClearCountOnExit ? 0 : count - 1;
+    }
+    return count;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t uxQueueLength, UBaseType_t uxItemSize)
+{
+    return new HostQueue(uxQueueLength, uxItemSize);
+}
+
+void vQueueDelete(QueueHandle_t xQueue)
+{
+    delete static_cast<HostQueue*>(xQueue);
+}
+
+BaseType_t xQueueSend(QueueHandle_t xQueue, const void* pvItemToQueue, TickType_t xTicksToWait)
+{
+    HostQueue* pQueue = static_cast<HostQueue*>(xQueue);
+    std::unique_lock<std::mutex> lock(pQueue->mutex);
+    if(not waitTicks(pQueue->changed, lock, xTicksToWait, [pQueue]{ return pQueue->items.size() < pQueue->length; }))
+    {
+        return pdFAIL;
+    }
+    const uint8_t* pItem = static_cast<const uint8_t*>(pvItemToQueue);
+    pQueue->items.emplace_back(pItem, pItem + pQueue->itemSize);
+    pQueue->changed.notify_all();
+    return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t xQueue, void* pvBuffer, TickType_t xTicksToWait)
+{
+    HostQueue* pQueue = static_cast<HostQueue*>(xQueue);
+    std::unique_lock<std::mutex> lock(pQueue->mutex);
+    if(not waitTicks(pQueue->changed, lock, xTicksToWait, [pQueue]{ return not pQueue->items.empty(); }))
+    {
+        return pdFALSE;
+    }
+    std::copy(pQueue->items.front().begin(), pQueue->items.front().end(), static_cast<uint8_t*>(pvBuffer));
+    pQueue->items.pop_front();
+    pQueue->changed.notify_all();
+    return pdTRUE;
+}
+
+BaseType_t xQueueReset(QueueHandle_t xQueue)
+{
+    HostQueue* pQueue = static_cast<HostQueue*>(xQueue);
+    std::lock_guard<std::mutex> lock(pQueue->mutex);
+    pQueue->items.clear();
+    pQueue->changed.notify_all();
+    return pdPASS;
+}
@@ -0,0 +1,100 @@
+/*
+Copyright (C) Yudoc Kim <craven@crowz.kr>
+ 
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+ 
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#include <array>
+#include <mutex>
+#include "driver/gpio.h"
+
+struct Pin
+{
+    gpio_mode_t mode;
+    gpio_pull_mode_t pull;
+    uint32_t level;
+};
+
+static std::mutex sMutex;
+static std::array<Pin, GPIO_NUM_MAX> sPins;
+
+static bool isValid(gpio_num_t gpio_num)
+{
+    return (gpio_num >= 0) and (gpio_num < GPIO_NUM_MAX);
+}
+
+esp_err_t gpio_reset_pin(gpio_num_t gpio_num)
+{
+    if(not isValid(gpio_num))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    std::lock_guard<std::mutex> lock(sMutex);
+    sPins[gpio_num] = Pin{GPIO_MODE_INPUT, GPIO_PULLUP_ONLY, 0};
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_direction(gpio_num_t gpio_num, gpio_mode_t mode)
+{
+    if(not isValid(gpio_num))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    std::lock_guard<std::mutex> lock(sMutex);
+    sPins[gpio_num].mode = mode;
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_pull_mode(gpio_num_t gpio_num, gpio_pull_mode_t pull)
+{
+    if(not isValid(gpio_num))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    std::lock_guard<std::mutex> lock(sMutex);
+    sPins[gpio_num].pull = pull;
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_drive_capability(gpio_num_t gpio_num, gpio_drive_cap_t)
+{
+    return isValid(gpio_num) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level)
+{
+    if(not isValid(gpio_num))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    std::lock_guard<std::mutex> lock(sMutex);
+    sPins[gpio_num].level = level ? 1 : 0;
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio_num)
+{
+    if(not isValid(gpio_num))
+    {
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock(sMutex);
+    const Pin& pin = sPins[gpio_num];
+    if((pin.mode == GPIO_MODE_INPUT) or (pin.mode == GPIO_MODE_DISABLE))
+    {
+        return (pin.pull == GPIO_PULLDOWN_ONLY) ? 0 : 1;
+    }
+    return pin.level;
+}
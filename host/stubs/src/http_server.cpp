@@ -0,0 +1,152 @@
+/*
+Copyright (C) Yudoc Kim <craven@crowz.kr>
+ 
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+ 
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#include <list>
+#include <mutex>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_http_server.h"
+
+static const char* TAG = "httpd";
+
+//! Server of the host build, it only keeps the registered URIs
+struct HttpServer
+{
+    std::mutex mutex;
+    httpd_config_t config;
+    std::list<httpd_uri_t> uris;
+};
+
+esp_err_t httpd_start(httpd_handle_t* handle, const httpd_config_t* config)
+{
+    if((handle == nullptr) or (config == nullptr))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    HttpServer* pServer = new HttpServer;
+    pServer->config = *config;
+    *handle = pServer;
+    ESP_LOGW(TAG, "HTTP is not served by the host build");
+    return ESP_OK;
+}
+
+esp_err_t httpd_stop(httpd_handle_t handle)
+{
+    delete static_cast<HttpServer*>(handle);
+    return ESP_OK;
+}
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t* uri_handler)
+{
+    HttpServer* pServer = static_cast<HttpServer*>(handle);
+    if((pServer == nullptr) or (uri_handler == nullptr))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    std::lock_guard<std::mutex> lock(pServer->mutex);
+    for(const httpd_uri_t& uri : pServer->uris)
+    {
+        if((strcmp(uri.uri, uri_handler->uri) == 0) and (uri.method == uri_handler->method))
+        {
+            return ESP_ERR_INVALID_STATE;
+        }
+    }
+    if(pServer->uris.size() >= pServer->config.max_uri_handlers)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    pServer->uris.push_back(*uri_handler);
+    ESP_LOGI(TAG, "%s registered", uri_handler->uri);
+    return ESP_OK;
+}
+
+esp_err_t httpd_unregister_uri_handler(httpd_handle_t handle, const char* uri, httpd_method_t method)
+{
+    HttpServer* pServer = static_cast<HttpServer*>(handle);
+    if((pServer == nullptr) or (uri == nullptr))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    std::lock_guard<std::mutex> lock(pServer->mutex);
+    const size_t size = pServer->uris.size();
+    pServer->uris.remove_if([uri, method](const httpd_uri_t& registered)
+        {
+            return (strcmp(registered.uri, uri) == 0) and (registered.method == method);
+        });
+    return (size != pServer->uris.size()) ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+int httpd_req_to_sockfd(httpd_req_t*)
+{
+    return -1;
+}
+
+int httpd_req_recv(httpd_req_t*, char*, size_t)
+{
+    return HTTPD_SOCK_ERR_FAIL;
+}
+
+size_t httpd_req_get_url_query_len(httpd_req_t*)
+{
+    return 0;
+}
+
+esp_err_t httpd_req_get_url_query_str(httpd_req_t*, char*, size_t)
+{
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t httpd_resp_set_status(httpd_req_t*, const char*)
+{
+    return ESP_FAIL;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t*, const char*)
+{
+    return ESP_FAIL;
+}
+
+esp_err_t httpd_resp_set_hdr(httpd_req_t*, const char*, const char*)
+{
+    return ESP_FAIL;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t*, const char*, ssize_t)
+{
+    return ESP_FAIL;
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t*, const char*, ssize_t)
+{
+    return ESP_FAIL;
+}
+
+esp_err_t httpd_resp_send_err(httpd_req_t*, httpd_err_code_t, const char*)
+{
+    return ESP_FAIL;
+}
+
+esp_err_t httpd_ws_recv_frame(httpd_req_t*, httpd_ws_frame_t*, size_t)
+{
+    return ESP_FAIL;
+}
+
+esp_err_t httpd_ws_send_frame_async(httpd_handle_t, int, httpd_ws_frame_t*)
+{
+    return ESP_FAIL;
+}
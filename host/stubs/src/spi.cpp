@@ -0,0 +1,54 @@
+/*
+Copyright (C) Yudoc Kim <craven@crowz.kr>
+ 
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+ 
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#include <array>
+#include <mutex>
+#include "driver/spi_common.h"
+
+static std::mutex sMutex;
+static std::array<bool, SPI_HOST_MAX> sBusInit;
+
+esp_err_t spi_bus_initialize(spi_host_device_t host_id, const spi_bus_config_t* bus_config, int)
+{
+    if((host_id < 0) or (host_id >= SPI_HOST_MAX) or (bus_config == nullptr))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    std::lock_guard<std::mutex> lock(sMutex);
+    if(sBusInit[host_id])
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    sBusInit[host_id] = true;
+    return ESP_OK;
+}
+
+esp_err_t spi_bus_free(spi_host_device_t host_id)
+{
+    if((host_id < 0) or (host_id >= SPI_HOST_MAX))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    std::lock_guard<std::mutex> lock(sMutex);
+    if(not sBusInit[host_id])
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    sBusInit[host_id] = false;
+    return ESP_OK;
+}
@@ -0,0 +1,243 @@
+/*
+Copyright (C) Yudoc Kim <craven@crowz.kr>
+ 
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+ 
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include "freertos/queue.h"
+#include "driver/uart.h"
+
+//! RX FIFO of a port, filled by uart_host_inject()
+struct Port
+{
+    std::mutex mutex;
+    std::condition_variable rxReady;
+    std::deque<uint8_t> rx;
+    size_t rxSize;          // 0: driver not installed
+    uint32_t dropped;
+    QueueHandle_t events;   // nullptr: no event queue
+    bool full;              // UART_BUFFER_FULL posted, until the next read
+    int pattern;            // -1: pattern detection off
+    size_t patternQueueSize;
+    std::deque<int> patterns;
+};
+
+static std::array<Port, UART_NUM_MAX> sPorts;
+
+static Port* getPort(uart_port_t uart_num)
+{
+    return ((uart_num >= 0) and (uart_num < UART_NUM_MAX)) ? &sPorts[uart_num] : nullptr;
+}
+
+//! \note an event doesn't fit in a full queue, as from the ISR
+static void postEvent(Port* pPort, uart_event_type_t type, size_t size)
+{
+    if(pPort->events)
+    {
+        const uart_event_t event = {.type = type, .size = size, .timeout_flag = false};
+        xQueueSend(pPort->events, &event, 0);
+    }
+}
+
+esp_err_t uart_driver_install(uart_port_t uart_num, int rx_buffer_size, int, int queue_size,
+    QueueHandle_t* uart_queue, int)
+{
+    Port* pPort = getPort(uart_num);
+    if((pPort == nullptr) or (rx_buffer_size <= 0))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    std::lock_guard<std::mutex> lock(pPort->mutex);
+    pPort->rx.clear();
+    pPort->rxSize = rx_buffer_size;
+    pPort->dropped = 0;
+    pPort->full = false;
+    pPort->pattern = -1;
+    pPort->patterns.clear();
+    pPort->events = nullptr;
+    if(uart_queue and (queue_size > 0))
+    {
+        pPort->events = xQueueCreate(queue_size, sizeof(uart_event_t));
+        *uart_queue = pPort->events;
+    }
+    return ESP_OK;
+}
+
+esp_err_t uart_driver_delete(uart_port_t uart_num)
+{
+    Port* pPort = getPort(uart_num);
+    if(pPort == nullptr)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    std::lock_guard<std::mutex> lock(pPort->mutex);
+    pPort->rx.clear();
+    pPort->rxSize = 0;
+    pPort->rxReady.notify_all();
+    if(pPort->events)
+    {
+        vQueueDelete(pPort->events);
+        pPort->events = nullptr;
+    }
+    return ESP_OK;
+}
+
+esp_err_t uart_param_config(uart_port_t uart_num, const uart_config_t* uart_config)
+{
+    return (getPort(uart_num) and uart_config) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t uart_set_pin(uart_port_t uart_num, int, int, int, int)
+{
+    return getPort(uart_num) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+int uart_read_bytes(uart_port_t uart_num, void* buf, uint32_t length, TickType_t ticks_to_wait)
+{
+    Port* pPort = getPort(uart_num);
+    if((pPort == nullptr) or (buf == nullptr))
+    {
+        return -1;
+    }
+    std::unique_lock<std::mutex> lock(pPort->mutex);
+    if(pPort->rxSize == 0)
+    {
+        return -1;
+    }
+    const auto timeout = std::chrono::milliseconds(static_cast<uint64_t>(ticks_to_wait) * portTICK_PERIOD_MS);
+    pPort->rxReady.wait_for(lock, timeout, [pPort, length]{ return pPort->rx.size() >= length or (pPort->rxSize == 0); });
+
+    const uint32_t size = std::min<size_t>(length, pPort->rx.size());
+    std::copy_n(pPort->rx.begin(), size, static_cast<uint8_t*>(buf));
+    pPort->rx.erase(pPort->rx.begin(), pPort->rx.begin() + size);
+    pPort->full = false;
+    for(auto it = pPort->patterns.begin(); it != pPort->patterns.end();)
+    {
+        *it -= size;
+        it = (*it < 0) ? pPort->patterns.erase(it) : it + 1;
+    }
+    return size;
+}
+
+esp_err_t uart_get_buffered_data_len(uart_port_t uart_num, size_t* size)
+{
+    Port* pPort = getPort(uart_num);
+    if((pPort == nullptr) or (size == nullptr))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    std::lock_guard<std::mutex> lock(pPort->mutex);
+    *size = pPort->rx.size();
+    return ESP_OK;
+}
+
+esp_err_t uart_enable_pattern_det_baud_intr(uart_port_t uart_num, char pattern_chr, uint8_t chr_num,
+    int, int, int)
+{
+    Port* pPort = getPort(uart_num);
+    if((pPort == nullptr) or (chr_num != 1))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    std::lock_guard<std::mutex> lock(pPort->mutex);
+    pPort->pattern = static_cast<uint8_t>(pattern_chr);
+    return ESP_OK;
+}
+
+esp_err_t uart_pattern_queue_reset(uart_port_t uart_num, int queue_length)
+{
+    Port* pPort = getPort(uart_num);
+    if((pPort == nullptr) or (queue_length <= 0))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    std::lock_guard<std::mutex> lock(pPort->mutex);
+    pPort->patternQueueSize = queue_length;
+    pPort->patterns.clear();
+    return ESP_OK;
+}
+
+int uart_pattern_pop_pos(uart_port_t uart_num)
+{
+    Port* pPort = getPort(uart_num);
+    if(pPort == nullptr)
+    {
+        return -1;
+    }
+    std::lock_guard<std::mutex> lock(pPort->mutex);
+    if(pPort->patterns.empty())
+    {
+        return -1;
+    }
+    const int pos = pPort->patterns.front();
+    pPort->patterns.pop_front();
+    return pos;
+}
+
+int uart_write_bytes(uart_port_t uart_num, const void* src, size_t size)
+{
+    if(getPort(uart_num) == nullptr)
+    {
+        return -1;
+    }
+    return fwrite(src, 1, size, stdout);
+}
+
+int uart_host_inject(uart_port_t uart_num, const void* src, size_t size)
+{
+    Port* pPort = getPort(uart_num);
+    if(pPort == nullptr)
+    {
+        return -1;
+    }
+    std::lock_guard<std::mutex> lock(pPort->mutex);
+    if(pPort->rxSize == 0)
+    {
+        return -1;
+    }
+    const size_t accepted = std::min(size, pPort->rxSize - std::min(pPort->rxSize, pPort->rx.size()));
+    const uint8_t* pSrc = static_cast<const uint8_t*>(src);
+    bool pattern = false;
+    for(size_t i = 0; (pPort->pattern >= 0) and (i < accepted); i++)
+    {
+        if((pSrc[i] == pPort->pattern) and (pPort->patterns.size() < pPort->patternQueueSize))
+        {
+            pPort->patterns.push_back(pPort->rx.size() + i);
+            pattern = true;
+        }
+    }
+    pPort->rx.insert(pPort->rx.end(), pSrc, pSrc + accepted);
+    pPort->dropped += size - accepted;
+    pPort->rxReady.notify_all();
+
+    if(accepted)
+    {
+        postEvent(pPort, pattern ? UART_PATTERN_DET : UART_DATA, accepted);
+    }
+    if((accepted < size) and not pPort->full)
+    {
+        pPort->full = true;
+        postEvent(pPort, UART_BUFFER_FULL, 0);
+    }
+    return accepted;
+}
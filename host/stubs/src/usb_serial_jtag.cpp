@@ -0,0 +1,71 @@
+/*
+Copyright (C) Yudoc Kim <craven@crowz.kr>
+ 
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+ 
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#include <poll.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "freertos/FreeRTOS.h"
+#include "driver/usb_serial_jtag.h"
+#include "driver/usb_serial_jtag_vfs.h"
+
+esp_err_t usb_serial_jtag_driver_install(usb_serial_jtag_driver_config_t*)
+{
+    return ESP_OK;
+}
+
+esp_err_t usb_serial_jtag_driver_uninstall(void)
+{
+    return ESP_OK;
+}
+
+int usb_serial_jtag_read_bytes(void* buf, uint32_t length, TickType_t ticks_to_wait)
+{
+    pollfd fd{.fd = STDIN_FILENO, .events = POLLIN, .revents = 0};
+    const int timeout = (ticks_to_wait == portMAX_DELAY) ? -1 : static_cast<int>(ticks_to_wait * portTICK_PERIOD_MS);
+    if((poll(&fd, 1, timeout) <= 0) or not (fd.revents & POLLIN))
+    {
+        return 0;
+    }
+    const ssize_t len = read(STDIN_FILENO, buf, length);
+    if(len <= 0)
+    {
+        // stdin closed, nobody is attached to the console
+        usleep(((timeout > 0) ? timeout : 100) * 1000);
+        return 0;
+    }
+    return len;
+}
+
+int usb_serial_jtag_write_bytes(const void* src, size_t size, TickType_t)
+{
+    return fwrite(src, 1, size, stdout);
+}
+
+void usb_serial_jtag_vfs_use_driver(void)
+{
+}
+
+esp_err_t usb_serial_jtag_vfs_set_rx_line_endings(esp_line_endings_t)
+{
+    return ESP_OK;
+}
+
+esp_err_t usb_serial_jtag_vfs_set_tx_line_endings(esp_line_endings_t)
+{
+    return ESP_OK;
+}